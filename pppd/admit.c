@@ -0,0 +1,217 @@
+/*
+ * admit.c - limit the rate at which new sessions start authenticating.
+ *
+ * Copyright (c) 1993-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * When a large number of peers all connect at once (say after the
+ * access concentrator they come through has restarted), every pppd
+ * starts authenticating at once and the RADIUS servers behind them
+ * are swamped.  With the admit-rate option, all the pppds on the
+ * system share a token bucket, kept in the pppd database, and a
+ * session may only start authentication when it has a token.  A
+ * session which can't have one straight away reserves the next one
+ * and waits for it; if that wait would be longer than admit-max-wait,
+ * the link is terminated instead, telling the peer when to retry.
+ *
+ * Peers which were connected recently (identified by calling number,
+ * since we don't know their names until they have authenticated) may
+ * go ahead even when the bucket is empty, up to another admit-burst
+ * sessions, pushing newcomers further back in the queue.  The records
+ * of when each number was last seen are removed by dbgc.c once they
+ * are older than admit-recent.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pppd-private.h"
+
+int admit_rate = 0;		/* new sessions per second; 0 => no limit */
+int admit_burst = 0;		/* bucket size; 0 => admit_rate */
+int admit_max_wait = 30;	/* longest a session may wait, seconds */
+int admit_recent = 3600;	/* secs a reconnecting peer gets priority */
+
+#define ADMIT_BUCKET_KEY	"admit:bucket"
+#define ADMIT_SEEN_PREFIX	"admit:seen:"
+
+#define ONE_TOKEN	1000	/* tokens are kept in thousandths */
+
+struct admit_bucket {
+    int64_t tokens;		/* may be negative if sessions are waiting */
+    int64_t stamp;		/* when tokens was computed, ms */
+};
+
+static int64_t
+now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * get_bucket - read the bucket and add the tokens which have
+ * accumulated since it was last updated.  The caller holds the
+ * database lock.
+ */
+static void
+get_bucket(struct admit_bucket *b)
+{
+    void *data;
+    int len, burst, found = 0;
+    int64_t now;
+
+    now = now_ms();
+    burst = admit_burst > 0? admit_burst: admit_rate;
+    if (ppp_db_fetch(ADMIT_BUCKET_KEY, &data, &len) == 0) {
+	if (len == sizeof(*b)) {
+	    memcpy(b, data, sizeof(*b));
+	    found = 1;
+	}
+	free(data);
+    }
+    if (!found)
+	b->tokens = (int64_t) burst * ONE_TOKEN;
+    else if (now > b->stamp)
+	b->tokens += (now - b->stamp) * admit_rate;
+    if (b->tokens > (int64_t) burst * ONE_TOKEN)
+	b->tokens = (int64_t) burst * ONE_TOKEN;
+    b->stamp = now;
+}
+
+/*
+ * peer_is_recent - has the peer on this calling number had a session
+ * in the last admit_recent seconds?
+ */
+static int
+peer_is_recent(void)
+{
+    char key[sizeof(ADMIT_SEEN_PREFIX) + MAXNAMELEN];
+    void *data;
+    int len, recent = 0;
+    time_t t;
+
+    if (remote_number[0] == 0)
+	return 0;
+    slprintf(key, sizeof(key), "%s%s", ADMIT_SEEN_PREFIX, remote_number);
+    if (ppp_db_fetch(key, &data, &len) < 0)
+	return 0;
+    if (len == sizeof(t)) {
+	memcpy(&t, data, sizeof(t));
+	recent = time(NULL) - t <= admit_recent;
+    }
+    free(data);
+    return recent;
+}
+
+/*
+ * admit_request - ask to start authenticating.  Returns 1 if we may,
+ * after waiting *wait_ms milliseconds (which may be 0), or 0 if the
+ * link should be dropped, in which case *wait_ms says roughly when
+ * the peer might try again.  Without a database we always say yes.
+ */
+int
+admit_request(int *wait_ms)
+{
+    struct admit_bucket b;
+    int64_t wait;
+    int burst;
+
+    *wait_ms = 0;
+    if (ppp_db_lock() < 0)
+	return 1;
+    burst = admit_burst > 0? admit_burst: admit_rate;
+    get_bucket(&b);
+    if (b.tokens < ONE_TOKEN
+	&& !(b.tokens > -(int64_t) burst * ONE_TOKEN && peer_is_recent())) {
+	/* we'll have to wait until there is a whole token */
+	wait = (ONE_TOKEN - b.tokens) / admit_rate;
+	*wait_ms = wait;
+	if (wait > admit_max_wait * 1000) {
+	    ppp_db_unlock();
+	    return 0;
+	}
+    }
+    b.tokens -= ONE_TOKEN;
+    ppp_db_store(ADMIT_BUCKET_KEY, &b, sizeof(b));
+    ppp_db_unlock();
+    return 1;
+}
+
+/*
+ * admit_cancel - give back the token taken by admit_request, when
+ * the link goes down before we have used it.
+ */
+void
+admit_cancel(void)
+{
+    struct admit_bucket b;
+
+    if (ppp_db_lock() < 0)
+	return;
+    get_bucket(&b);
+    b.tokens += ONE_TOKEN;
+    ppp_db_store(ADMIT_BUCKET_KEY, &b, sizeof(b));
+    ppp_db_unlock();
+}
+
+/*
+ * admit_seen_expired - is a record of when a calling number was last
+ * seen too old to matter any more?  For dbgc.c, which removes them.
+ */
+int
+admit_seen_expired(const void *data, int len)
+{
+    time_t t;
+
+    if (len != sizeof(t))
+	return 1;
+    memcpy(&t, data, sizeof(t));
+    return time(NULL) - t > admit_recent;
+}
+
+/*
+ * admit_note_peer - remember that the peer on this calling number
+ * has authenticated, so it gets priority if it reconnects.
+ */
+void
+admit_note_peer(void)
+{
+    char key[sizeof(ADMIT_SEEN_PREFIX) + MAXNAMELEN];
+    time_t t;
+
+    if (remote_number[0] == 0)
+	return;
+    slprintf(key, sizeof(key), "%s%s", ADMIT_SEEN_PREFIX, remote_number);
+    t = time(NULL);
+    ppp_db_store(key, &t, sizeof(t));
+}
@@ -205,6 +205,9 @@ int (*null_auth_hook)(struct wordlist **paddrs,
 
 int (*allowed_address_hook)(u_int32_t addr) = NULL;
 
+/* Hook for a plugin to hand the session on to another channel */
+int (*bridge_hook)(void) = NULL;
+
 /* A notifier for when the peer has authenticated itself,
    and we are proceeding to the network phase. */
 struct notifier *auth_up_notifier = NULL;
@@ -230,6 +233,10 @@ static pid_t auth_script_pid = 0;
  */
 bool uselogin = 0;		/* Use /etc/passwd for checking PAP */
 bool session_mgmt = 0;		/* Do session management (login records) */
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+bool session_db = 0;		/* Keep login records in the pppd database */
+int wtmp_batch = 32;		/* # wtmp records to write at once */
+#endif
 bool cryptpap = 0;		/* Passwords in pap-secrets are encrypted */
 bool refuse_pap = 0;		/* Don't wanna auth. ourselves with PAP */
 bool refuse_chap = 0;		/* Don't wanna auth. ourselves with CHAP */
@@ -272,7 +279,13 @@ static char *uafname;		/* name of most recent +ua file */
 
 /* Prototypes for procedures local to this file. */
 
+static void start_authentication (int);
 static void network_phase (int);
+#ifdef PPP_WITH_TDB
+static void admit_wait_done (void *);
+static int admit_waiting;	/* waiting to be admitted by admit_request */
+static char admit_reason[64];	/* tells the peer when to try again */
+#endif
 static void check_idle (void *);
 static void connect_time_expired (void *);
 static int  null_login (int);
@@ -427,6 +440,40 @@ struct option auth_options[] = {
       &session_mgmt },
     { "enable-session", o_bool, &session_mgmt,
       "Enable session accounting for remote peers", OPT_PRIV | 1 },
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+    { "session-db", o_bool, &session_db,
+      "Keep login records in the pppd database rather than utmp",
+      OPT_PRIV | 1 },
+    { "wtmp-batch", o_int, &wtmp_batch,
+      "Number of wtmp records to write at once with session-db",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 1 },
+#endif
+#ifdef PPP_WITH_TDB
+    { "admit-rate", o_int, &admit_rate,
+      "Limit the rate at which new sessions start authenticating",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 0 },
+    { "admit-burst", o_int, &admit_burst,
+      "Number of new sessions which may start authenticating at once",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 0 },
+    { "admit-max-wait", o_int, &admit_max_wait,
+      "Longest time a new session may wait to start authenticating",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 0 },
+    { "admit-recent", o_int, &admit_recent,
+      "Seconds for which a reconnecting peer is given priority",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 0 },
+    { "auth-fail-limit", o_int, &auth_fail_limit,
+      "Reject peers locally after this many authentication failures",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 0 },
+    { "auth-fail-window", o_int, &auth_fail_window,
+      "Seconds after which authentication failures are forgotten",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 1 },
+    { "auth-fail-holdoff", o_int, &auth_fail_holdoff,
+      "Seconds to reject a peer for after too many failures",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 1 },
+    { "auth-fail-holdoff-max", o_int, &auth_fail_holdoff_max,
+      "Longest time to reject a peer for after too many failures",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 1 },
+#endif
 
     { "papcrypt", o_bool, &cryptpap,
       "PAP passwords are encrypted", 1 },
@@ -720,6 +767,8 @@ link_terminated(int unit)
 	print_link_stats();
     } else
 	notice("Link terminated.");
+    cpu_acct_report(1);
+    mempool_compact();
 
     /*
      * Delete pid files before disestablishing ppp.  Otherwise it
@@ -783,6 +832,13 @@ link_down(int unit)
 	    auth_script(PPP_PATH_AUTHDOWN);
 	}
     }
+#ifdef PPP_WITH_TDB
+    if (admit_waiting) {
+	UNTIMEOUT(admit_wait_done, (void *) (long) unit);
+	admit_waiting = 0;
+	admit_cancel();
+    }
+#endif
     if (!mp_on())
     {
 	upper_layers_down(unit);
@@ -817,11 +873,10 @@ void upper_layers_down(int unit)
 void
 link_established(int unit)
 {
-    int auth;
     lcp_options *wo = &lcp_wantoptions[unit];
     lcp_options *go = &lcp_gotoptions[unit];
-    lcp_options *ho = &lcp_hisoptions[unit];
 #ifdef PPP_WITH_EAPTLS
+    lcp_options *ho = &lcp_hisoptions[unit];
     lcp_options *ao = &lcp_allowoptions[unit];
 #endif
     int i;
@@ -872,6 +927,53 @@ link_established(int unit)
     }
 #endif
 
+#ifdef PPP_WITH_TDB
+    if (admit_rate > 0) {
+	int wait;
+
+	if (!admit_request(&wait)) {
+	    warn("too many new sessions: terminating link");
+	    slprintf(admit_reason, sizeof(admit_reason),
+		     "Too many new sessions, retry in %d seconds",
+		     (wait + 999) / 1000);
+	    ppp_set_status(EXIT_CONNECT_FAILED);
+	    lcp_close(unit, admit_reason);
+	    return;
+	}
+	if (wait > 0) {
+	    info("too many new sessions: waiting %d ms to authenticate", wait);
+	    admit_waiting = 1;
+	    ppp_timeout(admit_wait_done, (void *) (long) unit,
+			wait / 1000, (wait % 1000) * 1000);
+	    return;
+	}
+    }
+#endif
+    start_authentication(unit);
+}
+
+#ifdef PPP_WITH_TDB
+/*
+ * admit_wait_done - our turn to authenticate has come.
+ */
+static void
+admit_wait_done(void *arg)
+{
+    admit_waiting = 0;
+    start_authentication((long) arg);
+}
+#endif
+
+/*
+ * Start authenticating the peer and/or ourselves.
+ */
+static void
+start_authentication(int unit)
+{
+    int auth;
+    lcp_options *go = &lcp_gotoptions[unit];
+    lcp_options *ho = &lcp_hisoptions[unit];
+
     new_phase(PHASE_AUTHENTICATE);
     auth = 0;
     if (go->neg_eap) {
@@ -919,6 +1021,10 @@ network_phase(int unit)
     /* Log calling number. */
     if (*remote_number)
 	notice("peer from calling number %q authorized", remote_number);
+#ifdef PPP_WITH_TDB
+    if (admit_rate > 0)
+	admit_note_peer();
+#endif
 
     /*
      * If the peer had to authenticate, run the auth-up script now.
@@ -932,6 +1038,25 @@ network_phase(int unit)
 	}
     }
 
+    /*
+     * If a plugin wants the session passed on to another channel,
+     * have the kernel bridge the two and leave the rest to the far
+     * end.  LCP frames will be passed on too, so stop sending echoes.
+     */
+    if (bridge_hook) {
+	int fd = (*bridge_hook)();
+
+	if (fd >= 0) {
+	    if (ppp_bridge_channel(fd) < 0) {
+		lcp_close(unit, "Couldn't bridge session");
+		return;
+	    }
+	    lcp_echo_lowerdown(unit);
+	    new_phase(PHASE_RUNNING);
+	    return;
+	}
+    }
+
 #ifdef PPP_WITH_CBCP
     /*
      * If we negotiated callback, do it now.
@@ -1408,6 +1533,10 @@ auth_check_options(void)
     }
 #endif
 
+    /* A plugin relaying EAP to a server doesn't need secrets here */
+    if (!can_auth && wo->neg_eap && eap_passthrough_hook != NULL)
+	can_auth = 1;
+
     if (auth_required && !can_auth && noauth_addrs == NULL) {
 	if (default_auth) {
 	    ppp_option_error(
@@ -1475,7 +1604,7 @@ auth_reset(int unit)
 			      our_name, 1, NULL)))
 	    go->neg_chap = 0;
     }
-    if (go->neg_eap &&
+    if (go->neg_eap && eap_passthrough_hook == NULL &&
 	(hadchap == 0 || (hadchap == -1 &&
 	    !have_chap_secret((explicit_remote? remote_name: NULL), our_name,
 		1, NULL))) &&
@@ -1522,12 +1651,23 @@ check_passwd(int unit,
     slprintf(user, sizeof(user), "%.*v", userlen, auser);
     *msg = "";
 
+#ifdef PPP_WITH_TDB
+    if (authfail_blocked(user)) {
+	*msg = "Too many failed attempts";
+	BZERO(passwd, sizeof(passwd));
+	return UPAP_AUTHNAK;
+    }
+#endif
+
     /*
      * Check if a plugin wants to handle this.
      */
     if (pap_auth_hook) {
 	ret = (*pap_auth_hook)(user, passwd, msg, &addrs, &opts);
 	if (ret >= 0) {
+#ifdef PPP_WITH_TDB
+	    authfail_record(user, ret);
+#endif
 	    /* note: set_allowed_addrs() saves opts (but not addrs):
 	       don't free it! */
 	    if (ret)
@@ -1588,6 +1728,10 @@ check_passwd(int unit,
 	fclose(f);
     }
 
+#ifdef PPP_WITH_TDB
+    authfail_record(user, ret == UPAP_AUTHACK);
+#endif
+
     if (ret == UPAP_AUTHNAK) {
         if (**msg == 0)
 	    *msg = "Login incorrect";
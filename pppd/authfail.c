@@ -0,0 +1,208 @@
+/*
+ * authfail.c - reject peers which keep failing to authenticate.
+ *
+ * Copyright (c) 1993-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A peer with the wrong password usually just reconnects and tries
+ * again, and every attempt costs a trip to the RADIUS server or PAM.
+ * With the auth-fail-limit option, PAP and CHAP failures are counted in
+ * the pppd database, so all the pppds on the system see them, both for
+ * the name and calling number together and for the calling number
+ * alone (which catches a script trying one name after another).  Once
+ * either count reaches the limit, further attempts are rejected without
+ * asking the backend, for auth-fail-holdoff seconds, doubling with each
+ * further failure up to auth-fail-holdoff-max.  A count is forgotten
+ * auth-fail-window seconds after the last failure or the end of the
+ * holdoff, whichever is later, or as soon as the peer authenticates,
+ * so peers with the right password are never held back by it.  Records
+ * which have been forgotten are removed by dbgc.c, so that a script
+ * trying name after name doesn't fill the database.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pppd-private.h"
+
+int auth_fail_limit = 0;	/* failures before holdoff; 0 => off */
+int auth_fail_window = 300;	/* secs after which failures are forgotten */
+int auth_fail_holdoff = 60;	/* secs to reject for, at first */
+int auth_fail_holdoff_max = 3600; /* longest holdoff */
+
+#define AUTHFAIL_PREFIX	"authfail:"
+
+struct authfail_rec {
+    int count;			/* failures since the count was reset */
+    time_t last;		/* time of the last failure */
+    time_t until;		/* reject locally until this time */
+};
+
+static int local_rejects;	/* attempts we rejected without asking */
+
+/*
+ * authfail_keys - make the database keys for the peer: the name with
+ * the calling number, and the calling number alone, if we know it.
+ * Returns the number of keys.
+ */
+static int
+authfail_keys(char *user, char keys[2][MAXNAMELEN * 2 + 16])
+{
+    int n = 0;
+
+    slprintf(keys[n++], sizeof(keys[0]), "%s%s/%s", AUTHFAIL_PREFIX,
+	     user, remote_number);
+    if (remote_number[0])
+	slprintf(keys[n++], sizeof(keys[0]), "%s/%s", AUTHFAIL_PREFIX,
+		 remote_number);
+    return n;
+}
+
+/*
+ * rec_expired - has the count in r been forgotten by now?
+ */
+static int
+rec_expired(struct authfail_rec *r, time_t now)
+{
+    return now - (r->until > r->last? r->until: r->last) > auth_fail_window;
+}
+
+/*
+ * authfail_expired - can this record be removed?  For dbgc.c.
+ */
+int
+authfail_expired(const void *data, int len)
+{
+    struct authfail_rec r;
+
+    if (len != sizeof(r))
+	return 1;
+    memcpy(&r, data, sizeof(r));
+    return rec_expired(&r, time(NULL));
+}
+
+static int
+get_rec(char *key, struct authfail_rec *r)
+{
+    void *data;
+    int len, found = 0;
+
+    if (ppp_db_fetch(key, &data, &len) < 0)
+	return 0;
+    if (len == sizeof(*r)) {
+	memcpy(r, data, sizeof(*r));
+	found = 1;
+    }
+    free(data);
+    return found;
+}
+
+/*
+ * authfail_blocked - should we reject this attempt by user without
+ * checking it?  If so, logs the fact and returns 1.
+ */
+int
+authfail_blocked(char *user)
+{
+    char keys[2][MAXNAMELEN * 2 + 16];
+    char buf[16];
+    struct authfail_rec r;
+    time_t now;
+    int i, n;
+
+    if (auth_fail_limit <= 0)
+	return 0;
+    now = time(NULL);
+    n = authfail_keys(user, keys);
+    for (i = 0; i < n; ++i) {
+	if (get_rec(keys[i], &r) && r.until > now) {
+	    warn("%d authentication failures from %s%s%s: rejecting %q "
+		 "for %d more seconds", r.count,
+		 i? "calling number ": "", i? remote_number: user,
+		 (i == 0 && remote_number[0])? " on this number": "",
+		 user, (int) (r.until - now));
+	    ++local_rejects;
+	    slprintf(buf, sizeof(buf), "%d", local_rejects);
+	    ppp_script_setenv("AUTHFAIL_REJECTS", buf, 0);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * authfail_record - note the result of checking user's credentials.
+ */
+void
+authfail_record(char *user, int ok)
+{
+    char keys[2][MAXNAMELEN * 2 + 16];
+    char buf[16];
+    struct authfail_rec r;
+    time_t now;
+    int i, n, shift, holdoff, count;
+
+    if (auth_fail_limit <= 0 || ppp_db_lock() < 0)
+	return;
+    now = time(NULL);
+    n = authfail_keys(user, keys);
+    count = 0;
+    for (i = 0; i < n; ++i) {
+	if (ok) {
+	    ppp_db_delete(keys[i]);
+	    continue;
+	}
+	if (!get_rec(keys[i], &r) || rec_expired(&r, now)) {
+	    r.count = 0;
+	    r.until = 0;
+	}
+	++r.count;
+	r.last = now;
+	if (r.count >= auth_fail_limit) {
+	    shift = r.count - auth_fail_limit;
+	    holdoff = auth_fail_holdoff;
+	    while (shift-- > 0 && holdoff < auth_fail_holdoff_max)
+		holdoff *= 2;
+	    if (holdoff > auth_fail_holdoff_max)
+		holdoff = auth_fail_holdoff_max;
+	    r.until = now + holdoff;
+	    if (i == 0 || r.count == auth_fail_limit)
+		notice("%d authentication failures from %s%s: holding off "
+		       "for %d seconds", r.count, i? "calling number ": "",
+		       i? remote_number: user, holdoff);
+	}
+	ppp_db_store(keys[i], &r, sizeof(r));
+	if (r.count > count)
+	    count = r.count;
+    }
+    ppp_db_unlock();
+
+    slprintf(buf, sizeof(buf), "%d", count);
+    ppp_script_setenv("AUTHFAIL_COUNT", buf, 0);
+}
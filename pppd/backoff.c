@@ -0,0 +1,154 @@
+/*
+ * backoff.c - back off between reconnection attempts.
+ *
+ * Copyright (c) 1999-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * With a fixed holdoff, when the access concentrator or LNS that many
+ * clients use goes away, they all try again together every holdoff
+ * seconds.  With holdoff-max, each failed attempt instead waits a
+ * random time between holdoff and three times the previous wait
+ * ("decorrelated jitter"), up to holdoff-max, so the clients spread
+ * out, and they back off further while the far end stays down.  A
+ * session which stays up for holdoff-reset seconds puts the wait back
+ * to holdoff.
+ *
+ * The current wait, and when the next attempt may start, are kept in
+ * the pppd database under the link name (or device name), so a pppd
+ * restarted by a supervisor waits out the time left rather than
+ * starting again from holdoff.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "pppd-private.h"
+
+int holdoff_max = 0;		/* longest wait; 0 => fixed holdoff */
+int holdoff_reset = 300;	/* secs up before the wait goes back down */
+
+#define BACKOFF_PREFIX	"backoff:"
+
+struct backoff_rec {
+    int delay;			/* the last wait, seconds */
+    time_t until;		/* when the next attempt may start */
+};
+
+static struct backoff_rec current;	/* used if there is no database */
+
+static void
+backoff_key(char *key, int len)
+{
+    slprintf(key, len, "%s%s", BACKOFF_PREFIX,
+	     linkname[0]? linkname: devnam[0]? devnam: "-");
+}
+
+static void
+get_rec(char *key, struct backoff_rec *r)
+{
+    void *data;
+    int len;
+
+    *r = current;
+    if (ppp_db_fetch(key, &data, &len) < 0)
+	return;
+    if (len == sizeof(*r))
+	memcpy(r, data, sizeof(*r));
+    free(data);
+}
+
+/*
+ * backoff_pending - how long must we wait before the first attempt,
+ * because of failures before we were started?
+ */
+int
+backoff_pending(void)
+{
+    char key[MAXPATHLEN + 16];
+    struct backoff_rec r;
+    time_t now;
+
+    if (holdoff_max <= 0)
+	return 0;
+    backoff_key(key, sizeof(key));
+    get_rec(key, &r);
+    now = time(NULL);
+    if (r.until <= now)
+	return 0;
+    /* don't trust a record from the future */
+    if (r.until - now > holdoff_max)
+	return holdoff_max;
+    return r.until - now;
+}
+
+/*
+ * backoff_next - work out how long to wait before the next attempt.
+ * t is the fixed holdoff that would apply, failed says whether the
+ * link went down in a way that should count against the far end, and
+ * uptime is how long the link was up for, in seconds.
+ */
+int
+backoff_next(int t, int failed, int uptime)
+{
+    char key[MAXPATHLEN + 16], buf[16];
+    struct backoff_rec r;
+    int base, hi;
+
+    if (holdoff_max <= 0)
+	return t;
+    backoff_key(key, sizeof(key));
+    if (uptime >= holdoff_reset) {
+	/* the far end was working */
+	ppp_db_delete(key);
+	memset(&current, 0, sizeof(current));
+	return t;
+    }
+    if (!failed)
+	return t;		/* we went down on purpose */
+
+    base = holdoff > 0? holdoff: 1;
+    ppp_db_lock();
+    get_rec(key, &r);
+    hi = r.delay * 3;
+    if (hi < base)
+	hi = base;
+    r.delay = base + (int) (drand48() * (hi - base + 1));
+    if (r.delay > holdoff_max)
+	r.delay = holdoff_max;
+    r.until = time(NULL) + r.delay;
+    ppp_db_store(key, &r, sizeof(r));
+    ppp_db_unlock();
+    current = r;
+
+    info("Waiting %d seconds before reconnecting", r.delay);
+    slprintf(buf, sizeof(buf), "%d", r.delay);
+    ppp_script_setenv("HOLDOFF", buf, 0);
+    return r.delay;
+}
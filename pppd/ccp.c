@@ -68,7 +68,11 @@ static char deflate_value[8];
  */
 #ifdef PPP_WITH_MPPE
 bool refuse_mppe_stateful = 1;		/* Allow stateful mode? */
+static bool mppe_prefer_stateless = 0;	/* Nak stateful mode at first? */
 #endif
+static int ccp_reset_holdoff = 0;	/* Min ms between reset-requests */
+static int ccp_min_ratio = 0;		/* Turn compression off below this % */
+static int ccp_adapt_interval = 30;	/* Seconds between ratio samples */
 
 static struct option ccp_option_list[] = {
     { "noccp", o_bool, &ccp_protent.enabled_flag,
@@ -157,8 +161,21 @@ static struct option ccp_option_list[] = {
       "allow MPPE stateful mode", OPT_PRIO },
     { "nomppe-stateful", o_bool, &refuse_mppe_stateful,
       "disallow MPPE stateful mode", OPT_PRIO | 1 },
+    { "mppe-prefer-stateless", o_bool, &mppe_prefer_stateless,
+      "ask the peer for MPPE stateless mode before accepting stateful",
+      1 },
 #endif /* MPPE */
 
+    { "ccp-reset-holdoff", o_int, &ccp_reset_holdoff,
+      "Minimum time in ms between CCP Reset-Requests",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 0 },
+    { "ccp-min-ratio", o_int, &ccp_min_ratio,
+      "Turn compression off if the ratio stays below this percentage",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 0 },
+    { "ccp-adapt-interval", o_int, &ccp_adapt_interval,
+      "Seconds between compression ratio samples",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 1 },
+
     { NULL }
 };
 
@@ -217,6 +234,11 @@ static void ccp_up (fsm *);
 static void ccp_down (fsm *);
 static int  ccp_extcode (fsm *, int, int, u_char *, int);
 static void ccp_rack_timeout (void *);
+static void ccp_reset_deferred (void *);
+static void ccp_send_resetreq (fsm *);
+static void ccp_reset_report (int);
+static void ccp_adapt_start (fsm *);
+static void ccp_adapt_sample (void *);
 static char *method_name (ccp_options *, ccp_options *);
 
 static fsm_callbacks ccp_callbacks = {
@@ -250,6 +272,56 @@ static fsm_callbacks ccp_callbacks = {
 static int ccp_localstate[NUM_PPP];
 #define RACK_PENDING	1	/* waiting for reset-ack */
 #define RREQ_REPEAT	2	/* send another reset-req if no reset-ack */
+#define RREQ_DEFERRED	4	/* send a reset-req when the holdoff ends */
+#define STATEFUL_NAKED	8	/* have asked the peer for stateless MPPE */
+
+/*
+ * Reset statistics for the current CCP session.  On a lossy link each
+ * reset round trip stalls the link, so we count them and how long they
+ * take, to help tune ccp-reset-holdoff and the MPPE mode.
+ */
+struct ccp_reset_stats {
+    int errors;			/* decompression errors from the kernel */
+    int requests;		/* reset-requests sent */
+    int acks;			/* reset-acks received */
+    long total_ms;		/* total time waiting for reset-acks */
+    long max_ms;		/* longest wait for a reset-ack */
+    struct timeval last_req;	/* when we last sent a reset-request */
+};
+static struct ccp_reset_stats ccp_rstats[NUM_PPP];
+
+/*
+ * A session which needed this many resets had a lossy link, so later
+ * sessions ask the peer for stateless MPPE as with mppe-prefer-stateless.
+ */
+#define CCP_LOSSY_RESETS	8
+#ifdef PPP_WITH_MPPE
+static bool ccp_lossy_link;
+#endif
+
+/*
+ * State for ccp-min-ratio.  Every ccp-adapt-interval seconds we work
+ * out the ratio achieved since the last sample, in both directions
+ * together.  After CCP_ADAPT_SAMPLES poor samples in a row we
+ * renegotiate without compression, and after a while we try it again
+ * in case the traffic has changed.  Each time compression turns out
+ * to be no use, we wait twice as long (up to CCP_ADAPT_MAX_HOLD
+ * intervals) before trying again.
+ */
+#define CCP_ADAPT_SAMPLES	3
+#define CCP_ADAPT_MAX_HOLD	64
+#define CCP_ADAPT_MIN_BYTES	65536	/* don't judge on less than this */
+
+struct ccp_adapt {
+    int off;			/* compression is off for a poor ratio */
+    int bad;			/* consecutive samples below ccp-min-ratio */
+    int hold;			/* intervals before we try compression again */
+    int backoff;		/* how long to hold off next time */
+    int changes;		/* times we have turned compression off */
+    u_int32_t unc_bytes;	/* byte counts at the last sample */
+    u_int32_t comp_bytes;
+};
+static struct ccp_adapt ccp_adapt[NUM_PPP];
 
 #define RACKTIMEOUT	1	/* second */
 
@@ -416,6 +488,7 @@ ccp_close(int unit, char *reason)
 static void
 ccp_lowerup(int unit)
 {
+    memset(&ccp_adapt[unit], 0, sizeof(ccp_adapt[unit]));
     fsm_lowerup(&ccp_fsm[unit]);
 }
 
@@ -478,8 +551,19 @@ ccp_extcode(fsm *f, int code, int id, u_char *p, int len)
 
     case CCP_RESETACK:
 	if (ccp_localstate[f->unit] & RACK_PENDING && id == f->reqid) {
+	    struct ccp_reset_stats *rs = &ccp_rstats[f->unit];
+	    struct timeval now;
+	    long ms;
+
 	    ccp_localstate[f->unit] &= ~(RACK_PENDING | RREQ_REPEAT);
 	    UNTIMEOUT(ccp_rack_timeout, f);
+	    ppp_get_time(&now);
+	    ms = (now.tv_sec - rs->last_req.tv_sec) * 1000
+		+ (now.tv_usec - rs->last_req.tv_usec) / 1000;
+	    rs->acks++;
+	    rs->total_ms += ms;
+	    if (ms > rs->max_ms)
+		rs->max_ms = ms;
 	}
 	break;
 
@@ -519,6 +603,9 @@ ccp_resetci(fsm *f)
 
     *go = ccp_wantoptions[f->unit];
     all_rejected[f->unit] = 0;
+    ccp_localstate[f->unit] &= ~STATEFUL_NAKED;
+    if (ccp_adapt[f->unit].off)
+	go->deflate = go->bsd_compress = go->predictor_1 = go->predictor_2 = 0;
 
 #ifdef PPP_WITH_MPPE
     if (go->mppe) {
@@ -1063,6 +1150,7 @@ ccp_reqci(fsm *f, u_char *p, int *lenp, int dont_nak)
     int len, clen, type, nb;
     ccp_options *ho = &ccp_hisoptions[f->unit];
     ccp_options *ao = &ccp_allowoptions[f->unit];
+    ccp_options no_comp;
 #ifdef PPP_WITH_MPPE
     bool rej_for_ci_mppe = 1;	/* Are we rejecting based on a bad/missing */
 				/* CI_MPPE, or due to other options?       */
@@ -1072,6 +1160,14 @@ ccp_reqci(fsm *f, u_char *p, int *lenp, int dont_nak)
     retp = p0 = p;
     len = *lenp;
 
+    if (ccp_adapt[f->unit].off) {
+	/* compression was doing no good; don't let the peer use it either */
+	no_comp = *ao;
+	no_comp.deflate = no_comp.bsd_compress = 0;
+	no_comp.predictor_1 = no_comp.predictor_2 = 0;
+	ao = &no_comp;
+    }
+
     memset(ho, 0, sizeof(ccp_options));
     ho->method = (len > 0)? p[0]: -1;
 
@@ -1107,17 +1203,23 @@ ccp_reqci(fsm *f, u_char *p, int *lenp, int dont_nak)
 
 		/* Check state opt */
 		if (ho->mppe & MPPE_OPT_STATEFUL) {
-		    /*
-		     * We can Nak and request stateless, but it's a
-		     * lot easier to just assume the peer will request
-		     * it if he can do it; stateful mode is bad over
-		     * the Internet -- which is where we expect MPPE.
-		     */
-		   if (refuse_mppe_stateful) {
+		    if (refuse_mppe_stateful) {
 			error("Refusing MPPE stateful mode offered by peer");
 			newret = CONFREJ;
 			break;
 		    }
+		    /*
+		     * Stateful mode needs a reset round trip for every
+		     * lost packet, so if we prefer stateless, or the
+		     * last session saw a lot of loss, ask for stateless
+		     * once.  If the peer insists, we accept stateful.
+		     */
+		    if ((mppe_prefer_stateless || ccp_lossy_link)
+			&& !(ccp_localstate[f->unit] & STATEFUL_NAKED)) {
+			ccp_localstate[f->unit] |= STATEFUL_NAKED;
+			newret = CONFNAK;
+			ho->mppe &= ~MPPE_OPT_STATEFUL;
+		    }
 		}
 
 		/* Find out which of {S,L} are set. */
@@ -1413,6 +1515,8 @@ ccp_up(fsm *f)
     char method1[64];
 
     ccp_flags_set(f->unit, 1, 1);
+    memset(&ccp_rstats[f->unit], 0, sizeof(ccp_rstats[f->unit]));
+    ccp_adapt_start(f);
     if (ANY_COMPRESS(*go)) {
 	if (ANY_COMPRESS(*ho)) {
 	    if (go->method == ho->method) {
@@ -1442,7 +1546,11 @@ ccp_down(fsm *f)
 {
     if (ccp_localstate[f->unit] & RACK_PENDING)
 	UNTIMEOUT(ccp_rack_timeout, f);
+    if (ccp_localstate[f->unit] & RREQ_DEFERRED)
+	UNTIMEOUT(ccp_reset_deferred, f);
+    UNTIMEOUT(ccp_adapt_sample, f);
     ccp_localstate[f->unit] = 0;
+    ccp_reset_report(f->unit);
     ccp_flags_set(f->unit, 1, 0);
 #ifdef PPP_WITH_MPPE
     if (ccp_gotoptions[f->unit].mppe) {
@@ -1622,18 +1730,198 @@ ccp_datainput(int unit, u_char *pkt, int len)
 	    /*
 	     * Send a reset-request to reset the peer's compressor.
 	     * We don't do that if we are still waiting for an
-	     * acknowledgement to a previous reset-request.
+	     * acknowledgement to a previous reset-request, or if we
+	     * sent one less than ccp-reset-holdoff ms ago; the errors
+	     * in the meantime are dealt with by one reset-request.
 	     */
-	    if (!(ccp_localstate[f->unit] & RACK_PENDING)) {
-		fsm_sdata(f, CCP_RESETREQ, f->reqid = ++f->id, NULL, 0);
-		TIMEOUT(ccp_rack_timeout, f, RACKTIMEOUT);
-		ccp_localstate[f->unit] |= RACK_PENDING;
-	    } else
-		ccp_localstate[f->unit] |= RREQ_REPEAT;
+	    struct ccp_reset_stats *rs = &ccp_rstats[unit];
+	    struct timeval now;
+	    long ms;
+
+	    rs->errors++;
+	    if (ccp_localstate[unit] & RACK_PENDING) {
+		ccp_localstate[unit] |= RREQ_REPEAT;
+		return;
+	    }
+	    if (ccp_localstate[unit] & RREQ_DEFERRED)
+		return;
+	    if (ccp_reset_holdoff > 0 && rs->requests > 0) {
+		ppp_get_time(&now);
+		ms = (now.tv_sec - rs->last_req.tv_sec) * 1000
+		    + (now.tv_usec - rs->last_req.tv_usec) / 1000;
+		if (ms >= 0 && ms < ccp_reset_holdoff) {
+		    ms = ccp_reset_holdoff - ms;
+		    ppp_timeout(ccp_reset_deferred, f, ms / 1000,
+				(ms % 1000) * 1000);
+		    ccp_localstate[unit] |= RREQ_DEFERRED;
+		    return;
+		}
+	    }
+	    ccp_send_resetreq(f);
 	}
     }
 }
 
+/*
+ * Send a reset-request and wait for the reset-ack.
+ */
+static void
+ccp_send_resetreq(fsm *f)
+{
+    struct ccp_reset_stats *rs = &ccp_rstats[f->unit];
+
+    fsm_sdata(f, CCP_RESETREQ, f->reqid = ++f->id, NULL, 0);
+    TIMEOUT(ccp_rack_timeout, f, RACKTIMEOUT);
+    ccp_localstate[f->unit] |= RACK_PENDING;
+    rs->requests++;
+    ppp_get_time(&rs->last_req);
+}
+
+/*
+ * The reset-request holdoff has ended.
+ */
+static void
+ccp_reset_deferred(void *arg)
+{
+    fsm *f = arg;
+
+    ccp_localstate[f->unit] &= ~RREQ_DEFERRED;
+    if (f->state == OPENED)
+	ccp_send_resetreq(f);
+}
+
+/*
+ * Log the reset statistics for the CCP session which has just ended,
+ * and make them available to the ip-down and link-down scripts.
+ */
+static void
+ccp_reset_report(int unit)
+{
+    struct ccp_reset_stats *rs = &ccp_rstats[unit];
+    char buf[32];
+
+    if (rs->errors == 0)
+	return;
+    info("CCP: %d decompression errors, %d reset-requests, %d reset-acks"
+	 " (average %ld ms, max %ld ms)", rs->errors, rs->requests, rs->acks,
+	 rs->acks? rs->total_ms / rs->acks: 0, rs->max_ms);
+    slprintf(buf, sizeof(buf), "%d", rs->errors);
+    ppp_script_setenv("CCP_DECOMP_ERRORS", buf, 0);
+    slprintf(buf, sizeof(buf), "%d", rs->requests);
+    ppp_script_setenv("CCP_RESET_REQUESTS", buf, 0);
+    slprintf(buf, sizeof(buf), "%ld", rs->acks? rs->total_ms / rs->acks: 0);
+    ppp_script_setenv("CCP_RESET_AVG_MS", buf, 0);
+    slprintf(buf, sizeof(buf), "%ld", rs->max_ms);
+    ppp_script_setenv("CCP_RESET_MAX_MS", buf, 0);
+
+#ifdef PPP_WITH_MPPE
+    if (ccp_gotoptions[unit].mppe && rs->requests >= CCP_LOSSY_RESETS
+	&& !ccp_lossy_link) {
+	notice("CCP: link is lossy, will prefer stateless MPPE");
+	ccp_lossy_link = 1;
+    }
+#endif
+    memset(rs, 0, sizeof(*rs));
+}
+
+/*
+ * Start sampling the compression ratio, if ccp-min-ratio is set and
+ * it could help.  MPPE is never turned off, since that is encryption.
+ */
+static void
+ccp_adapt_start(fsm *f)
+{
+    struct ccp_adapt *ca = &ccp_adapt[f->unit];
+    ccp_options *go = &ccp_gotoptions[f->unit];
+    ccp_options *ho = &ccp_hisoptions[f->unit];
+    struct ppp_comp_stats cs;
+
+    if (ccp_min_ratio == 0 || go->mppe)
+	return;
+    if (!ca->off) {
+	if (!ANY_COMPRESS(*go) && !ANY_COMPRESS(*ho))
+	    return;
+	if (!get_ppp_comp_stats(f->unit, &cs))
+	    return;
+	ca->unc_bytes = cs.c.unc_bytes + cs.d.unc_bytes;
+	ca->comp_bytes = cs.c.comp_bytes + cs.c.inc_bytes
+	    + cs.d.comp_bytes + cs.d.inc_bytes;
+	ca->bad = 0;
+    }
+    TIMEOUT(ccp_adapt_sample, f, ccp_adapt_interval);
+}
+
+/*
+ * Check the compression ratio achieved since the last sample, and
+ * renegotiate if compression should be turned off or tried again.
+ */
+static void
+ccp_adapt_sample(void *arg)
+{
+    fsm *f = arg;
+    struct ccp_adapt *ca = &ccp_adapt[f->unit];
+    struct ppp_comp_stats cs;
+    u_int32_t unc, comp;
+    int ratio;
+    char buf[32];
+
+    if (f->state != OPENED)
+	return;
+
+    if (ca->off) {
+	if (--ca->hold > 0) {
+	    TIMEOUT(ccp_adapt_sample, f, ccp_adapt_interval);
+	    return;
+	}
+	info("CCP: trying compression again");
+	ca->off = 0;
+	fsm_renegotiate(f);
+	return;
+    }
+
+    if (!get_ppp_comp_stats(f->unit, &cs))
+	return;
+    unc = cs.c.unc_bytes + cs.d.unc_bytes;
+    comp = cs.c.comp_bytes + cs.c.inc_bytes + cs.d.comp_bytes + cs.d.inc_bytes;
+    unc -= ca->unc_bytes;
+    comp -= ca->comp_bytes;
+    if (unc < CCP_ADAPT_MIN_BYTES || comp == 0) {
+	/* not enough traffic to tell */
+	TIMEOUT(ccp_adapt_sample, f, ccp_adapt_interval);
+	return;
+    }
+    ca->unc_bytes += unc;
+    ca->comp_bytes += comp;
+
+    ratio = (int) ((unsigned long long) unc * 100 / comp);
+    dbglog("CCP: compression ratio %d.%02d", ratio / 100, ratio % 100);
+    slprintf(buf, sizeof(buf), "%d", ratio);
+    ppp_script_setenv("CCP_RATIO", buf, 0);
+
+    if (ratio >= ccp_min_ratio) {
+	ca->bad = 0;
+	ca->backoff = 0;
+	TIMEOUT(ccp_adapt_sample, f, ccp_adapt_interval);
+	return;
+    }
+    if (++ca->bad < CCP_ADAPT_SAMPLES) {
+	TIMEOUT(ccp_adapt_sample, f, ccp_adapt_interval);
+	return;
+    }
+
+    ca->backoff = ca->backoff? ca->backoff * 2: 1;
+    if (ca->backoff > CCP_ADAPT_MAX_HOLD)
+	ca->backoff = CCP_ADAPT_MAX_HOLD;
+    ca->hold = ca->backoff;
+    ca->off = 1;
+    ca->changes++;
+    slprintf(buf, sizeof(buf), "%d", ca->changes);
+    ppp_script_setenv("CCP_ADAPT_OFF_COUNT", buf, 0);
+    notice("CCP: compression ratio %d.%02d is below %d.%02d, turning compression off",
+	   ratio / 100, ratio % 100, ccp_min_ratio / 100, ccp_min_ratio % 100);
+    fsm_renegotiate(f);
+}
+
 /*
  * Timeout waiting for reset-ack.
  */
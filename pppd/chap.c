@@ -375,9 +375,23 @@ chap_handle_response(struct chap_server_state *ss, int id,
 			verifier = chap_verify_hook;
 		else
 			verifier = chap_verify_response;
+#ifdef PPP_WITH_TDB
+		if (authfail_blocked(name)) {
+			ok = 0;
+			slprintf(ss->message, sizeof(ss->message),
+				 "Too many failed attempts");
+		} else {
+			ok = (*verifier)(name, ss->name, id, ss->digest,
+					 ss->challenge + PPP_HDRLEN + CHAP_HDRLEN,
+					 response, ss->message,
+					 sizeof(ss->message));
+			authfail_record(name, ok);
+		}
+#else
 		ok = (*verifier)(name, ss->name, id, ss->digest,
 				 ss->challenge + PPP_HDRLEN + CHAP_HDRLEN,
 				 response, ss->message, sizeof(ss->message));
+#endif
 		if (!ok || !auth_number()) {
 			ss->flags |= AUTH_FAILED;
 			warn("Peer %q failed CHAP authentication", name);
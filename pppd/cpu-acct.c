@@ -0,0 +1,250 @@
+/*
+ * cpu-acct.c - attribute pppd's CPU time to the things it does.
+ *
+ * Copyright (c) 1999-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * With the cpu-accounting option, the main loop measures the CPU time
+ * taken by each protocol's input routine, each timeout routine and each
+ * fd callback, and every cpu-accounting-interval seconds we publish the
+ * totals, along with our rusage and RSS, as script environment
+ * variables (which also puts them in the pppd database).  That makes it
+ * possible to find the session which is eating CPU without attaching a
+ * profiler to it.  Timeout routines and fd callbacks are identified by
+ * address; where possible we turn that into an offset from the start
+ * of pppd or of the plugin, which addr2line can make sense of.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef PPP_WITH_PLUGINS
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "pppd-private.h"
+
+bool cpu_accounting = 0;	/* measure CPU time per subsystem */
+bool cpu_accounting_log = 0;	/* log the totals at disconnect */
+int cpu_accounting_interval = 60; /* seconds between updates */
+
+struct cpu_acct_entry {
+    int kind;
+    uintptr_t id;
+    unsigned long calls;
+    uint64_t ns;
+};
+
+/*
+ * There are only a few dozen protocols and callbacks in a pppd, so a
+ * small table searched linearly does; anything beyond it is lumped
+ * together in the last entry.
+ */
+#define CPU_ACCT_ENTRIES	64
+#define CPU_ACCT_TOP		3	/* how many to name in CPU_TOP */
+
+static struct cpu_acct_entry cpu_acct[CPU_ACCT_ENTRIES];
+static int n_cpu_acct;
+
+static void cpu_acct_update(void *);
+
+/*
+ * cpu_acct_init - start publishing the totals periodically.
+ */
+void
+cpu_acct_init(void)
+{
+    if (cpu_accounting)
+	TIMEOUT(cpu_acct_update, NULL, cpu_accounting_interval);
+}
+
+/*
+ * cpu_acct_start - note the CPU time before calling something.
+ */
+void
+cpu_acct_start(struct timespec *t0)
+{
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, t0);
+}
+
+/*
+ * cpu_acct_end - charge the CPU time since cpu_acct_start to the
+ * protocol number or callback address id.
+ */
+void
+cpu_acct_end(struct timespec *t0, int kind, uintptr_t id)
+{
+    struct timespec t1;
+    struct cpu_acct_entry *e;
+    int i;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t1);
+    for (i = 0; i < n_cpu_acct; ++i)
+	if (cpu_acct[i].kind == kind && cpu_acct[i].id == id)
+	    break;
+    if (i == n_cpu_acct) {
+	if (n_cpu_acct < CPU_ACCT_ENTRIES)
+	    ++n_cpu_acct;
+	else
+	    i = CPU_ACCT_ENTRIES - 1;
+	cpu_acct[i].kind = kind;
+	cpu_acct[i].id = id;
+    }
+    e = &cpu_acct[i];
+    e->calls++;
+    e->ns += (uint64_t) (t1.tv_sec - t0->tv_sec) * 1000000000
+	+ t1.tv_nsec - t0->tv_nsec;
+}
+
+/*
+ * cpu_acct_name - describe what an entry was charged to.
+ */
+static void
+cpu_acct_name(struct cpu_acct_entry *e, char *buf, int len)
+{
+#ifdef PPP_WITH_PLUGINS
+    Dl_info info;
+    const char *file;
+#endif
+
+    if (e->kind == CPU_ACCT_PROTO) {
+	slprintf(buf, len, "%s", protocol_name(e->id));
+	return;
+    }
+#ifdef PPP_WITH_PLUGINS
+    if (dladdr((void *) e->id, &info) && info.dli_fname != NULL) {
+	file = strrchr(info.dli_fname, '/');
+	file = file? file + 1: info.dli_fname;
+	if (info.dli_sname != NULL && info.dli_saddr == (void *) e->id)
+	    slprintf(buf, len, "%s %s", e->kind == CPU_ACCT_FD? "fd": "timer",
+		     info.dli_sname);
+	else
+	    slprintf(buf, len, "%s %s+0x%lx", e->kind == CPU_ACCT_FD? "fd": "timer",
+		     file, (unsigned long) (e->id - (uintptr_t) info.dli_fbase));
+	return;
+    }
+#endif
+    slprintf(buf, len, "%s 0x%lx", e->kind == CPU_ACCT_FD? "fd": "timer",
+	     (unsigned long) e->id);
+}
+
+/*
+ * get_rss_kb - return our resident set size.
+ */
+static long
+get_rss_kb(struct rusage *ru)
+{
+#ifdef __linux__
+    FILE *f;
+    long size, resident;
+
+    f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+	if (fscanf(f, "%ld %ld", &size, &resident) == 2) {
+	    fclose(f);
+	    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+	}
+	fclose(f);
+    }
+#endif
+    return ru->ru_maxrss;	/* the peak, which is better than nothing */
+}
+
+/*
+ * cpu_acct_report - publish the totals, and log them if asked to.
+ */
+void
+cpu_acct_report(int at_end)
+{
+    struct rusage ru;
+    struct cpu_acct_entry *top[CPU_ACCT_TOP];
+    char buf[256], name[64];
+    int i, j, n;
+    char *p;
+
+    if (!cpu_accounting || getrusage(RUSAGE_SELF, &ru) < 0)
+	return;
+
+    slprintf(buf, sizeof(buf), "%ld", ru.ru_utime.tv_sec * 1000
+	     + ru.ru_utime.tv_usec / 1000);
+    ppp_script_setenv("CPU_USER_MS", buf, 0);
+    slprintf(buf, sizeof(buf), "%ld", ru.ru_stime.tv_sec * 1000
+	     + ru.ru_stime.tv_usec / 1000);
+    ppp_script_setenv("CPU_SYS_MS", buf, 0);
+    slprintf(buf, sizeof(buf), "%ld", get_rss_kb(&ru));
+    ppp_script_setenv("RSS_KB", buf, 0);
+
+    /* find the biggest few */
+    n = 0;
+    for (i = 0; i < n_cpu_acct; ++i) {
+	for (j = n; j > 0 && top[j-1]->ns < cpu_acct[i].ns; --j)
+	    if (j < CPU_ACCT_TOP)
+		top[j] = top[j-1];
+	if (j < CPU_ACCT_TOP) {
+	    top[j] = &cpu_acct[i];
+	    if (n < CPU_ACCT_TOP)
+		++n;
+	}
+    }
+    p = buf;
+    *p = 0;
+    for (i = 0; i < n; ++i) {
+	cpu_acct_name(top[i], name, sizeof(name));
+	p += slprintf(p, buf + sizeof(buf) - p, "%s%s:%lu.%03lu",
+		      i? ",": "", name,
+		      (unsigned long) (top[i]->ns / 1000000),
+		      (unsigned long) (top[i]->ns / 1000 % 1000));
+    }
+    ppp_script_setenv("CPU_TOP", buf, 0);
+
+    if (!at_end || !cpu_accounting_log)
+	return;
+    info("CPU: %ld.%03ld s user, %ld.%03ld s system, %ld kB resident",
+	 (long) ru.ru_utime.tv_sec, (long) ru.ru_utime.tv_usec / 1000,
+	 (long) ru.ru_stime.tv_sec, (long) ru.ru_stime.tv_usec / 1000,
+	 get_rss_kb(&ru));
+    for (i = 0; i < n_cpu_acct; ++i) {
+	cpu_acct_name(&cpu_acct[i], name, sizeof(name));
+	info("CPU: %s: %lu calls, %lu.%03lu ms", name, cpu_acct[i].calls,
+	     (unsigned long) (cpu_acct[i].ns / 1000000),
+	     (unsigned long) (cpu_acct[i].ns / 1000 % 1000));
+    }
+}
+
+static void
+cpu_acct_update(void *arg)
+{
+    cpu_acct_report(0);
+    TIMEOUT(cpu_acct_update, NULL, cpu_accounting_interval);
+}
@@ -54,6 +54,9 @@ struct crypto_ctx {
 #endif
 #endif
 
+/* Set once PPP_crypto_init has succeeded */
+static int crypto_ready;
+
 PPP_MD_CTX *PPP_MD_CTX_new()
 {
     return (PPP_MD_CTX*) calloc(1, sizeof(PPP_MD_CTX));
@@ -72,6 +75,9 @@ void PPP_MD_CTX_free(PPP_MD_CTX* ctx)
 int PPP_DigestInit(PPP_MD_CTX *ctx, const PPP_MD *type)
 {
     int ret = 0;
+    if (!crypto_ready && !PPP_crypto_init()) {
+        return 0;
+    }
     if (ctx) {
         ctx->md = *type;
         if (ctx->md.init_fn) {
@@ -128,6 +134,9 @@ void PPP_CIPHER_CTX_free(PPP_CIPHER_CTX *ctx)
 int PPP_CipherInit(PPP_CIPHER_CTX *ctx, const PPP_CIPHER *cipher, const unsigned char *key, const unsigned char *iv, int encr)
 {
     int ret = 0;
+    if (!crypto_ready && !PPP_crypto_init()) {
+        return 0;
+    }
     if (ctx && cipher) {
         ret = 1;
         ctx->is_encr = encr;
@@ -196,10 +205,19 @@ PPP_crypto_error(char *fmt, ...)
 }
 
 
+/*
+ * This is called from PPP_DigestInit and PPP_CipherInit the first
+ * time they are used, so pppd doesn't pay for loading the providers
+ * at startup unless it needs them.  Calling it again is harmless.
+ */
 int PPP_crypto_init()
 {
     int retval = 0;
 
+    if (crypto_ready) {
+        return 1;
+    }
+
 #ifdef PPP_WITH_OPENSSL
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
     g_crypto_ctx.legacy = OSSL_PROVIDER_load(NULL, "legacy");
@@ -219,6 +237,7 @@ int PPP_crypto_init()
 #endif
 
     retval = 1;
+    crypto_ready = 1;
 
 done:
 
@@ -227,6 +246,8 @@ done:
 
 int PPP_crypto_deinit()
 {
+    crypto_ready = 0;
+
 #ifdef PPP_WITH_OPENSSL
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
     if (g_crypto_ctx.legacy) {
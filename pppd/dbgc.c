@@ -0,0 +1,385 @@
+/*
+ * dbgc.c - remove the records left in the pppd database by pppds
+ * which died without cleaning up.
+ *
+ * Copyright (c) 1999-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Each pppd keeps a record of its environment in the database under
+ * "pppd<pid>", with a key record ("IFNAME=ppp0", "BUNDLE=...", ...)
+ * pointing at it for each variable it can be looked up by, and with
+ * multilink, a "BUNDLE_LINKS=..." list of the pppds in each bundle.
+ * cleanup_db removes ours when we exit, but a pppd which crashes or
+ * is killed with SIGKILL leaves them behind, and on a busy system they
+ * pile up and slow down every lookup.
+ *
+ * So once every db-gc-interval seconds, one of the pppds on the system
+ * (whichever notices first that it's time) goes through the database
+ * looking for records belonging to processes which no longer exist,
+ * and removes them.  It goes through the database without holding the
+ * global lock, then takes the lock to remove each batch of up to
+ * DBGC_BATCH records, checking each again first.  A pid may have been
+ * reused by some other process since; if the environment record
+ * names an interface which no longer exists, and the process doesn't
+ * look like a pppd, the record is taken to be stale too.  Records
+ * which admit.c and authfail.c keep for each calling number or peer
+ * name are removed once they are too old to matter.  Other records are
+ * left alone.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+
+#include "pppd-private.h"
+#include "tdb.h"
+
+int db_gc_interval = 3600;	/* secs between collections; 0 => never */
+
+extern TDB_CONTEXT *pppdb;
+
+#define DBGC_KEY	"dbgc:next"	/* when the next collection is due */
+#define DBGC_BATCH	64		/* records removed per lock */
+#define DBGC_MAX	16384		/* records removed per collection */
+#define DBGC_SOON	10		/* secs till we carry on, if we hit it */
+
+#define process_exists(n)	(kill((n), 0) == 0 || errno != ESRCH)
+
+#define ADMIT_SEEN_PREFIX	"admit:seen:"
+#define AUTHFAIL_PREFIX		"authfail:"
+
+enum { GC_ENV, GC_KEY, GC_LINKS, GC_EXPIRED };
+
+struct gc_item {
+    int type;
+    char *key;
+};
+
+struct gc_state {
+    struct gc_item *items;
+    int n;
+    int full;
+};
+
+static void dbgc_timer(void *);
+
+/*
+ * pid_of - if s (of length len) is "pppd<pid>", return the pid,
+ * otherwise 0.
+ */
+static int
+pid_of(const char *s, int len)
+{
+    int i, pid = 0;
+
+    if (len <= 4 || len > 14 || strncmp(s, "pppd", 4) != 0)
+	return 0;
+    for (i = 4; i < len; ++i) {
+	if (s[i] < '0' || s[i] > '9')
+	    return 0;
+	pid = pid * 10 + s[i] - '0';
+    }
+    return pid;
+}
+
+static int
+pid_dead(int pid)
+{
+    return pid > 0 && pid != getpid() && !process_exists(pid);
+}
+
+/*
+ * looks_like_pppd - is pid still running pppd?  If we can't tell, say
+ * yes.
+ */
+static int
+looks_like_pppd(int pid)
+{
+#ifdef __linux__
+    char path[64], comm[32];
+    FILE *f;
+    int yes = 1;
+
+    slprintf(path, sizeof(path), "/proc/%d/comm", pid);
+    f = fopen(path, "r");
+    if (f == NULL)
+	return 1;
+    if (fgets(comm, sizeof(comm), f) != NULL)
+	yes = strncmp(comm, "pppd", 4) == 0;
+    fclose(f);
+    return yes;
+#else
+    return 1;
+#endif
+}
+
+/*
+ * env_stale - is the environment record for pid, with contents
+ * env (null-terminated), left over from a dead pppd?
+ */
+static int
+env_stale(int pid, char *env)
+{
+    char *p, ifn[IFNAMSIZ];
+    int i;
+
+    if (pid_dead(pid))
+	return 1;
+    if (pid == getpid())
+	return 0;
+    p = strstr(env, "IFNAME=");
+    if (p == NULL || (p != env && p[-1] != ';'))
+	return 0;
+    p += 7;
+    for (i = 0; i < IFNAMSIZ - 1 && p[i] != ';' && p[i] != 0; ++i)
+	ifn[i] = p[i];
+    ifn[i] = 0;
+    return if_nametoindex(ifn) == 0 && !looks_like_pppd(pid);
+}
+
+/*
+ * links_stale - does a bundle link list (null-terminated) name a
+ * dead pppd?
+ */
+static int
+links_stale(char *list)
+{
+    char *p, *q;
+
+    for (p = list; (q = strchr(p, ';')) != NULL; p = q + 1)
+	if (pid_dead(pid_of(p, q - p)))
+	    return 1;
+    return 0;
+}
+
+/*
+ * is_stale - classify a record.  Returns the type of stale record,
+ * or -1 if the record should stay.
+ */
+static int
+is_stale(TDB_DATA key, TDB_DATA val)
+{
+    char *s;
+    int pid, type = -1;
+
+    if (key.dsize > 11 && strncmp(key.dptr, ADMIT_SEEN_PREFIX, 11) == 0)
+	return admit_seen_expired(val.dptr, val.dsize)? GC_EXPIRED: -1;
+    if (key.dsize > 9 && strncmp(key.dptr, AUTHFAIL_PREFIX, 9) == 0)
+	return authfail_expired(val.dptr, val.dsize)? GC_EXPIRED: -1;
+
+    pid = pid_of(key.dptr, key.dsize);
+    if (pid == 0 && memchr(key.dptr, '=', key.dsize) == NULL)
+	return -1;		/* not one of ours */
+    s = malloc(val.dsize + 1);
+    if (s == NULL)
+	return -1;
+    memcpy(s, val.dptr, val.dsize);
+    s[val.dsize] = 0;
+    if (pid != 0) {
+	if (env_stale(pid, s))
+	    type = GC_ENV;
+    } else if (key.dsize > 13 && strncmp(key.dptr, "BUNDLE_LINKS=", 13) == 0) {
+	if (links_stale(s))
+	    type = GC_LINKS;
+    } else {
+	pid = pid_of(s, strlen(s));
+	if (pid_dead(pid))
+	    type = GC_KEY;
+    }
+    free(s);
+    return type;
+}
+
+static int
+collect_one(TDB_CONTEXT *db, TDB_DATA key, TDB_DATA val, void *arg)
+{
+    struct gc_state *st = arg;
+    struct gc_item *it;
+    int type;
+
+    type = is_stale(key, val);
+    if (type < 0)
+	return 0;
+    if (st->n >= DBGC_MAX) {
+	st->full = 1;
+	return 1;		/* stop; we'll carry on later */
+    }
+    it = &st->items[st->n];
+    it->key = malloc(key.dsize + 1);
+    if (it->key == NULL)
+	return 1;
+    memcpy(it->key, key.dptr, key.dsize);
+    it->key[key.dsize] = 0;
+    it->type = type;
+    ++st->n;
+    return 0;
+}
+
+/*
+ * remove_one - check a record again and remove it (or for a bundle
+ * link list, the dead pppds from it).  The caller holds the lock.
+ */
+static int
+remove_one(struct gc_item *it)
+{
+    TDB_DATA key, val;
+    char *p, *q, *out;
+    int removed = 0;
+
+    key.dptr = it->key;
+    key.dsize = strlen(it->key);
+    val = tdb_fetch(pppdb, key);
+    if (val.dptr == NULL)
+	return 0;
+    if (is_stale(key, val) == it->type) {
+	if (it->type != GC_LINKS) {
+	    removed = tdb_delete(pppdb, key) == 0;
+	} else if (val.dsize > 0 && (out = malloc(val.dsize)) != NULL) {
+	    val.dptr[val.dsize-1] = 0;
+	    q = out;
+	    for (p = val.dptr; (p = strtok(p, ";")) != NULL; p = NULL)
+		if (!pid_dead(pid_of(p, strlen(p))))
+		    q += slprintf(q, out + val.dsize - q, "%s;", p);
+	    free(val.dptr);
+	    if (q == out) {
+		removed = tdb_delete(pppdb, key) == 0;
+	    } else {
+		val.dptr = out;
+		val.dsize = q - out + 1;
+		removed = tdb_store(pppdb, key, val, TDB_REPLACE) == 0;
+	    }
+	    free(out);
+	    return removed;
+	}
+    }
+    free(val.dptr);
+    return removed;
+}
+
+/*
+ * dbgc_elect - is it time for a collection, and are we the one to do
+ * it?  If so, says when the next is due, so nobody else starts one.
+ */
+static int
+dbgc_elect(void)
+{
+    void *data;
+    int len, due = 1;
+    time_t now, next;
+
+    lock_db();
+    now = time(NULL);
+    if (ppp_db_fetch(DBGC_KEY, &data, &len) == 0) {
+	if (len == sizeof(next)) {
+	    memcpy(&next, data, sizeof(next));
+	    /* don't believe a time from too far in the future */
+	    due = now >= next || next - now > db_gc_interval;
+	}
+	free(data);
+    }
+    if (due) {
+	next = now + db_gc_interval;
+	ppp_db_store(DBGC_KEY, &next, sizeof(next));
+    }
+    unlock_db();
+    return due;
+}
+
+/*
+ * dbgc_run - go through the database and remove stale records.
+ */
+static void
+dbgc_run(void)
+{
+    struct gc_state st;
+    struct timespec t0, t1;
+    time_t next;
+    int i, j, removed, records;
+
+    st.items = malloc(DBGC_MAX * sizeof(struct gc_item));
+    if (st.items == NULL)
+	return;
+    st.n = 0;
+    st.full = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    records = tdb_traverse(pppdb, collect_one, &st);
+
+    removed = 0;
+    for (i = 0; i < st.n; i += DBGC_BATCH) {
+	lock_db();
+	for (j = i; j < st.n && j < i + DBGC_BATCH; ++j)
+	    removed += remove_one(&st.items[j]);
+	unlock_db();
+    }
+    for (i = 0; i < st.n; ++i)
+	free(st.items[i].key);
+    free(st.items);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (removed > 0)
+	notice("Removed %d stale records from the ppp database", removed);
+    dbglog("database collection: %d records%s, %d stale, %d removed, %ld ms",
+	   records, st.full? " or more": "", st.n, removed,
+	   (long) ((t1.tv_sec - t0.tv_sec) * 1000
+		   + (t1.tv_nsec - t0.tv_nsec) / 1000000));
+
+    if (st.full) {
+	/* there's more to do; come back for it soon */
+	next = time(NULL) + DBGC_SOON;
+	lock_db();
+	ppp_db_store(DBGC_KEY, &next, sizeof(next));
+	unlock_db();
+	UNTIMEOUT(dbgc_timer, NULL);
+	TIMEOUT(dbgc_timer, NULL, DBGC_SOON);
+    }
+}
+
+static void
+dbgc_timer(void *arg)
+{
+    TIMEOUT(dbgc_timer, NULL, db_gc_interval);
+    if (dbgc_elect())
+	dbgc_run();
+}
+
+/*
+ * dbgc_init - called once the database is open: collect now if it's
+ * due, and arrange to check again every db_gc_interval seconds.
+ */
+void
+dbgc_init(void)
+{
+    if (pppdb == NULL || db_gc_interval <= 0)
+	return;
+    dbgc_timer(NULL);
+}
@@ -94,6 +94,8 @@ extern int chapms_strip_domain;
 #endif /* PPP_WITH_CHAPMS */
 
 eap_state eap_states[NUM_PPP];		/* EAP state; one for each unit */
+
+eap_passthrough_hook_fn *eap_passthrough_hook = NULL;
 #ifdef PPP_WITH_SRP
 static char *pn_secret = NULL;		/* Pseudonym generating secret */
 #endif
@@ -829,11 +831,13 @@ eap_send_request(eap_state *esp)
 	if (esp->es_server.ea_state < eapIdentify &&
 	    esp->es_server.ea_state != eapInitial) {
 		esp->es_server.ea_state = eapIdentify;
-		if (explicit_remote) {
+		if (explicit_remote && eap_passthrough_hook == NULL) {
 			/*
 			 * If we already know the peer's
 			 * unauthenticated name, then there's no
 			 * reason to ask.  Go to next state instead.
+			 * (The authentication server wants to see the
+			 * Identity Response, though.)
 			 */
 			esp->es_server.ea_peer = remote_name;
 			esp->es_server.ea_peerlen = strlen(remote_name);
@@ -1078,6 +1082,12 @@ eap_send_request(eap_state *esp)
 		break;
 #endif /* PPP_WITH_SRP */
 
+	case eapPassthrough:
+		BCOPY(esp->es_ptreq + EAP_HEADERLEN, outp,
+		    esp->es_ptreqlen - EAP_HEADERLEN);
+		INCPTR(esp->es_ptreqlen - EAP_HEADERLEN, outp);
+		break;
+
 	default:
 		return;
 	}
@@ -1278,6 +1288,11 @@ eap_lowerdown(int unit)
 
 	esp->es_client.ea_state = esp->es_server.ea_state = eapInitial;
 	esp->es_client.ea_requests = esp->es_server.ea_requests = 0;
+
+	if (esp->es_ptreq != NULL) {
+		free(esp->es_ptreq);
+		esp->es_ptreq = NULL;
+	}
 }
 
 /*
@@ -2317,6 +2332,85 @@ client_failure:
 #endif /* PPP_WITH_SRP */
 }
 
+/*
+ * eap_passthrough - Hand a Response from the peer to the plugin which
+ * relays EAP to an authentication server, and send the peer whatever
+ * the server sends back.  (Server operation)
+ */
+static void
+eap_passthrough(eap_state *esp, u_char *inp, int len)
+{
+	u_char pkt[PPP_MRU];
+	u_char *p, *outp;
+	u_char code, id;
+	int pktlen, plen, status;
+
+	if (esp->es_server.ea_timeout > 0) {
+		UNTIMEOUT(eap_server_timeout, (void *)esp);
+	}
+
+	pktlen = sizeof(pkt);
+	status = (*eap_passthrough_hook)(esp->es_server.ea_peer, inp, len,
+	    pkt, &pktlen);
+
+	code = 0;
+	id = 0;
+	plen = 0;
+	if (status != EAP_PT_ERROR && pktlen >= EAP_HEADERLEN &&
+	    pktlen <= sizeof(pkt)) {
+		p = pkt;
+		GETCHAR(code, p);
+		GETCHAR(id, p);
+		GETSHORT(plen, p);
+		if (plen < EAP_HEADERLEN || plen > pktlen)
+			code = 0;
+	}
+
+	switch (status) {
+	case EAP_PT_CONTINUE:
+		if (code != EAP_REQUEST || plen <= EAP_HEADERLEN)
+			break;
+		/* Keep the Request, to retransmit it if need be. */
+		if (esp->es_ptreq != NULL)
+			free(esp->es_ptreq);
+		esp->es_ptreq = malloc(plen);
+		if (esp->es_ptreq == NULL)
+			break;
+		BCOPY(pkt, esp->es_ptreq, plen);
+		esp->es_ptreqlen = plen;
+		esp->es_server.ea_id = id;
+		esp->es_server.ea_requests = 0;
+		eap_send_request(esp);
+		return;
+
+	case EAP_PT_SUCCESS:
+	case EAP_PT_FAILURE:
+		if (code != (status == EAP_PT_SUCCESS? EAP_SUCCESS: EAP_FAILURE))
+			break;
+		outp = outpacket_buf;
+		MAKEHEADER(outp, PPP_EAP);
+		BCOPY(pkt, outp, plen);
+		output(esp->es_unit, outpacket_buf, plen + PPP_HDRLEN);
+		esp->es_server.ea_id = id;
+		if (status == EAP_PT_SUCCESS) {
+			esp->es_server.ea_state = eapOpen;
+			auth_peer_success(esp->es_unit, PPP_EAP, 0,
+			    esp->es_server.ea_peer, esp->es_server.ea_peerlen);
+		} else {
+			esp->es_server.ea_state = eapBadAuth;
+			auth_peer_fail(esp->es_unit, PPP_EAP);
+		}
+		return;
+	}
+
+	if (status == EAP_PT_ERROR)
+		error("EAP: no answer from authentication server");
+	else if (status != EAP_PT_FAILURE)
+		error("EAP: unexpected packet (code %d) from authentication "
+		    "server", code);
+	eap_send_failure(esp);
+}
+
 /*
  * eap_response - Receive EAP Response message (server mode).
  */
@@ -2368,6 +2462,11 @@ eap_response(eap_state *esp, u_char *inp, int id, int len)
 		return;
 	}
 
+	if (esp->es_server.ea_state == eapPassthrough) {
+		eap_passthrough(esp, inp - EAP_HEADERLEN, len + EAP_HEADERLEN);
+		return;
+	}
+
 	GETCHAR(typenum, inp);
 	len--;
 
@@ -2391,6 +2490,15 @@ eap_response(eap_state *esp, u_char *inp, int id, int len)
 		BCOPY(inp, esp->es_server.ea_peer, len);
 		esp->es_server.ea_peer[len] = '\0';
 		esp->es_server.ea_peerlen = len;
+		if (eap_passthrough_hook != NULL) {
+			esp->es_server.ea_state = eapPassthrough;
+#ifdef PPP_WITH_EAPTLS
+			esp->es_server.ea_prev_state = eapPassthrough;
+#endif /* PPP_WITH_EAPTLS */
+			eap_passthrough(esp, inp - 1 - EAP_HEADERLEN,
+			    len + 1 + EAP_HEADERLEN);
+			return;
+		}
 		eap_figure_next_state(esp, 0);
 		break;
 
@@ -115,6 +115,7 @@ enum eap_state_code {
 	eapSRP2,	/* Sent EAP SRP-SHA1 Subtype 2 */
 	eapSRP3,	/* Sent EAP SRP-SHA1 Subtype 3 */
 	eapMD5Chall,	/* Sent MD5-Challenge */
+	eapPassthrough,	/* Relaying to authentication server */
 	eapMSCHAPv2Chall,	/* Sent MSCHAPv2-Challenge */
 	eapOpen,	/* Completed authentication */
 	eapSRP4,	/* Sent EAP SRP-SHA1 Subtype 4 */
@@ -125,7 +126,7 @@ enum eap_state_code {
 	"Initial", "Pending", "Closed", "Listen", "Identify", \
 	"TlsStart", "TlsRecv", "TlsSendAck", "TlsSend", "TlsRecvAck", "TlsRecvClient",\
 	"TlsSendAlert", "TlsRecvAlertAck" , "TlsRecvSuccess", "TlsRecvFailure", \
-	"SRP1", "SRP2", "SRP3", "MD5Chall", "MSCHAPv2Chall", "Open", "SRP4", "BadAuth"
+	"SRP1", "SRP2", "SRP3", "MD5Chall", "Passthrough", "MSCHAPv2Chall", "Open", "SRP4", "BadAuth"
 
 #ifdef PPP_WITH_EAPTLS
 #define	eap_client_active(esp)	((esp)->es_client.ea_state != eapInitial &&\
@@ -137,7 +138,7 @@ enum eap_state_code {
 
 #define	eap_server_active(esp)	\
 	((esp)->es_server.ea_state >= eapIdentify && \
-	 (esp)->es_server.ea_state <= eapMD5Chall)
+	 (esp)->es_server.ea_state <= eapPassthrough)
 
 struct eap_auth {
 	char *ea_name;		/* Our name */
@@ -182,6 +183,8 @@ typedef struct eap_state {
 	int es_usedpseudo;		/* Set if we already sent PN */
 	int es_challen;			/* Length of challenge string */
 	unsigned char es_challenge[MAX_CHALLENGE_LENGTH];
+	unsigned char *es_ptreq;	/* Request from authentication server */
+	int es_ptreqlen;		/* Length of that Request */
 } eap_state;
 
 /*
@@ -209,6 +212,23 @@ typedef int (eaptls_passwd_hook_fn)(char *user, char *passwd);
 extern eaptls_passwd_hook_fn *eaptls_passwd_hook;
 #endif
 
+/*
+ * Hook for a plugin which relays EAP between the peer and an
+ * authentication server, instead of pppd doing the EAP method itself.
+ * It is called with each Response from the peer (a whole EAP packet),
+ * starting with its Identity, and puts the packet the server wants
+ * sent to the peer in pkt, which has room for *pktlen bytes, setting
+ * *pktlen to the length.  It returns one of the following.
+ */
+#define EAP_PT_ERROR	(-1)	/* no usable answer from the server */
+#define EAP_PT_CONTINUE	0	/* pkt is the next Request */
+#define EAP_PT_SUCCESS	1	/* peer authenticated; pkt is a Success */
+#define EAP_PT_FAILURE	2	/* peer failed; pkt is a Failure */
+
+typedef int (eap_passthrough_hook_fn)(char *name, unsigned char *resp,
+				      int len, unsigned char *pkt, int *pktlen);
+extern eap_passthrough_hook_fn *eap_passthrough_hook;
+
 #ifdef	__cplusplus
 }
 #endif
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "pppd-private.h"
+#include "fsm.h"
+#include "lcp.h"
+
+/*
+ * Runs the protocol engine against a scripted peer which acks
+ * whatever it is asked for, and checks that the link gets through LCP
+ * and IPCP (and IPv6CP) to the point of the interface being
+ * configured through iface_config_hook, and that it is taken down
+ * again on close.
+ */
+
+#define MAXFRAMES	16
+
+static struct {
+    unsigned char buf[PPP_MRU + PPP_HDRLEN];
+    int len;
+} frames[MAXFRAMES];
+static int nframes;
+
+static int sent_req[3];		/* peer has sent its Configure-Request */
+static int peer_id = 0x40;
+
+static int ip_up, ip_down;
+static int if_up, if_addr, if_npmode_pass;
+static u_int32_t got_ouraddr, got_hisaddr;
+#ifdef PPP_WITH_IPV6CP
+static int if6_up, if6_addr;
+static u_int8_t got_hisid[8];
+static const u_int8_t peer_ifid[8] = { 2, 0, 0, 0, 0, 0, 0, 2 };
+#endif
+
+static void
+frame_out(int unit, unsigned char *p, int len)
+{
+    if (nframes >= MAXFRAMES || len > sizeof(frames[0].buf)) {
+	printf("too many frames queued\n");
+	exit(1);
+    }
+    memcpy(frames[nframes].buf, p, len);
+    frames[nframes].len = len;
+    ++nframes;
+}
+
+static void
+timer_arm(int msecs)
+{
+}
+
+static int
+iface_config(int unit, ppp_iface_op_t op, struct ppp_iface_config *cfg)
+{
+    switch (op) {
+    case PPP_IFACE_UP:
+	if (cfg->proto == PPP_IP)
+	    ++if_up;
+#ifdef PPP_WITH_IPV6CP
+	else if (cfg->proto == PPP_IPV6)
+	    ++if6_up;
+#endif
+	break;
+    case PPP_IFACE_DOWN:
+	if (cfg->proto == PPP_IP)
+	    --if_up;
+#ifdef PPP_WITH_IPV6CP
+	else if (cfg->proto == PPP_IPV6)
+	    --if6_up;
+#endif
+	break;
+    case PPP_IFACE_ADDR:
+	++if_addr;
+	got_ouraddr = cfg->ouraddr;
+	got_hisaddr = cfg->hisaddr;
+	break;
+    case PPP_IFACE_CLEAR_ADDR:
+	--if_addr;
+	break;
+#ifdef PPP_WITH_IPV6CP
+    case PPP_IFACE_ADDR6:
+	++if6_addr;
+	memcpy(got_hisid, cfg->hisid, sizeof(got_hisid));
+	break;
+    case PPP_IFACE_CLEAR_ADDR6:
+	--if6_addr;
+	break;
+#endif
+    case PPP_IFACE_NPMODE:
+	if (cfg->proto == PPP_IP)
+	    if_npmode_pass = cfg->npmode == NPMODE_PASS;
+	break;
+    default:
+	break;
+    }
+    return 1;
+}
+
+static void
+ip_up_notify(void *arg, int val)
+{
+    ++ip_up;
+}
+
+static void
+ip_down_notify(void *arg, int val)
+{
+    ++ip_down;
+}
+
+/* Hand a frame from the peer to the engine */
+static void
+peer_send(int proto, int code, int id, unsigned char *data, int dlen)
+{
+    unsigned char buf[PPP_MRU + PPP_HDRLEN], *p = buf;
+
+    PUTCHAR(PPP_ALLSTATIONS, p);
+    PUTCHAR(PPP_UI, p);
+    PUTSHORT(proto, p);
+    PUTCHAR(code, p);
+    PUTCHAR(id, p);
+    PUTSHORT(dlen + HEADERLEN, p);
+    if (dlen > 0)
+	memcpy(p, data, dlen);
+    ppp_input_frame(buf, PPP_HDRLEN + HEADERLEN + dlen);
+}
+
+/* The peer's own Configure-Request for a control protocol */
+static void
+peer_request(int proto)
+{
+    unsigned char opts[16];
+    int n = 0;
+
+    if (proto == PPP_IPCP) {
+	if (sent_req[1]++)
+	    return;
+	opts[n++] = 3;		/* IP-Address */
+	opts[n++] = 6;
+	memcpy(&opts[n], "\12\0\0\2", 4);	/* 10.0.0.2 */
+	n += 4;
+#ifdef PPP_WITH_IPV6CP
+    } else if (proto == PPP_IPV6CP) {
+	if (sent_req[2]++)
+	    return;
+	opts[n++] = 1;		/* Interface-Identifier */
+	opts[n++] = 10;
+	memcpy(&opts[n], peer_ifid, 8);
+	n += 8;
+#endif
+    } else if (sent_req[0]++)
+	return;
+    peer_send(proto, CONFREQ, peer_id++, opts, n);
+}
+
+/* The peer answers one frame from the engine */
+static void
+peer_input(unsigned char *p, int len)
+{
+    int proto, code, id, plen;
+    unsigned char *inp = p + 2;
+
+    GETSHORT(proto, inp);
+    if (len < PPP_HDRLEN + HEADERLEN)
+	return;
+    GETCHAR(code, inp);
+    GETCHAR(id, inp);
+    GETSHORT(plen, inp);
+    plen -= HEADERLEN;
+
+    if (proto != PPP_LCP && proto != PPP_IPCP
+#ifdef PPP_WITH_IPV6CP
+	&& proto != PPP_IPV6CP
+#endif
+	) {
+	peer_send(PPP_LCP, PROTREJ, peer_id++, p + 2, len - 2);
+	return;
+    }
+    switch (code) {
+    case CONFREQ:
+	peer_send(proto, CONFACK, id, inp, plen);
+	peer_request(proto);
+	break;
+    case TERMREQ:
+	peer_send(proto, TERMACK, id, NULL, 0);
+	break;
+    }
+}
+
+/* Let the peer answer everything the engine has sent; returns the count */
+static int
+run_peer(void)
+{
+    unsigned char buf[PPP_MRU + PPP_HDRLEN];
+    int i, len, n = 0;
+
+    while (nframes > 0) {
+	len = frames[0].len;
+	memcpy(buf, frames[0].buf, len);
+	--nframes;
+	for (i = 0; i < nframes; ++i)
+	    frames[i] = frames[i+1];
+	peer_input(buf, len);
+	++n;
+    }
+    return n;
+}
+
+static int
+write_options(char *path)
+{
+    FILE *f;
+
+    f = fopen(path, "w");
+    if (f == NULL)
+	return -1;
+    fprintf(f, "noauth\nnovj\nnoccp\n10.0.0.1:\n");
+#ifdef PPP_WITH_IPV6CP
+    fprintf(f, "+ipv6\n");
+#endif
+    fclose(f);
+    return 0;
+}
+
+int
+main(void)
+{
+    char path[] = "/tmp/ppp_engine_utest.XXXXXX";
+    int fd, i, failure = 0;
+
+    fd = mkstemp(path);
+    if (fd < 0 || write_options(path) < 0) {
+	printf("Could not write the options file, aborting\n");
+	return 1;
+    }
+    close(fd);
+
+    frame_out_hook = frame_out;
+    timer_arm_hook = timer_arm;
+    iface_config_hook = iface_config;
+    ppp_engine_init();
+    if (!ppp_options_from_file(path, 1, 0, 1)) {
+	printf("Could not read the options\n");
+	unlink(path);
+	return 1;
+    }
+    unlink(path);
+    ppp_add_notify(NF_IP_UP, ip_up_notify, NULL);
+    ppp_add_notify(NF_IP_DOWN, ip_down_notify, NULL);
+
+    ppp_engine_open();
+    for (i = 0; i < 10 && run_peer() > 0; ++i)
+	;
+
+    if (ip_up != 1) {
+	printf("IPCP didn't come up\n");
+	failure++;
+    }
+    if (if_addr != 1 || got_ouraddr != htonl(0x0a000001)
+	|| got_hisaddr != htonl(0x0a000002)) {
+	printf("IPv4 addresses weren't set\n");
+	failure++;
+    }
+    if (if_up < 1 || !if_npmode_pass) {
+	printf("Interface wasn't brought up for IP\n");
+	failure++;
+    }
+#ifdef PPP_WITH_IPV6CP
+    if (if6_up != 1 || if6_addr != 1
+	|| memcmp(got_hisid, peer_ifid, sizeof(got_hisid)) != 0) {
+	printf("Interface wasn't brought up for IPv6\n");
+	failure++;
+    }
+#endif
+
+    ppp_engine_close("test done");
+    for (i = 0; i < 10 && run_peer() > 0; ++i)
+	;
+
+    if (ip_down != 1 || if_up != 0 || if_addr != 0) {
+	printf("Interface wasn't taken down for IP\n");
+	failure++;
+    }
+#ifdef PPP_WITH_IPV6CP
+    if (if6_up != 0 || if6_addr != 0) {
+	printf("Interface wasn't taken down for IPv6\n");
+	failure++;
+    }
+#endif
+
+    return failure;
+}
@@ -29,6 +29,7 @@
 #include <limits.h>
 #include <stddef.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/select.h>
 
 #include "pppd.h"
@@ -58,6 +59,7 @@ void wait_input(struct timeval *timo)
     fd_set ready, exc;
     int n;
     struct event_handler* h = handlers, *nh;
+    struct timespec t0;
 
     called_remove = 0;
     ready = in_fds;
@@ -70,7 +72,14 @@ void wait_input(struct timeval *timo)
 	nh = h->next;
 	if (FD_ISSET(h->fd, &ready)) {
 	    FD_CLR(h->fd, &ready); /* clear so that if we need to re-iterate we won't call again */
-	    h->cb(h->fd, h->ctx);
+	    if (cpu_accounting) {
+		event_cb cb = h->cb;	/* cb may remove h */
+
+		cpu_acct_start(&t0);
+		cb(h->fd, h->ctx);
+		cpu_acct_end(&t0, CPU_ACCT_FD, (uintptr_t) cb);
+	    } else
+		h->cb(h->fd, h->ctx);
 
 	    if (called_remove) {
 		nh = handlers;
@@ -52,6 +52,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 
 #include "pppd-private.h"
@@ -66,11 +67,31 @@ static void fsm_rtermreq (fsm *, int, u_char *, int);
 static void fsm_rtermack (fsm *);
 static void fsm_rcoderej (fsm *, u_char *, int);
 static void fsm_sconfreq (fsm *, int);
+static void fsm_settimer (fsm *, int);
+static unsigned int fsm_now_us (void);
+static void fsm_rtt_ack (fsm *);
 
 #define PROTO_NAME(f)	((f)->callbacks->proto_name)
 
 int peer_mru[NUM_PPP];
 
+/*
+ * With adaptive-restart, the retransmission timeout for all the
+ * protocols on a link comes from the round-trip time measured on it,
+ * as for TCP (RFC 6298), rather than being a fixed number of seconds.
+ * The RTT is measured from Configure-Request to Ack, Nak or Reject
+ * (for requests which weren't retransmitted, so we know which one
+ * was answered), and from LCP Echo-Requests.
+ */
+bool adaptive_restart = 0;
+int adaptive_restart_min = 200;		/* ms */
+int adaptive_restart_max = 10000;	/* ms */
+
+static struct fsm_rtt {
+    int srtt;			/* smoothed RTT, us; 0 => no samples yet */
+    int rttvar;			/* RTT variation, us */
+} fsm_rtt[NUM_PPP];
+
 
 /*
  * fsm_init - Initialize fsm.
@@ -97,6 +118,7 @@ fsm_init(fsm *f)
 void
 fsm_lowerup(fsm *f)
 {
+    f->flags &= ~OPT_NOCACHE;
     switch( f->state ){
     case INITIAL:
 	f->state = CLOSED;
@@ -229,12 +251,31 @@ terminate_layer(fsm *f, int nextstate)
 	return;
     }
 
-    TIMEOUT(fsm_timeout, f, f->timeouttime);
+    fsm_settimer(f, 0);
     --f->retransmits;
 
     f->state = nextstate;
 }
 
+/*
+ * fsm_renegotiate - Restart negotiation on an open connection.
+ *
+ * Used when we want different options from the ones agreed, e.g. to
+ * turn compression off.  The peer sees a Configure-Request in the
+ * Opened state, and renegotiates too.
+ */
+void
+fsm_renegotiate(fsm *f)
+{
+    if (f->state != OPENED)
+	return;
+    if( f->callbacks->down )
+	(*f->callbacks->down)(f);	/* Inform upper layers */
+    fsm_sconfreq(f, 0);			/* Send initial Configure-Request */
+    f->state = REQSENT;
+}
+
+
 /*
  * fsm_close - Start closing connection.
  *
@@ -289,7 +330,7 @@ fsm_timeout(void *arg)
 	    /* Send Terminate-Request */
 	    fsm_sdata(f, TERMREQ, f->reqid = ++f->id,
 		      (u_char *) f->term_reason, f->term_reason_len);
-	    TIMEOUT(fsm_timeout, f, f->timeouttime);
+	    fsm_settimer(f, f->maxtermtransmits - f->retransmits);
 	    --f->retransmits;
 	}
 	break;
@@ -478,6 +519,7 @@ fsm_rconfack(fsm *f, int id, u_char *inp, int len)
     }
     f->seen_ack = 1;
     f->rnakloops = 0;
+    fsm_rtt_ack(f);
 
     switch (f->state) {
     case CLOSED:
@@ -524,28 +566,52 @@ fsm_rconfnakrej(fsm *f, int code, int id, u_char *inp, int len)
 {
     int ret;
     int treat_as_reject;
+    int cached;
 
     if (id != f->reqid || f->seen_ack)	/* Expected id? */
 	return;				/* Nope, toss... */
 
+    /*
+     * If our request used what the peer agreed to last time, it
+     * doesn't agree now.  Go back to our configured options, which
+     * the cache may have narrowed (to one authentication protocol,
+     * say), and carry on from the Nak or Reject as if we had sent
+     * those; don't count this as a hit for the cache.  If it doesn't
+     * make sense against them, just send them.
+     */
+    cached = f->flags & OPT_CACHED;
+    if (cached) {
+	f->flags = (f->flags & ~OPT_CACHED) | OPT_NOCACHE;
+	if (f->callbacks->resetci)
+	    (*f->callbacks->resetci)(f);
+    }
+
     if (code == CONFNAK) {
 	++f->rnakloops;
 	treat_as_reject = (f->rnakloops >= f->maxnakloops);
 	if (f->callbacks->nakci == NULL
 	    || !(ret = f->callbacks->nakci(f, inp, len, treat_as_reject))) {
-	    error("Received bad configure-nak: %P", inp, len);
-	    return;
+	    if (!cached) {
+		error("Received bad configure-nak: %P", inp, len);
+		return;
+	    }
+	    ret = 1;
 	}
     } else {
 	f->rnakloops = 0;
 	if (f->callbacks->rejci == NULL
 	    || !(ret = f->callbacks->rejci(f, inp, len))) {
-	    error("Received bad configure-rej: %P", inp, len);
-	    return;
+	    if (!cached) {
+		error("Received bad configure-rej: %P", inp, len);
+		return;
+	    }
+	    ret = 1;
 	}
     }
 
     f->seen_ack = 1;
+    ++f->nakrej;
+    fsm_rtt_ack(f);
 
     switch (f->state) {
     case CLOSED:
@@ -602,7 +668,7 @@ fsm_rtermreq(fsm *f, int id, u_char *p, int len)
 	f->state = STOPPING;
 	if (f->callbacks->down)
 	    (*f->callbacks->down)(f);	/* Inform upper layers */
-	TIMEOUT(fsm_timeout, f, f->timeouttime);
+	fsm_settimer(f, 0);
 	break;
     }
 
@@ -717,10 +783,12 @@ fsm_sconfreq(fsm *f, int retransmit)
 
     if( f->state != REQSENT && f->state != ACKRCVD && f->state != ACKSENT ){
 	/* Not currently negotiating - reset options */
+	f->flags &= ~OPT_CACHED;
 	if( f->callbacks->resetci )
 	    (*f->callbacks->resetci)(f);
 	f->nakloops = 0;
 	f->rnakloops = 0;
+	f->nakrej = 0;
     }
 
     if( !retransmit ){
@@ -746,10 +814,100 @@ fsm_sconfreq(fsm *f, int retransmit)
 
     /* send the request to our peer */
     fsm_sdata(f, CONFREQ, f->reqid, outp, cilen);
+    f->req_time = fsm_now_us();
 
     /* start the retransmit timer */
     --f->retransmits;
-    TIMEOUT(fsm_timeout, f, f->timeouttime);
+    fsm_settimer(f, f->maxconfreqtransmits - f->retransmits - 1);
+}
+
+
+/*
+ * fsm_now_us - a clock for measuring round trips, in microseconds.
+ * It wraps, but only differences matter.
+ */
+static unsigned int
+fsm_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000U + ts.tv_nsec / 1000;
+}
+
+/*
+ * fsm_settimer - start the retransmission timer.  With
+ * adaptive-restart, the timeout is doubled for each of the previous
+ * (re)transmissions.
+ */
+static void
+fsm_settimer(fsm *f, int backoff)
+{
+    struct fsm_rtt *r = &fsm_rtt[f->unit];
+    int rto;
+
+    if (!adaptive_restart) {
+	TIMEOUT(fsm_timeout, f, f->timeouttime);
+	return;
+    }
+    if (r->srtt == 0)
+	rto = f->timeouttime * 1000;
+    else
+	rto = (r->srtt + 4 * r->rttvar) / 1000;
+    if (rto < adaptive_restart_min)
+	rto = adaptive_restart_min;
+    while (backoff-- > 0 && rto < adaptive_restart_max)
+	rto *= 2;
+    if (rto > adaptive_restart_max)
+	rto = adaptive_restart_max;
+    ppp_timeout(fsm_timeout, f, rto / 1000, (rto % 1000) * 1000);
+}
+
+/*
+ * fsm_rtt_ack - our Configure-Request has been answered; measure the
+ * round trip if it was only sent once.
+ */
+static void
+fsm_rtt_ack(fsm *f)
+{
+    if (adaptive_restart && f->retransmits == f->maxconfreqtransmits - 1)
+	fsm_rtt_sample(f->unit, fsm_now_us() - f->req_time);
+}
+
+/*
+ * fsm_rtt_sample - update the RTT estimate for a link with a new
+ * measurement, in microseconds.
+ */
+void
+fsm_rtt_sample(int unit, unsigned int rtt)
+{
+    struct fsm_rtt *r = &fsm_rtt[unit];
+    int err;
+
+    if (rtt > 60000000)
+	return;			/* clock jumped? */
+    if (rtt == 0)
+	rtt = 1;
+    if (r->srtt == 0) {
+	r->srtt = rtt;
+	r->rttvar = rtt / 2;
+    } else {
+	err = (int) rtt - r->srtt;
+	if (err < 0)
+	    err = -err;
+	r->rttvar += (err - r->rttvar) / 4;
+	r->srtt += ((int) rtt - r->srtt) / 8;
+    }
+}
+
+/*
+ * fsm_rtt_reset - forget the RTT estimate, when a new link comes up.
+ */
+void
+fsm_rtt_reset(int unit)
+{
+    fsm_rtt[unit].srtt = 0;
+    fsm_rtt[unit].rttvar = 0;
 }
 
 
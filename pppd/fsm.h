@@ -86,6 +86,8 @@ typedef struct fsm {
     struct fsm_callbacks *callbacks;	/* Callback routines */
     char *term_reason;		/* Reason for closing protocol */
     int term_reason_len;	/* Length of term_reason */
+    int nakrej;			/* # Naks/Rejects in this negotiation */
+    unsigned int req_time;	/* When Configure-Request was sent, us */
 } fsm;
 
 
@@ -135,6 +137,8 @@ typedef struct fsm_callbacks {
 #define OPT_PASSIVE	1	/* Don't die if we don't get a response */
 #define OPT_RESTART	2	/* Treat 2nd OPEN as DOWN, UP */
 #define OPT_SILENT	4	/* Wait for peer to speak first */
+#define OPT_CACHED	8	/* Request came from the negotiation cache */
+#define OPT_NOCACHE	16	/* Cached options failed; don't use them */
 
 
 /*
@@ -154,15 +158,21 @@ void fsm_lowerup (fsm *);
 void fsm_lowerdown (fsm *);
 void fsm_open (fsm *);
 void fsm_close (fsm *, char *);
+void fsm_renegotiate (fsm *);
 void fsm_input (fsm *, unsigned char *, int);
 void fsm_protreject (fsm *);
 void fsm_sdata (fsm *, int, int, unsigned char *, int);
+void fsm_rtt_reset (int);
+void fsm_rtt_sample (int, unsigned int);
 
 
 /*
  * Variables
  */
 extern int peer_mru[];		/* currently negotiated peer MRU (per unit) */
+extern bool adaptive_restart;	/* retransmit timeouts from measured RTT */
+extern int adaptive_restart_min; /* shortest retransmit timeout, ms */
+extern int adaptive_restart_max; /* longest retransmit timeout, ms */
 
 #ifdef __cplusplus
 }
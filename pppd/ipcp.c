@@ -95,6 +95,7 @@ static int ipcp_is_up;			/* have called np_up() */
 static int ipcp_is_open;		/* haven't called np_finished() */
 static bool ask_for_local;		/* request our address from peer */
 static char vj_value[8];		/* string form of vj option value */
+static bool vj_auto_slots = 0;	/* size VJ slots from past sessions */
 static char netmask_str[20];		/* string form of netmask value */
 
 /*
@@ -135,6 +136,10 @@ static fsm_callbacks ipcp_callbacks = { /* IPCP callback routines */
  * Command-line options.
  */
 static int setvjslots (char **);
+static void vj_report_stats (fsm *);
+static int vj_peer_key (char *, int);
+static void ipcp_cache_apply (fsm *);
+static void ipcp_cache_save (fsm *);
 static int setdnsaddr (char **);
 static int setwinsaddr (char **);
 static int setnetmask (char **);
@@ -165,6 +170,8 @@ static struct option ipcp_option_list[] = {
     { "vj-max-slots", o_special, (void *)setvjslots,
       "Set maximum VJ header slots",
       OPT_PRIO | OPT_A2STRVAL | OPT_STATIC, vj_value },
+    { "vj-auto-slots", o_bool, &vj_auto_slots,
+      "Size VJ header slots from the peer's last session", 1 },
 
     { "ipcp-accept-local", o_bool, &ipcp_wantoptions[0].accept_local,
       "Accept peer's address for us", 1 },
@@ -720,6 +727,29 @@ ipcp_resetci(fsm *f)
     *go = *wo;
     if (!ask_for_local)
 	go->ouraddr = 0;
+    if (vj_auto_slots && go->neg_vj && !go->old_vj) {
+	char key[MAXNAMELEN + 16], val[8];
+	void *data;
+	int len, n;
+
+	/* Ask for as many slots as the peer's last session needed */
+	if (vj_peer_key(key, sizeof(key))
+	    && ppp_db_fetch(key, &data, &len) == 0) {
+	    n = 0;
+	    if (len < sizeof(val)) {
+		memcpy(val, data, len);
+		val[len] = 0;
+		n = atoi(val);
+	    }
+	    free(data);
+	    if (n >= 2 && n <= MAX_VJ_SLOTS)
+		go->maxslotindex = n - 1;
+	}
+	/* and let the peer have as many as it wants */
+	ao->maxslotindex = MAX_VJ_SLOTS - 1;
+    }
+    if (negotiation_cache)
+	ipcp_cache_apply(f);
     if (ip_choose_hook) {
 	ip_choose_hook(&wo->hisaddr);
 	if (wo->hisaddr) {
@@ -730,6 +760,77 @@ ipcp_resetci(fsm *f)
 }
 
 
+/*
+ * What we keep in the negotiation cache: the options of ours which
+ * the peer agreed to last time.
+ */
+struct ipcp_cached {
+    u_char neg_vj;
+    u_char old_vj;
+    u_char cflag;
+    u_char req_dns1;
+    u_char req_dns2;
+    int vj_protocol;
+    int maxslotindex;
+    uint32_t ouraddr;
+    uint32_t dnsaddr[2];
+};
+
+/*
+ * ipcp_cache_apply - start from the options the peer agreed to last
+ * time, as far as our configuration allows.
+ */
+static void
+ipcp_cache_apply(fsm *f)
+{
+    ipcp_options *go = &ipcp_gotoptions[f->unit];
+    struct ipcp_cached c;
+
+    if (!negcache_fetch(f, &c, sizeof(c)))
+	return;
+    if (go->accept_local && c.ouraddr != 0)
+	go->ouraddr = c.ouraddr;
+    go->req_dns1 = go->req_dns1 && c.req_dns1;
+    if (go->req_dns1)
+	go->dnsaddr[0] = c.dnsaddr[0];
+    go->req_dns2 = go->req_dns2 && c.req_dns2;
+    if (go->req_dns2)
+	go->dnsaddr[1] = c.dnsaddr[1];
+    go->neg_vj = go->neg_vj && c.neg_vj;
+    if (go->neg_vj) {
+	go->old_vj = c.old_vj;
+	go->vj_protocol = c.vj_protocol;
+	/* vj-auto-slots may want more slots than last time */
+	if (!vj_auto_slots && c.maxslotindex < go->maxslotindex)
+	    go->maxslotindex = c.maxslotindex;
+	go->cflag = go->cflag && c.cflag;
+    }
+    f->flags |= OPT_CACHED;
+}
+
+/*
+ * ipcp_cache_save - remember the options the peer agreed to.
+ */
+static void
+ipcp_cache_save(fsm *f)
+{
+    ipcp_options *go = &ipcp_gotoptions[f->unit];
+    struct ipcp_cached c;
+
+    memset(&c, 0, sizeof(c));
+    c.neg_vj = go->neg_vj;
+    c.old_vj = go->old_vj;
+    c.cflag = go->cflag;
+    c.vj_protocol = go->vj_protocol;
+    c.maxslotindex = go->maxslotindex;
+    c.ouraddr = go->ouraddr;
+    c.req_dns1 = go->req_dns1;
+    c.req_dns2 = go->req_dns2;
+    c.dnsaddr[0] = go->dnsaddr[0];
+    c.dnsaddr[1] = go->dnsaddr[1];
+    negcache_store(f, &c, sizeof(c));
+}
+
 /*
  * ipcp_cilen - Return length of our CI.
  * Called by fsm_sconfreq, Send Configure Request.
@@ -1854,6 +1955,8 @@ ipcp_up(fsm *f)
     ppp_script_setenv("IPLOCAL", ip_ntoa(go->ouraddr), 0);
     if (ho->hisaddr != 0)
 	ppp_script_setenv("IPREMOTE", ip_ntoa(ho->hisaddr), 1);
+    if (negotiation_cache)
+	ipcp_cache_save(f);
 
     if (!go->req_dns1)
 	    go->dnsaddr[0] = 0;
@@ -1884,8 +1987,13 @@ ipcp_up(fsm *f)
 	return;
     }
 
-    /* set tcp compression */
-    sifvjcomp(f->unit, ho->neg_vj, ho->cflag, ho->maxslotindex);
+    /*
+     * Set tcp compression.  The top 16 bits of maxcid give the number
+     * of receive slots, if we asked for more than the usual 16.
+     */
+    sifvjcomp(f->unit, ho->neg_vj, ho->cflag, ho->maxslotindex
+	      | (go->neg_vj && go->maxslotindex >= MAX_STATES?
+		 go->maxslotindex << 16: 0));
 
     /*
      * If we are doing dial-on-demand, the interface is already
@@ -1953,7 +2061,7 @@ ipcp_up(fsm *f)
 	ipcp_script(path_ippreup, 1);
 
 	/* check if preup script renamed the interface */
-	if (!if_indextoname(ifindex, ifname)) {
+	if (iface_config_hook == NULL && !if_indextoname(ifindex, ifname)) {
             error("Interface index %d failed to get renamed by a pre-up script", ifindex);
 	    ipcp_close(f->unit, "Interface configuration failed");
 	    return;
@@ -2040,6 +2148,7 @@ ipcp_down(fsm *f)
 	ipcp_is_up = 0;
 	np_down(f->unit, PPP_IP);
     }
+    vj_report_stats(f);
     sifvjcomp(f->unit, 0, 0, 0);
 
     print_link_stats(); /* _after_ running the notifiers and ip_down_hook(),
@@ -2067,6 +2176,74 @@ ipcp_down(fsm *f)
 }
 
 
+/*
+ * vj_peer_key - make the database key under which we remember the
+ * number of VJ slots for this peer.  Returns 0 if we don't know who
+ * the peer is.
+ */
+static int
+vj_peer_key(char *key, int len)
+{
+    if (peer_authname[0])
+	slprintf(key, len, "vjslots:%s", peer_authname);
+    else if (remote_number[0])
+	slprintf(key, len, "vjslots:@%s", remote_number);
+    else
+	return 0;
+    return 1;
+}
+
+/*
+ * vj_report_stats - log how well VJ header compression did, and with
+ * vj-auto-slots, remember how many slots the peer should get next
+ * time.  A connection which isn't in the slot table costs a full
+ * header, so if more than VJ_MISS_PCT percent of TCP packets missed,
+ * we double the number of slots.
+ */
+#define VJ_MISS_PCT		10
+#define VJ_MIN_PACKETS		1000
+
+static void
+vj_report_stats(fsm *f)
+{
+    ipcp_options *go = &ipcp_gotoptions[f->unit];
+    ipcp_options *ho = &ipcp_hisoptions[f->unit];
+    struct vjstat vj;
+    u_int32_t tcp;
+    int slots;
+    char key[MAXNAMELEN + 16], val[16];
+
+    if (!ho->neg_vj || !get_ppp_vj_stats(f->unit, &vj))
+	return;
+
+    info("VJ: sent %u packets, %u compressed, %u misses;"
+	 " received %u compressed, %u uncompressed, %u errors",
+	 vj.vjs_packets, vj.vjs_compressed, vj.vjs_misses,
+	 vj.vjs_compressedin, vj.vjs_uncompressedin, vj.vjs_errorin);
+    slprintf(val, sizeof(val), "%u", vj.vjs_compressed);
+    ppp_script_setenv("VJ_COMPRESSED", val, 0);
+    slprintf(val, sizeof(val), "%u", vj.vjs_misses);
+    ppp_script_setenv("VJ_MISSES", val, 0);
+    slprintf(val, sizeof(val), "%u", vj.vjs_compressedin);
+    ppp_script_setenv("VJ_COMPRESSED_IN", val, 0);
+    slprintf(val, sizeof(val), "%u", vj.vjs_errorin + vj.vjs_tossed);
+    ppp_script_setenv("VJ_ERRORS_IN", val, 0);
+
+    tcp = vj.vjs_compressed + vj.vjs_misses;
+    if (!vj_auto_slots || !go->neg_vj || go->old_vj || tcp < VJ_MIN_PACKETS
+	|| !vj_peer_key(key, sizeof(key)))
+	return;
+    slots = go->maxslotindex + 1;
+    if ((unsigned long long) vj.vjs_misses * 100 > (unsigned long long) tcp * VJ_MISS_PCT
+	&& slots < MAX_VJ_SLOTS) {
+	slots = slots * 2 > MAX_VJ_SLOTS? MAX_VJ_SLOTS: slots * 2;
+	info("VJ: %u of %u TCP packets missed, will ask for %d slots",
+	     vj.vjs_misses, tcp, slots);
+    }
+    slprintf(val, sizeof(val), "%d", slots);
+    ppp_db_store(key, val, strlen(val));
+}
+
 /*
  * ipcp_clear_addrs() - clear the interface addresses, routes,
  * proxy arp entries, etc.
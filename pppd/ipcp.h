@@ -61,6 +61,7 @@ extern "C" {
 #define CI_MS_WINS2	132	/* Secondary WINS value */
 
 #define MAX_STATES 16		/* from slcompress.h */
+#define MAX_VJ_SLOTS 255	/* Linux's slhc_init takes no more */
 
 #define IPCP_VJMODE_OLD 1	/* "old" mode (option # = 0x0037) */
 #define IPCP_VJMODE_RFC1172 2	/* "old-rfc"mode (option # = 0x002d) */
@@ -206,6 +206,8 @@ static int  ipv6cp_reqci (fsm *, u_char *, int *, int); /* Rcv CI */
 static void ipv6cp_up (fsm *);		/* We're UP */
 static void ipv6cp_down (fsm *);		/* We're DOWN */
 static void ipv6cp_finished (fsm *);	/* Don't need lower layer */
+static void ipv6cp_cache_apply (fsm *);
+static void ipv6cp_cache_save (fsm *);
 
 fsm ipv6cp_fsm[NUM_PPP];		/* IPV6CP fsm structure */
 
@@ -555,6 +557,52 @@ ipv6cp_resetci(fsm *f)
     
     *go = *wo;
     eui64_zero(go->hisid);	/* last proposed interface identifier */
+    if (negotiation_cache)
+	ipv6cp_cache_apply(f);
+}
+
+
+/*
+ * What we keep in the negotiation cache: the options of ours which
+ * the peer agreed to last time.
+ */
+struct ipv6cp_cached {
+    int neg_ifaceid;
+    eui64_t ourid;
+};
+
+/*
+ * ipv6cp_cache_apply - start from the options the peer agreed to last
+ * time, as far as our configuration allows.
+ */
+static void
+ipv6cp_cache_apply(fsm *f)
+{
+    ipv6cp_options *go = &ipv6cp_gotoptions[f->unit];
+    struct ipv6cp_cached c;
+
+    if (!negcache_fetch(f, &c, sizeof(c)))
+	return;
+    go->neg_ifaceid = go->neg_ifaceid && c.neg_ifaceid;
+    /* use the identifier the peer last gave us, if we may choose */
+    if (go->neg_ifaceid && !go->opt_local && !eui64_iszero(c.ourid))
+	go->ourid = c.ourid;
+    f->flags |= OPT_CACHED;
+}
+
+/*
+ * ipv6cp_cache_save - remember the options the peer agreed to.
+ */
+static void
+ipv6cp_cache_save(fsm *f)
+{
+    ipv6cp_options *go = &ipv6cp_gotoptions[f->unit];
+    struct ipv6cp_cached c;
+
+    memset(&c, 0, sizeof(c));
+    c.neg_ifaceid = go->neg_ifaceid;
+    c.ourid = go->ourid;
+    negcache_store(f, &c, sizeof(c));
 }
 
 
@@ -1309,6 +1357,8 @@ ipv6cp_up(fsm *f)
     ppp_script_setenv("LLLOCAL", llv6_ntoa(go->ourid), 0);
     if (!eui64_iszero(ho->hisid))
         ppp_script_setenv("LLREMOTE", llv6_ntoa(ho->hisid), 0);
+    if (negotiation_cache)
+	ipv6cp_cache_save(f);
 
 #ifdef IPV6CP_COMP
     /* set tcp compression */
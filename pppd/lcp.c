@@ -49,6 +49,7 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <arpa/inet.h>
 #include <sys/mman.h>
@@ -77,6 +78,7 @@ static void lcp_delayed_up(void *);
  * time (RTT) of LCP echo-requests implemented in lcp_rtt_update_buffer().
  */
 #define LCP_RTT_MAGIC 0x19450425
+#define LCP_ACCM_MAGIC 0x41434d50	/* marks asyncmap probe echo-requests */
 #define LCP_RTT_HEADER_LENGTH 4
 #define LCP_RTT_FILE_SIZE 8192
 #define LCP_RTT_ELEMENTS (LCP_RTT_FILE_SIZE / sizeof(u_int32_t) - LCP_RTT_HEADER_LENGTH) / 2
@@ -90,6 +92,7 @@ bool	lcp_echo_adaptive = 0;	/* request echo only if the link was idle */
 char	*lcp_rtt_file = NULL;	/* measure the RTT of LCP echo-requests */
 bool	lax_recv = 0;		/* accept control chars in asyncmap */
 bool	noendpoint = 0;		/* don't send/accept endpoint discriminator */
+bool	accm_probe = 0;		/* find which control chars needn't be escaped */
 
 static int noopt(char **);
 
@@ -178,6 +181,18 @@ static struct option lcp_option_list[] = {
       "Set maximum number of LCP configure-request transmissions", OPT_PRIO },
     { "lcp-max-failure", o_int, &lcp_fsm[0].maxnakloops,
       "Set limit on number of LCP configure-naks", OPT_PRIO },
+    { "adaptive-restart", o_bool, &adaptive_restart,
+      "Set retransmission timeouts from the measured round-trip time",
+      OPT_PRIO | 1 },
+    { "adaptive-restart-min", o_int, &adaptive_restart_min,
+      "Set shortest retransmission timeout in milliseconds",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 1 },
+    { "adaptive-restart-max", o_int, &adaptive_restart_max,
+      "Set longest retransmission timeout in milliseconds",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 1 },
+
+    { "accm-probe", o_bool, &accm_probe,
+      "Probe which control characters need not be escaped", 1 },
 
     { "receive-all", o_bool, &lax_recv,
       "Accept all received control characters", 1 },
@@ -220,6 +235,38 @@ static u_int32_t *lcp_rtt_buffer = NULL; /* the mmap'ed LCP RTT file */
 
 static u_char nak_buffer[PPP_MRU];	/* where we construct a nak packet */
 
+/*
+ * State for the asyncmap probe.  accm_queue holds the sets of
+ * characters still to be tried; accm_probing is the set being tried
+ * now, and accm_safe the characters which got through unescaped.
+ */
+static u_int32_t accm_queue[32];
+static int accm_nqueue;
+static u_int32_t accm_probing;
+static u_int32_t accm_safe;
+static int accm_probe_id;
+static bool accm_probe_pending;	/* start once the network phase is up */
+
+/*
+ * What we keep in the negotiation cache: the options of ours which
+ * the peer agreed to last time.
+ */
+struct lcp_cached {
+    u_char neg_mru;
+    u_char neg_asyncmap;
+    u_char neg_upap;
+    u_char neg_chap;
+    u_char neg_eap;
+    u_char neg_pcompression;
+    u_char neg_accompression;
+    u_char chap_mdtype;
+    int mru;
+    uint32_t asyncmap;
+};
+
+static void lcp_cache_apply(fsm *);
+static void lcp_cache_save(fsm *);
+
 /*
  * Callbacks for fsm code.  (CI = Configuration Information)
  */
@@ -242,12 +289,17 @@ static void lcp_rprotrej(fsm *, u_char *, int);
  */
 
 static void lcp_echo_lowerup(int);
-static void lcp_echo_lowerdown(int);
 static void LcpEchoTimeout(void *);
 static void lcp_received_echo_reply(fsm *, int, u_char *, int);
 static void LcpSendEchoRequest(fsm *);
 static void LcpLinkFailure(fsm *);
 static void LcpEchoCheck(fsm *);
+static void accm_send_config(fsm *, u_int32_t);
+static void accm_probe_start(fsm *);
+static void accm_probe_stop(fsm *);
+static void accm_probe_reply(fsm *, u_char *, int);
+static void accm_probe_timeout(void *);
+static void accm_probe_phase(void *, int);
 
 static fsm_callbacks lcp_callbacks = {	/* LCP callback routines */
     lcp_resetci,		/* Reset our Configuration Information */
@@ -359,6 +411,7 @@ lcp_init(int unit)
     f->callbacks = &lcp_callbacks;
 
     fsm_init(f);
+    ppp_add_notify(NF_PHASE_CHANGE, accm_probe_phase, f);
 
     BZERO(wo, sizeof(*wo));
     wo->neg_mru = 1;
@@ -453,6 +506,7 @@ lcp_lowerup(int unit)
 			   wo->neg_pcompression, wo->neg_accompression) < 0)
 	    return;
     peer_mru[unit] = PPP_MRU;
+    fsm_rtt_reset(unit);
 
     if (listen_time != 0) {
 	f->flags |= DELAYED_UP;
@@ -650,6 +704,8 @@ lcp_resetci(fsm *f)
 	go->neg_ssnhf = 0;
 	go->neg_endpoint = 0;
     }
+    if (negotiation_cache)
+	lcp_cache_apply(f);
     if (noendpoint)
 	ao->neg_endpoint = 0;
     peer_mru[f->unit] = PPP_MRU;
@@ -657,6 +713,63 @@ lcp_resetci(fsm *f)
 }
 
 
+/*
+ * lcp_cache_apply - start from the options the peer agreed to last
+ * time, as far as our configuration allows.
+ */
+static void
+lcp_cache_apply(fsm *f)
+{
+    lcp_options *wo = &lcp_wantoptions[f->unit];
+    lcp_options *go = &lcp_gotoptions[f->unit];
+    struct lcp_cached c;
+
+    if (!negcache_fetch(f, &c, sizeof(c)))
+	return;
+    go->neg_mru = go->neg_mru && c.neg_mru;
+    /* the mru option (or the interface) may have lowered it since */
+    if (go->neg_mru)
+	go->mru = MIN(c.mru, wo->mru);
+    go->neg_asyncmap = go->neg_asyncmap && c.neg_asyncmap;
+    if (go->neg_asyncmap)
+	go->asyncmap |= c.asyncmap;
+    if ((go->neg_eap && c.neg_eap) || (go->neg_chap && c.neg_chap)
+	|| (go->neg_upap && c.neg_upap)) {
+	/* ask for the authentication protocol the peer agreed to */
+	go->neg_eap = go->neg_eap && c.neg_eap;
+	go->neg_chap = go->neg_chap && c.neg_chap;
+	go->neg_upap = go->neg_upap && c.neg_upap;
+	if (go->neg_chap && (go->chap_mdtype & c.chap_mdtype))
+	    go->chap_mdtype &= c.chap_mdtype;
+    }
+    go->neg_pcompression = go->neg_pcompression && c.neg_pcompression;
+    go->neg_accompression = go->neg_accompression && c.neg_accompression;
+    f->flags |= OPT_CACHED;
+}
+
+/*
+ * lcp_cache_save - remember the options the peer agreed to.
+ */
+static void
+lcp_cache_save(fsm *f)
+{
+    lcp_options *go = &lcp_gotoptions[f->unit];
+    struct lcp_cached c;
+
+    memset(&c, 0, sizeof(c));
+    c.neg_mru = go->neg_mru;
+    c.mru = go->mru;
+    c.neg_asyncmap = go->neg_asyncmap;
+    c.asyncmap = go->asyncmap;
+    c.neg_eap = go->neg_eap;
+    c.neg_chap = !go->neg_eap && go->neg_chap;
+    c.neg_upap = !go->neg_eap && !go->neg_chap && go->neg_upap;
+    c.chap_mdtype = CHAP_MDTYPE_D(CHAP_DIGEST(go->chap_mdtype));
+    c.neg_pcompression = go->neg_pcompression;
+    c.neg_accompression = go->neg_accompression;
+    negcache_store(f, &c, sizeof(c));
+}
+
 /*
  * lcp_cilen - Return length of our CI.
  */
@@ -1904,8 +2017,13 @@ lcp_up(fsm *f)
     if (ho->neg_mru)
 	peer_mru[f->unit] = ho->mru;
 
+    if (negotiation_cache)
+	lcp_cache_save(f);
+
     lcp_echo_lowerup(f->unit);  /* Enable echo messages */
 
+    accm_probe_pending = accm_probe;
+
     link_established(f->unit);
 }
 
@@ -1921,6 +2039,7 @@ lcp_down(fsm *f)
     lcp_options *go = &lcp_gotoptions[f->unit];
 
     lcp_echo_lowerdown(f->unit);
+    accm_probe_stop(f);
 
     link_down(f->unit);
 
@@ -2334,7 +2453,13 @@ lcp_received_echo_reply (fsm *f, int id, u_char *inp, int len)
 	return;
     }
 
-    if (lcp_rtt_file_fd && len >= 16) {
+    /* a probe reply has our magic, then the probe's magic and mask */
+    if (accm_probing && id == accm_probe_id && len >= 12) {
+	accm_probe_reply(f, inp, len - 4);
+	return;
+    }
+
+    if ((lcp_rtt_file_fd || adaptive_restart) && len >= 16) {
 	long lcp_rtt_magic;
 
 	/*
@@ -2354,7 +2479,11 @@ lcp_received_echo_reply (fsm *f, int id, u_char *inp, int len)
 	    rtt = (ts.tv_sec - req_sec) * 1000000
 		+ (ts.tv_nsec / 1000 - req_nsec / 1000);
 	    /* log the RTT */
-	    lcp_rtt_update_buffer(rtt);
+	    if (lcp_rtt_file_fd)
+		lcp_rtt_update_buffer(rtt);
+	    /* and use it for retransmission timeouts */
+	    if (adaptive_restart)
+		fsm_rtt_sample(f->unit, rtt);
 	}
     }
 
@@ -2382,6 +2511,17 @@ LcpSendEchoRequest (fsm *f)
 	}
     }
 
+    /*
+     * An unanswered echo-request may mean that the peer is losing
+     * frames with characters we have stopped escaping.
+     */
+    if (accm_safe && !accm_probing && lcp_echos_pending > 0) {
+	warn("No reply to echo-request: escaping asyncmap 0x%x again",
+	     accm_safe);
+	accm_safe = 0;
+	accm_send_config(f, 0);
+    }
+
     /*
      * If adaptive echos have been enabled, only send the echo request if
      * no traffic was received since the last one.
@@ -2407,7 +2547,7 @@ LcpSendEchoRequest (fsm *f)
 	PUTLONG(lcp_magic, pktp);
 
 	/* Put a timestamp in the data section of the frame */
-	if (lcp_rtt_file_fd) {
+	if (lcp_rtt_file_fd || adaptive_restart) {
 	    struct timespec ts;
 
 	    PUTLONG(LCP_RTT_MAGIC, pktp);
@@ -2498,7 +2638,7 @@ lcp_echo_lowerup (int unit)
  * lcp_echo_lowerdown - Stop the timer for the LCP frame
  */
 
-static void
+void
 lcp_echo_lowerdown (int unit)
 {
     fsm *f = &lcp_fsm[unit];
@@ -2511,3 +2651,191 @@ lcp_echo_lowerdown (int unit)
     /* Close the file containing the LCP RTT data */
     lcp_rtt_close_file();
 }
+
+/*
+ * The peer's asyncmap says which control characters we must escape,
+ * but often they would get through unescaped anyway, and escaping them
+ * costs a byte each time one is sent: about 12% of random binary data
+ * with the default map.  With accm-probe, once the network phase is up
+ * (so that a failed probe can't cost authentication or NCP frames,
+ * since it changes the map for every frame we send) we send
+ * echo-requests containing some of those characters unescaped, and if
+ * the echo-reply comes back with them intact, we stop escaping them.
+ * If a set of characters doesn't come back, it is split in two and
+ * each half tried, down to single characters.  Later, if an
+ * echo-request goes unanswered, we go back to escaping everything the
+ * peer asked for.
+ */
+
+/*
+ * accm_send_config - set the transmit asyncmap to the peer's, less the
+ * characters found safe and those in extra.
+ */
+static void
+accm_send_config(fsm *f, u_int32_t extra)
+{
+    lcp_options *ho = &lcp_hisoptions[f->unit];
+
+    ppp_send_config(f->unit, ho->neg_mru? ho->mru: PPP_MRU,
+		    ho->asyncmap & ~(accm_safe | extra),
+		    ho->neg_pcompression, ho->neg_accompression);
+}
+
+/*
+ * accm_probe_next - try the next set of characters, or finish.
+ */
+static void
+accm_probe_next(fsm *f)
+{
+    u_char pkt[12 + 64], *pktp;
+    u_int32_t mask, n;
+    int c;
+
+    if (accm_nqueue == 0) {
+	accm_probing = 0;
+	accm_send_config(f, 0);
+	if (accm_safe) {
+	    for (n = c = 0; c < 32; ++c)
+		if (accm_safe & (1U << c))
+		    ++n;
+	    /* each character is 1/256 of random data */
+	    notice("asyncmap probe: sending with asyncmap 0x%x instead of "
+		   "0x%x, saving about %d.%d%% on binary data",
+		   lcp_hisoptions[f->unit].asyncmap & ~accm_safe,
+		   lcp_hisoptions[f->unit].asyncmap,
+		   n * 1000 / 256 / 10, n * 1000 / 256 % 10);
+	} else
+	    info("asyncmap probe: all control characters need escaping");
+	return;
+    }
+
+    mask = accm_probing = accm_queue[--accm_nqueue];
+    accm_send_config(f, mask);
+
+    pktp = pkt;
+    PUTLONG(lcp_gotoptions[f->unit].magicnumber, pktp);
+    PUTLONG(LCP_ACCM_MAGIC, pktp);
+    PUTLONG(mask, pktp);
+    for (c = 0; c < 32; ++c) {
+	if (mask & (1U << c)) {
+	    *pktp++ = c;
+	    *pktp++ = c;
+	}
+    }
+    accm_probe_id = lcp_echo_number++ & 0xFF;
+    fsm_sdata(f, ECHOREQ, accm_probe_id, pkt, pktp - pkt);
+    TIMEOUT(accm_probe_timeout, f, f->timeouttime);
+}
+
+/*
+ * accm_probe_result - note whether the set being tried got through.
+ */
+static void
+accm_probe_result(fsm *f, int ok)
+{
+    u_int32_t half;
+    int c, n;
+
+    if (ok) {
+	accm_safe |= accm_probing;
+    } else if (accm_probing & (accm_probing - 1)) {
+	/* more than one character: try each half */
+	for (n = c = 0; c < 32; ++c)
+	    if (accm_probing & (1U << c))
+		++n;
+	half = 0;
+	for (c = 0; n > 1; ++c) {
+	    if (accm_probing & (1U << c)) {
+		half |= 1U << c;
+		n -= 2;
+	    }
+	}
+	accm_queue[accm_nqueue++] = accm_probing & ~half;
+	accm_queue[accm_nqueue++] = half;
+    } else {
+	dbglog("asyncmap probe: character 0x%x must be escaped",
+	       ffs(accm_probing) - 1);
+    }
+    accm_probe_next(f);
+}
+
+static void
+accm_probe_timeout(void *arg)
+{
+    accm_probe_result((fsm *) arg, 0);
+}
+
+/*
+ * accm_probe_reply - check the data in the echo-reply to a probe.
+ */
+static void
+accm_probe_reply(fsm *f, u_char *inp, int len)
+{
+    u_int32_t magic, mask;
+    int c, ok;
+
+    GETLONG(magic, inp);
+    GETLONG(mask, inp);
+    if (magic != LCP_ACCM_MAGIC || mask != accm_probing)
+	return;
+    len -= 8;
+    UNTIMEOUT(accm_probe_timeout, f);
+    ok = 1;
+    for (c = 0; c < 32 && ok; ++c) {
+	if (mask & (1U << c)) {
+	    if (len < 2 || inp[0] != c || inp[1] != c)
+		ok = 0;
+	    inp += 2;
+	    len -= 2;
+	}
+    }
+    accm_probe_result(f, ok && len == 0);
+}
+
+/*
+ * accm_probe_phase - start the probe LCP asked for, once we reach the
+ * network phase.
+ */
+static void
+accm_probe_phase(void *arg, int phase)
+{
+    fsm *f = arg;
+
+    if (phase != PHASE_RUNNING || !accm_probe_pending)
+	return;
+    accm_probe_pending = 0;
+    if (f->state == OPENED)
+	accm_probe_start(f);
+}
+
+/*
+ * accm_probe_start - called when the network phase is up.
+ */
+static void
+accm_probe_start(fsm *f)
+{
+    lcp_options *ho = &lcp_hisoptions[f->unit];
+    u_int32_t cand;
+
+    accm_safe = 0;
+    accm_nqueue = 0;
+    if (!ho->neg_asyncmap)
+	return;		/* not an async link */
+    /* leave alone what we were told to escape, and XON/XOFF */
+    cand = ho->asyncmap & ~lcp_allowoptions[f->unit].asyncmap & ~0x000A0000;
+    if (cand == 0)
+	return;
+    accm_queue[accm_nqueue++] = cand;
+    accm_probe_next(f);
+}
+
+static void
+accm_probe_stop(fsm *f)
+{
+    if (accm_probing)
+	UNTIMEOUT(accm_probe_timeout, f);
+    accm_probe_pending = 0;
+    accm_probing = 0;
+    accm_nqueue = 0;
+    accm_safe = 0;
+}
@@ -142,6 +142,7 @@ void lcp_close(int, char *);
 void lcp_lowerup(int);
 void lcp_lowerdown(int);
 void lcp_sprotrej(int, unsigned char *, int);	/* send protocol reject */
+void lcp_echo_lowerdown(int);	/* stop sending echo requests */
 
 extern struct protent lcp_protent;
 
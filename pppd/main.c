@@ -82,6 +82,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -131,6 +132,7 @@ char *progname;			/* Name of this program */
 char hostname[MAXNAMELEN];	/* Our hostname */
 static char pidfilename[MAXPATHLEN];	/* name of pid file */
 static char linkpidfile[MAXPATHLEN];	/* name of linkname pid file */
+static bool not_link_owner;	/* the linkname pid file isn't ours */
 uid_t uid;			/* Our real user-id */
 struct notifier *pidchange = NULL;
 struct notifier *phasechange = NULL;
@@ -160,6 +162,10 @@ int (*holdoff_hook)(void) = NULL;
 int (*new_phase_hook)(int) = NULL;
 void (*snoop_recv_hook)(unsigned char *p, int len) = NULL;
 void (*snoop_send_hook)(unsigned char *p, int len) = NULL;
+void (*frame_out_hook)(int unit, unsigned char *p, int len) = NULL;
+void (*timer_arm_hook)(int msecs) = NULL;
+int (*iface_config_hook)(int unit, ppp_iface_op_t op,
+			 struct ppp_iface_config *cfg) = NULL;
 
 static int conn_running;	/* we have a [dis]connector running */
 static int fd_loop;		/* fd for getting demand-dial packets */
@@ -255,8 +261,15 @@ static void cleanup_db(void);
 
 static void handle_events(void);
 void print_link_stats(void);
+static void startup_mark(const char *);
+static void startup_report(void);
 
 extern	char	*getlogin(void);
+
+#ifdef PPP_LIBRARY
+/* In libpppd, the program using the library has the main() */
+#define main	ppp_main
+#endif
 int main(int, char *[]);
 
 const char *ppp_hostname()
@@ -268,6 +281,8 @@ bool ppp_signaled(int sig)
 {
     if (sig == SIGTERM)
         return !!got_sigterm;
+    if (sig == SIGINT)
+        return got_sigterm == SIGINT;
     if (sig == SIGUSR2)
         return !!got_sigusr2;
     if (sig == SIGHUP)
@@ -325,6 +340,17 @@ int ppp_get_link_uptime()
     return link_connect_time;
 }
 
+/*
+ * Timestamps taken as we start up, for the startup-profile option.
+ * n_startup_marks is set to -1 once they have been reported.
+ */
+#define MAX_STARTUP_MARKS	16
+static struct startup_mark {
+    const char *what;
+    struct timeval when;
+} startup_marks[MAX_STARTUP_MARKS];
+static int n_startup_marks;
+
 /*
  * PPP Data Link Layer "protocol" table.
  * One entry per supported protocol.
@@ -358,6 +384,9 @@ main(int argc, char *argv[])
     struct passwd *pw;
     struct protent *protp;
     char numbuf[16];
+    struct timeval now;
+
+    startup_mark("start");
 
     strlcpy(path_upapfile, PPP_PATH_UPAPFILE, MAXPATHLEN);
     strlcpy(path_chapfile, PPP_PATH_CHAPFILE, MAXPATHLEN);
@@ -383,10 +412,11 @@ main(int argc, char *argv[])
     /* Initialize syslog facilities */
     reopen_log();
 
-    /* Initialize crypto libraries */
-    if (!PPP_crypto_init()) {
-        exit(1);
-    }
+    /*
+     * The crypto libraries are initialized when first used, since
+     * loading the OpenSSL providers is a noticeable part of our
+     * startup time and many links never need them.
+     */
 
     if (gethostname(hostname, sizeof(hostname)) < 0 ) {
 	ppp_option_error("Couldn't get hostname: %m");
@@ -404,17 +434,8 @@ main(int argc, char *argv[])
 
     ngroups = getgroups(NGROUPS_MAX, groups);
 
-    /*
-     * Initialize magic number generator now so that protocols may
-     * use magic numbers in initialization.
-     */
-    magic_init();
-
-    /*
-     * Initialize each protocol.
-     */
-    for (i = 0; (protp = protocols[i]) != NULL; ++i)
-        (*protp->init)(0);
+    ppp_engine_init();
+    startup_mark("protocol init");
 
     /*
      * Initialize the default channel.
@@ -439,6 +460,7 @@ main(int argc, char *argv[])
      */
     if (the_channel->process_extra_options)
 	(*the_channel->process_extra_options)();
+    startup_mark("options");
 
     if (debug)
 	setlogmask(LOG_UPTO(LOG_DEBUG));
@@ -461,6 +483,7 @@ main(int argc, char *argv[])
 	ppp_option_error("%s", no_ppp_msg);
 	exit(EXIT_NO_KERNEL_SUPPORT);
     }
+    startup_mark("kernel check");
 
     /*
      * Check that the options given are valid and consistent.
@@ -475,7 +498,7 @@ main(int argc, char *argv[])
 	    (*protp->check_options)();
     if (the_channel->check_options)
 	(*the_channel->check_options)();
-
+    startup_mark("option checks");
 
     if (dump_options || dryrun) {
 	init_pr_log(NULL, LOG_INFO);
@@ -503,12 +526,14 @@ main(int argc, char *argv[])
      * Initialize system-dependent stuff.
      */
     sys_init();
+    startup_mark("system init");
 
 #ifdef PPP_WITH_TDB
     pppdb = tdb_open(PPP_PATH_PPPDB, 0, 0, O_RDWR|O_CREAT, 0644);
     if (pppdb != NULL) {
 	slprintf(db_key, sizeof(db_key), "pppd%d", getpid());
 	update_db_entry();
+	dbgc_init();
     } else {
 	warn("Warning: couldn't open ppp database %s", PPP_PATH_PPPDB);
 	if (multilink) {
@@ -516,7 +541,9 @@ main(int argc, char *argv[])
 	    multilink = 0;
 	}
     }
+    startup_mark("database");
 #endif
+    cpu_acct_init();
 
     /*
      * Detach ourselves from the terminal, if required,
@@ -561,8 +588,26 @@ main(int argc, char *argv[])
 	demand_conf();
     }
 
+    /*
+     * If earlier attempts failed, perhaps in a pppd which has since
+     * been restarted, finish waiting before we start.
+     */
+    t = backoff_pending();
+    if (t > 0) {
+	notice("Waiting %d seconds before connecting", t);
+	new_phase(PHASE_HOLDOFF);
+	TIMEOUT(holdoff_end, NULL, t);
+	do {
+	    handle_events();
+	    if (kill_link)
+		new_phase(PHASE_DORMANT); /* allow signal to end holdoff */
+	} while (phase == PHASE_HOLDOFF);
+    }
+
     do_callback = 0;
     for (;;) {
+	if (asked_to_quit)
+	    break;
 
 	bundle_eof = 0;
 	bundle_terminating = 0;
@@ -578,6 +623,8 @@ main(int argc, char *argv[])
 	    /*
 	     * Don't do anything until we see some activity.
 	     */
+	    startup_mark("demand setup");
+	    startup_report();
 	    new_phase(PHASE_DORMANT);
 	    demand_unblock();
 	    add_fd(fd_loop);
@@ -606,6 +653,8 @@ main(int argc, char *argv[])
 
 	lcp_open(0);		/* Start protocol */
 	start_link(0);
+	startup_mark("link start");
+	startup_report();
 	while (phase != PHASE_DEAD) {
 	    handle_events();
 	    get_input();
@@ -634,6 +683,11 @@ main(int argc, char *argv[])
 	if (demand)
 	    demand_discard();
 	t = need_holdoff? holdoff: 0;
+	if (holdoff_max > 0) {
+	    ppp_get_time(&now);
+	    t = backoff_next(t, need_holdoff || code == EXIT_HANGUP,
+			     now.tv_sec - start_time.tv_sec);
+	}
 	if (holdoff_hook)
 	    t = (*holdoff_hook)();
 	if (t > 0) {
@@ -672,6 +726,49 @@ main(int argc, char *argv[])
     return 0;
 }
 
+/*
+ * startup_mark - note the time at which we finished some stage of
+ * starting up.
+ */
+static void
+startup_mark(const char *what)
+{
+    if (n_startup_marks < 0 || n_startup_marks >= MAX_STARTUP_MARKS)
+	return;
+    startup_marks[n_startup_marks].what = what;
+    ppp_get_time(&startup_marks[n_startup_marks].when);
+    ++n_startup_marks;
+}
+
+/*
+ * startup_report - log how long each stage of starting up took,
+ * if the startup-profile option was given.  Only done once.
+ */
+static void
+startup_report(void)
+{
+    struct timeval *t0, *tp;
+    long us, tot;
+    int i;
+
+    if (n_startup_marks <= 0)
+	return;
+    if (startup_profile) {
+	t0 = &startup_marks[0].when;
+	for (i = 1; i < n_startup_marks; ++i) {
+	    tp = &startup_marks[i-1].when;
+	    us = (startup_marks[i].when.tv_sec - tp->tv_sec) * 1000000
+		+ startup_marks[i].when.tv_usec - tp->tv_usec;
+	    tot = (startup_marks[i].when.tv_sec - t0->tv_sec) * 1000000
+		+ startup_marks[i].when.tv_usec - t0->tv_usec;
+	    notice("startup: %s took %ld.%03ld ms (%ld.%03ld ms total)",
+		   startup_marks[i].what, us / 1000, us % 1000,
+		   tot / 1000, tot % 1000);
+	}
+    }
+    n_startup_marks = -1;
+}
+
 /*
  * handle_events - wait for something to happen and respond to it.
  */
@@ -944,7 +1041,7 @@ create_linkpidfile(int pid)
 {
     FILE *pidfile;
 
-    if (linkname[0] == 0)
+    if (linkname[0] == 0 || not_link_owner)
 	return;
     ppp_script_setenv("LINKNAME", linkname, 1);
     slprintf(linkpidfile, sizeof(linkpidfile), "%s/ppp-%s.pid",
@@ -973,6 +1070,36 @@ void remove_pidfiles(void)
     linkpidfile[0] = 0;
 }
 
+/*
+ * ppp_forget_pidfiles - called in a process which a plugin has forked
+ * to carry on as a pppd of its own (such as a session of a PPPoE
+ * access concentrator).  The pid files so far, and the one for the
+ * link name, belong to the process it was forked from, so we mustn't
+ * overwrite or remove them.
+ */
+void
+ppp_forget_pidfiles(void)
+{
+    pidfilename[0] = 0;
+    linkpidfile[0] = 0;
+    not_link_owner = 1;
+}
+
+/*
+ * ppp_reseed - called in a process which a plugin has forked to run a
+ * link of its own.  It inherited the random number state of the
+ * process it was forked from, so without this every such process would
+ * use the same magic numbers, and send the same authentication ids and
+ * challenges (which a peer could replay).  CHAP picks its id when it
+ * starts, but EAP picked its first id at initialization, so pick again.
+ */
+void
+ppp_reseed(void)
+{
+    magic_init();
+    eap_states[0].es_server.ea_id = (u_char)(drand48() * 0x100);
+}
+
 /*
  * holdoff_end - called via a timeout when the holdoff period ends.
  */
@@ -1137,12 +1264,7 @@ protocol_name(int proto)
 static void
 get_input(void)
 {
-    int len, i;
-    u_char *p;
-    u_short protocol;
-    struct protent *protp;
-
-    p = inpacket_buf;	/* point to beginning of packet buffer */
+    int len;
 
     len = read_packet(inpacket_buf);
     if (len < 0)
@@ -1163,6 +1285,21 @@ get_input(void)
 	return;
     }
 
+    ppp_input_frame(inpacket_buf, len);
+}
+
+/*
+ * ppp_input_frame - process a frame received from the link, starting
+ * with the address and control fields.
+ */
+void
+ppp_input_frame(u_char *p, int len)
+{
+    int i;
+    u_short protocol;
+    struct protent *protp;
+    struct timespec t0;
+
     if (len < PPP_HDRLEN) {
 	dbglog("received short packet:%.*B", len, p);
 	return;
@@ -1201,12 +1338,20 @@ get_input(void)
      */
     for (i = 0; (protp = protocols[i]) != NULL; ++i) {
 	if (protp->protocol == protocol && protp->enabled_flag) {
+	    if (cpu_accounting)
+		cpu_acct_start(&t0);
 	    (*protp->input)(0, p, len);
+	    if (cpu_accounting)
+		cpu_acct_end(&t0, CPU_ACCT_PROTO, protocol);
 	    return;
 	}
         if (protocol == (protp->protocol & ~0x8000) && protp->enabled_flag
 	    && protp->datainput != NULL) {
+	    if (cpu_accounting)
+		cpu_acct_start(&t0);
 	    (*protp->datainput)(0, p, len);
+	    if (cpu_accounting)
+		cpu_acct_end(&t0, CPU_ACCT_PROTO, protocol);
 	    return;
 	}
     }
@@ -1321,6 +1466,7 @@ cleanup(void)
     if (the_channel->cleanup)
 	(*the_channel->cleanup)();
     remove_pidfiles();
+    session_flush();
 
 #ifdef PPP_WITH_TDB
     if (pppdb != NULL)
@@ -1406,6 +1552,7 @@ struct	callout {
 
 static struct callout *callout = NULL;	/* Callout list */
 static struct timeval timenow;		/* Current time */
+static struct ppp_pool *callout_pool;	/* Where callouts come from */
 
 /*
  * timeout - Schedule a timeout.
@@ -1418,7 +1565,10 @@ ppp_timeout(void (*func)(void *), void *arg, int secs, int usecs)
     /*
      * Allocate timeout.
      */
-    if ((newp = (struct callout *) malloc(sizeof(struct callout))) == NULL)
+    if (callout_pool == NULL)
+	callout_pool = ppp_pool_create("callout", sizeof(struct callout));
+    if (callout_pool == NULL
+	|| (newp = ppp_pool_alloc(callout_pool)) == NULL)
 	fatal("Out of memory in timeout()!");
     newp->c_arg = arg;
     newp->c_func = func;
@@ -1440,6 +1590,10 @@ ppp_timeout(void (*func)(void *), void *arg, int secs, int usecs)
 	    break;
     newp->c_next = p;
     *pp = newp;
+
+    /* An event loop outside pppd needs to know if this is due first */
+    if (timer_arm_hook && pp == &callout)
+	(*timer_arm_hook)(secs * 1000 + usecs / 1000);
 }
 
 
@@ -1457,7 +1611,7 @@ ppp_untimeout(void (*func)(void *), void *arg)
     for (copp = &callout; (freep = *copp); copp = &freep->c_next)
 	if (freep->c_func == func && freep->c_arg == arg) {
 	    *copp = freep->c_next;
-	    free((char *) freep);
+	    ppp_pool_free(callout_pool, freep);
 	    break;
 	}
 }
@@ -1470,6 +1624,7 @@ static void
 calltimeout(void)
 {
     struct callout *p;
+    struct timespec t0;
 
     while (callout != NULL) {
 	p = callout;
@@ -1482,9 +1637,14 @@ calltimeout(void)
 	    break;		/* no, it's not time yet */
 
 	callout = p->c_next;
-	(*p->c_func)(p->c_arg);
+	if (cpu_accounting) {
+	    cpu_acct_start(&t0);
+	    (*p->c_func)(p->c_arg);
+	    cpu_acct_end(&t0, CPU_ACCT_TIMER, (uintptr_t) p->c_func);
+	} else
+	    (*p->c_func)(p->c_arg);
 
-	free((char *) p);
+	ppp_pool_free(callout_pool, p);
     }
 }
 
@@ -1511,6 +1671,88 @@ timeleft(struct timeval *tvp)
     return tvp;
 }
 
+/*
+ * ppp_advance_time - run the timeouts which are due, for an event loop
+ * outside pppd.  Returns the number of milliseconds until the next one
+ * is due, or -1 if there are none.
+ */
+int
+ppp_advance_time(void)
+{
+    struct timeval tv;
+
+    calltimeout();
+    if (timeleft(&tv) == NULL)
+	return -1;
+    return tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+}
+
+/*
+ * A channel with nothing to do, for a program which runs the link
+ * itself and hasn't given us a channel of its own.
+ */
+static struct option engine_options[] = {
+    { NULL }
+};
+
+static struct channel engine_channel = {
+    .options = engine_options,
+};
+
+/*
+ * ppp_engine_init - initialize the magic number generator and the
+ * protocols.  Options may be set after this.
+ */
+void
+ppp_engine_init(void)
+{
+    struct protent *protp;
+    int i;
+
+    if (the_channel == NULL)
+	the_channel = &engine_channel;
+
+    /*
+     * Initialize magic number generator now so that protocols may
+     * use magic numbers in initialization.
+     */
+    magic_init();
+
+    /*
+     * Initialize each protocol.
+     */
+    for (i = 0; (protp = protocols[i]) != NULL; ++i)
+        (*protp->init)(0);
+}
+
+/*
+ * ppp_engine_open - check the options given and start LCP, for a
+ * program which has brought up the link itself rather than through a
+ * channel.
+ */
+void
+ppp_engine_open(void)
+{
+    struct protent *protp;
+    int i;
+
+    for (i = 0; (protp = protocols[i]) != NULL; ++i)
+	if (protp->check_options != NULL)
+	    (*protp->check_options)();
+    lcp_open(0);
+    new_phase(PHASE_ESTABLISH);
+    lcp_lowerup(0);
+}
+
+/*
+ * ppp_engine_close - take the link down, as if on a user request.
+ */
+void
+ppp_engine_close(char *reason)
+{
+    lcp_close(0, reason);
+}
+
 
 /*
  * kill_my_pg - send a signal to our process group, and ignore it ourselves.
@@ -2299,6 +2541,100 @@ void unlock_db(void)
 #endif
 }
 
+/*
+ * ppp_db_store - store a record in the database under key,
+ * replacing any existing record.
+ */
+int
+ppp_db_store(const char *key, const void *data, int len)
+{
+#ifdef PPP_WITH_TDB
+    TDB_DATA k, dbuf;
+
+    if (pppdb == NULL)
+	return -1;
+    k.dptr = (char *) key;
+    k.dsize = strlen(key);
+    dbuf.dptr = (char *) data;
+    dbuf.dsize = len;
+    if (tdb_store(pppdb, k, dbuf, TDB_REPLACE) == 0)
+	return 0;
+    error("tdb_store failed: %s", tdb_errorstr(pppdb));
+#endif
+    return -1;
+}
+
+/*
+ * ppp_db_fetch - look up the record stored under key.
+ */
+int
+ppp_db_fetch(const char *key, void **data, int *len)
+{
+#ifdef PPP_WITH_TDB
+    TDB_DATA k, dbuf;
+
+    if (pppdb == NULL)
+	return -1;
+    k.dptr = (char *) key;
+    k.dsize = strlen(key);
+    dbuf = tdb_fetch(pppdb, k);
+    if (dbuf.dptr == NULL)
+	return -1;
+    *data = dbuf.dptr;
+    *len = dbuf.dsize;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * ppp_db_delete - remove the record stored under key.
+ */
+int
+ppp_db_delete(const char *key)
+{
+#ifdef PPP_WITH_TDB
+    TDB_DATA k;
+
+    if (pppdb == NULL)
+	return -1;
+    k.dptr = (char *) key;
+    k.dsize = strlen(key);
+    return tdb_delete(pppdb, k) == 0? 0: -1;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * ppp_db_lock - take the database lock on behalf of a plugin.
+ */
+int
+ppp_db_lock(void)
+{
+#ifdef PPP_WITH_TDB
+    if (pppdb == NULL)
+	return -1;
+    lock_db();
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * ppp_db_unlock - release the lock taken by ppp_db_lock.
+ */
+void
+ppp_db_unlock(void)
+{
+#ifdef PPP_WITH_TDB
+    if (pppdb != NULL)
+	unlock_db();
+#endif
+}
+
 #ifdef PPP_WITH_TDB
 /*
  * update_db_entry - update our entry in the database.
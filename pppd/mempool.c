@@ -0,0 +1,205 @@
+/*
+ * mempool.c - pools of fixed-size objects for per-session state.
+ *
+ * Copyright (c) 1999-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Things like timeouts and RADIUS attribute lists are allocated and
+ * freed continually over the life of a session.  Coming from malloc,
+ * they end up scattered among longer-lived allocations, and over a
+ * long session the heap fragments and RSS creeps up.  Instead these
+ * objects come from slabs, each of which holds a number of objects of
+ * one size, so they stay together, and slabs which become empty can
+ * be given back when the link goes down.
+ *
+ * A slab is SLAB_SIZE bytes and aligned to SLAB_SIZE, so the slab an
+ * object belongs to can be found from its address.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pppd-private.h"
+
+#define SLAB_SIZE	4096
+#define POOL_ALIGN	16
+
+struct pool_slab {
+    struct pool_slab *next;
+    void *free;			/* list of free objects in this slab */
+    int nfree;
+};
+
+struct ppp_pool {
+    struct ppp_pool *next;	/* list of all pools */
+    const char *name;
+    size_t size;		/* object size, rounded up */
+    int per_slab;		/* objects per slab; 0 => use malloc */
+    struct pool_slab *slabs;
+    int nslabs;
+    int in_use;			/* objects allocated */
+    int peak;			/* most objects allocated at once */
+    unsigned long allocs;	/* total allocations */
+};
+
+#define SLAB_HDR	((sizeof(struct pool_slab) + POOL_ALIGN - 1) \
+			 & ~(POOL_ALIGN - 1))
+
+static struct ppp_pool *pools;
+
+/*
+ * ppp_pool_create - make a pool of objects of the given size.
+ * Objects too large to fit several to a slab just come from malloc,
+ * but are still counted.
+ */
+struct ppp_pool *
+ppp_pool_create(const char *name, size_t size)
+{
+    struct ppp_pool *pool;
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+	return NULL;
+    pool->name = name;
+    pool->size = (size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+    pool->per_slab = (SLAB_SIZE - SLAB_HDR) / pool->size;
+    if (pool->per_slab < 4)
+	pool->per_slab = 0;
+    pool->next = pools;
+    pools = pool;
+    return pool;
+}
+
+/*
+ * new_slab - get a new slab and put all its objects on its free list.
+ */
+static struct pool_slab *
+new_slab(struct ppp_pool *pool)
+{
+    struct pool_slab *slab;
+    char *p;
+    int i;
+
+    if (posix_memalign((void **) &slab, SLAB_SIZE, SLAB_SIZE) != 0)
+	return NULL;
+    slab->free = NULL;
+    p = (char *) slab + SLAB_HDR;
+    for (i = 0; i < pool->per_slab; ++i, p += pool->size) {
+	*(void **) p = slab->free;
+	slab->free = p;
+    }
+    slab->nfree = pool->per_slab;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    ++pool->nslabs;
+    return slab;
+}
+
+/*
+ * ppp_pool_alloc - allocate an object.  Returns NULL if out of memory.
+ */
+void *
+ppp_pool_alloc(struct ppp_pool *pool)
+{
+    struct pool_slab *slab;
+    void *obj;
+
+    if (pool->per_slab == 0) {
+	obj = malloc(pool->size);
+    } else {
+	for (slab = pool->slabs; slab != NULL; slab = slab->next)
+	    if (slab->nfree > 0)
+		break;
+	if (slab == NULL && (slab = new_slab(pool)) == NULL)
+	    return NULL;
+	obj = slab->free;
+	slab->free = *(void **) obj;
+	--slab->nfree;
+    }
+    if (obj == NULL)
+	return NULL;
+    ++pool->allocs;
+    if (++pool->in_use > pool->peak)
+	pool->peak = pool->in_use;
+    return obj;
+}
+
+/*
+ * ppp_pool_free - return an object to its pool.
+ */
+void
+ppp_pool_free(struct ppp_pool *pool, void *obj)
+{
+    struct pool_slab *slab;
+
+    if (obj == NULL)
+	return;
+    --pool->in_use;
+    if (pool->per_slab == 0) {
+	free(obj);
+	return;
+    }
+    slab = (struct pool_slab *) ((uintptr_t) obj & ~(uintptr_t)(SLAB_SIZE - 1));
+    *(void **) obj = slab->free;
+    slab->free = obj;
+    ++slab->nfree;
+}
+
+/*
+ * mempool_compact - give back the slabs which are empty, and publish
+ * how much each pool is using.  Called when the link goes down.
+ */
+void
+mempool_compact(void)
+{
+    struct ppp_pool *pool;
+    struct pool_slab *slab, **sp;
+    char buf[256], *p;
+
+    p = buf;
+    *p = 0;
+    for (pool = pools; pool != NULL; pool = pool->next) {
+	for (sp = &pool->slabs; (slab = *sp) != NULL; ) {
+	    if (slab->nfree == pool->per_slab) {
+		*sp = slab->next;
+		free(slab);
+		--pool->nslabs;
+	    } else
+		sp = &slab->next;
+	}
+	dbglog("pool %s: %d in use, peak %d, %lu allocations, %d slabs",
+	       pool->name, pool->in_use, pool->peak, pool->allocs,
+	       pool->nslabs);
+	p += slprintf(p, buf + sizeof(buf) - p, "%s%s:%d/%d/%d",
+		      p == buf? "": ",", pool->name, pool->in_use,
+		      pool->peak, pool->nslabs);
+    }
+    if (buf[0])
+	ppp_script_setenv("MEMPOOLS", buf, 0);
+}
@@ -0,0 +1,369 @@
+/*
+ * modem.c - built-in modem dialler for pppd.
+ *
+ * Copyright (C) 2000-2024 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This talks to a modem directly over the serial port, replacing the
+ * usual `connect "chat ..."' script for the common case.  The script
+ * is a list of expect/send string pairs, as for chat(8).  Unlike chat,
+ * we know the standard modem result codes, so BUSY, NO CARRIER and
+ * friends fail the connection at once rather than waiting for a
+ * timeout, and a command which gets no response is sent again.
+ * Unsolicited network registration reports (+CREG etc.) are logged
+ * and made available to scripts.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/time.h>
+
+#include "pppd-private.h"
+
+#define MODEM_MAXWORDS	64	/* max # expect and send strings */
+#define MODEM_BUFSIZE	512	/* how much modem output we remember */
+
+/* Result codes which mean the connection attempt has failed. */
+static const char *modem_abort_codes[] = {
+    "BUSY",
+    "NO CARRIER",
+    "NO DIALTONE",
+    "NO DIAL TONE",
+    "NO ANSWER",
+    "ERROR",
+    "DELAYED",
+    "BLACKLISTED",
+    NULL
+};
+
+struct modem_state {
+    int		fd;
+    char	buf[MODEM_BUFSIZE+1];	/* received since last match */
+    int		len;
+    int		line;		/* start of current line in buf */
+    const char	*failed;	/* abort code we saw */
+};
+
+extern int got_sigterm;
+extern int got_sighup;
+
+/*
+ * modem_split - split a modem script into words, in place.
+ * Words are separated by white space; single or double quotes may be
+ * used to include spaces in a word, and '' gives an empty word.
+ */
+static int
+modem_split(char *script, char **words, int max)
+{
+    char *p, *q;
+    int n = 0, quote;
+
+    p = script;
+    for (;;) {
+	while (*p == ' ' || *p == '\t' || *p == '\n')
+	    ++p;
+	if (*p == 0)
+	    break;
+	if (n >= max) {
+	    error("Too many strings in modem script");
+	    return -1;
+	}
+	words[n++] = q = p;
+	quote = 0;
+	for (; *p != 0; ++p) {
+	    if (quote) {
+		if (*p == quote) {
+		    quote = 0;
+		    continue;
+		}
+	    } else if (*p == '\'' || *p == '"') {
+		quote = *p;
+		continue;
+	    } else if (*p == ' ' || *p == '\t' || *p == '\n')
+		break;
+	    *q++ = *p;
+	}
+	if (*p != 0)
+	    ++p;
+	*q = 0;
+    }
+    return n;
+}
+
+/*
+ * modem_send - send a string to the modem, followed by a carriage
+ * return unless it ends in \c.  \r, \n and \\ are interpreted.
+ */
+static int
+modem_send(struct modem_state *ms, const char *s)
+{
+    char buf[MAXWORDLEN];
+    int n = 0, cr = 1;
+
+    for (; *s != 0 && n < sizeof(buf) - 1; ++s) {
+	if (*s == '\\' && s[1] != 0) {
+	    switch (*++s) {
+	    case 'r':
+		buf[n++] = '\r';
+		break;
+	    case 'n':
+		buf[n++] = '\n';
+		break;
+	    case 'c':
+		if (s[1] == 0)
+		    cr = 0;
+		break;
+	    default:
+		buf[n++] = *s;
+	    }
+	} else
+	    buf[n++] = *s;
+    }
+    if (cr)
+	buf[n++] = '\r';
+
+    if (debug)
+	dbglog("modem send: %.*v", n, buf);
+    if (write(ms->fd, buf, n) != n) {
+	error("Couldn't write to modem: %m");
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * modem_urc - look at a complete line from the modem for result codes
+ * which mean we have failed, and for unsolicited registration reports.
+ */
+static void
+modem_urc(struct modem_state *ms, char *line)
+{
+    const char **ac;
+    char *p, *var, value[8];
+    int stat;
+
+    if (*line == 0)
+	return;
+    if (debug)
+	dbglog("modem: %s", line);
+
+    for (ac = modem_abort_codes; *ac != NULL; ++ac) {
+	if (strcmp(line, *ac) == 0) {
+	    ms->failed = *ac;
+	    return;
+	}
+    }
+
+    if (strncmp(line, "+CREG:", 6) == 0)
+	var = "MODEM_CREG";
+    else if (strncmp(line, "+CGREG:", 7) == 0)
+	var = "MODEM_CGREG";
+    else if (strncmp(line, "+CEREG:", 7) == 0)
+	var = "MODEM_CEREG";
+    else
+	return;
+
+    /*
+     * An unsolicited report is "+CREG: <stat>[,...]", while the reply
+     * to AT+CREG? is "+CREG: <n>,<stat>[,...]".  Either way we want
+     * the registration status.
+     */
+    p = strchr(line, ':') + 1;
+    stat = strtol(p, &p, 10);
+    if (*p == ',' && p[1] >= '0' && p[1] <= '9')
+	stat = strtol(p + 1, NULL, 10);
+    switch (stat) {
+    case 1:
+	info("Modem registered on home network");
+	break;
+    case 5:
+	info("Modem registered on network (roaming)");
+	break;
+    case 2:
+	info("Modem searching for network");
+	break;
+    case 3:
+	warn("Modem network registration denied");
+	break;
+    default:
+	dbglog("Modem registration status %d", stat);
+    }
+    slprintf(value, sizeof(value), "%d", stat);
+    ppp_script_setenv(var, value, 0);
+}
+
+/*
+ * modem_input - process characters received from the modem.
+ * Returns 1 if we have now seen the expect string.
+ */
+static int
+modem_input(struct modem_state *ms, const char *expect, char *p, int n)
+{
+    int i, match;
+
+    for (; n > 0; --n, ++p) {
+	if (*p == 0)
+	    continue;
+	if (ms->len >= MODEM_BUFSIZE) {
+	    /* forget the oldest half */
+	    i = MODEM_BUFSIZE / 2;
+	    memmove(ms->buf, ms->buf + i, ms->len - i);
+	    ms->len -= i;
+	    ms->line = ms->line > i? ms->line - i: 0;
+	}
+	ms->buf[ms->len++] = *p;
+	ms->buf[ms->len] = 0;
+
+	match = *expect != 0 && strstr(ms->buf + ms->line, expect) != NULL;
+
+	if (*p == '\r' || *p == '\n') {
+	    ms->buf[ms->len - 1] = 0;
+	    modem_urc(ms, ms->buf + ms->line);
+	    ms->buf[ms->len - 1] = *p;
+	    ms->line = ms->len;
+	    if (ms->failed != NULL)
+		return 0;
+	}
+	if (match) {
+	    ms->len = ms->line = 0;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * modem_expect - wait up to timeout seconds for the expect string.
+ * Returns 1 if it was seen, 0 on timeout, -1 on failure.
+ */
+static int
+modem_expect(struct modem_state *ms, const char *expect, int timeout)
+{
+    struct pollfd pfd;
+    struct timeval now, end;
+    char buf[128];
+    int n, left;
+
+    if (*expect == 0)
+	return 1;
+    ppp_get_time(&end);
+    end.tv_sec += timeout;
+    for (;;) {
+	if (got_sigterm || got_sighup)
+	    return -1;
+	ppp_get_time(&now);
+	left = (end.tv_sec - now.tv_sec) * 1000
+	    + (end.tv_usec - now.tv_usec) / 1000;
+	if (left <= 0)
+	    return 0;
+	pfd.fd = ms->fd;
+	pfd.events = POLLIN;
+	n = poll(&pfd, 1, left);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    error("Error waiting for modem: %m");
+	    return -1;
+	}
+	if (n == 0)
+	    return 0;
+	n = read(ms->fd, buf, sizeof(buf));
+	if (n < 0) {
+	    if (errno == EINTR || errno == EAGAIN)
+		continue;
+	    error("Error reading from modem: %m");
+	    return -1;
+	}
+	if (n == 0) {
+	    error("Modem hung up");
+	    return -1;
+	}
+	if (modem_input(ms, expect, buf, n))
+	    return 1;
+	if (ms->failed != NULL) {
+	    error("Modem reported %s", ms->failed);
+	    return -1;
+	}
+    }
+}
+
+/*
+ * modem_chat - run the expect/send script on fd.  Each expect string
+ * gets timeout seconds; if it doesn't appear, the preceding send string
+ * is sent again, up to retries times.  Returns 0 once the last expect
+ * string has been seen, or -1 on failure.
+ */
+int
+modem_chat(int fd, char *script, int timeout, int retries)
+{
+    struct modem_state ms;
+    char *copy, *words[MODEM_MAXWORDS];
+    const char *last_send = NULL;
+    int i, n, r, tries, ret = -1;
+
+    copy = strdup(script);
+    if (copy == NULL)
+	novm("modem script");
+    n = modem_split(copy, words, MODEM_MAXWORDS);
+    if (n < 0)
+	goto out;
+
+    memset(&ms, 0, sizeof(ms));
+    ms.fd = fd;
+    tcflush(fd, TCIFLUSH);
+
+    for (i = 0; i < n; i += 2) {
+	tries = 0;
+	while ((r = modem_expect(&ms, words[i], timeout)) == 0) {
+	    if (last_send == NULL || ++tries > retries) {
+		error("Timed out waiting for \"%s\" from modem", words[i]);
+		goto out;
+	    }
+	    dbglog("No \"%s\" from modem, retrying", words[i]);
+	    if (modem_send(&ms, last_send) < 0)
+		goto out;
+	}
+	if (r < 0)
+	    goto out;
+	if (i + 1 < n) {
+	    last_send = words[i + 1];
+	    if (modem_send(&ms, last_send) < 0)
+		goto out;
+	}
+    }
+    ret = 0;
+
+ out:
+    free(copy);
+    return ret;
+}
@@ -0,0 +1,186 @@
+/*
+ * negcache.c - remember the options each peer agreed to.
+ *
+ * Copyright (c) 1984-2000 Carnegie Mellon University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name "Carnegie Mellon University" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For permission or any legal
+ *    details, please contact
+ *      Office of Technology Transfer
+ *      Carnegie Mellon University
+ *      5000 Forbes Avenue
+ *      Pittsburgh, PA  15213-3890
+ *      (412) 268-4387, fax: (412) 268-7395
+ *      tech-transfer@andrew.cmu.edu
+ *
+ * 4. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Computing Services
+ *     at Carnegie Mellon University (http://www.cmu.edu/computing/)."
+ *
+ * CARNEGIE MELLON UNIVERSITY DISCLAIMS ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY BE LIABLE
+ * FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Many peers Nak or Reject parts of our first Configure-Request every
+ * time (the MRU, the authentication protocol, our IP address, ...),
+ * which costs a round trip or two per protocol at every connection.
+ * With the negotiation-cache option, when a protocol comes up it saves
+ * the options that were agreed in the pppd database, keyed by the peer,
+ * and next time its resetci routine starts from those, marking the fsm
+ * with OPT_CACHED.  If the peer Naks or Rejects a request built from
+ * the cache, fsm.c clears OPT_CACHED, sets OPT_NOCACHE and calls
+ * resetci again, which then starts from our configured options, and
+ * the Nak or Reject is applied to those.  So a stale cache costs little
+ * more than having none (the Nak of a cached address, say, gives us
+ * the new one), and the record is replaced when we come up.
+ *
+ * LCP comes up before we know the peer's name, so the peer is
+ * identified by its calling number (with PPPoE, its MAC address) or
+ * the remotename option; the network protocols use the name the peer
+ * authenticated with if there is one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pppd-private.h"
+#include "fsm.h"
+
+bool negotiation_cache = 0;	/* start from the options agreed last time */
+
+#define NEGCACHE_PREFIX	"negcache:"
+
+/*
+ * Each record starts with the number of Naks and Rejects it took to
+ * reach agreement without the cache, which is what using it saves.
+ */
+struct negcache_hdr {
+    int nakrej;
+};
+
+#define NEGCACHE_MAXLEN	64	/* longest option record */
+
+static int hits, misses, saved;
+
+static int
+negcache_key(fsm *f, char *key, int len)
+{
+    if (f->protocol != PPP_LCP && peer_authname[0])
+	slprintf(key, len, "%s%04x:%s", NEGCACHE_PREFIX, f->protocol,
+		 peer_authname);
+    else if (remote_number[0])
+	slprintf(key, len, "%s%04x:@%s", NEGCACHE_PREFIX, f->protocol,
+		 remote_number);
+    else if (remote_name[0])
+	slprintf(key, len, "%s%04x:=%s", NEGCACHE_PREFIX, f->protocol,
+		 remote_name);
+    else
+	return 0;
+    return 1;
+}
+
+/*
+ * negcache_fetch - get the options the peer agreed to last time.
+ * Returns 1 if there is a record of the given length, in which case
+ * the caller should use it and set OPT_CACHED in f->flags.
+ */
+int
+negcache_fetch(fsm *f, void *opts, int len)
+{
+    char key[MAXNAMELEN + 32];
+    void *data;
+    int dlen, ok = 0;
+
+    if (!negotiation_cache || (f->flags & OPT_NOCACHE)
+	|| !negcache_key(f, key, sizeof(key))
+	|| ppp_db_fetch(key, &data, &dlen) < 0)
+	return 0;
+    if (dlen == sizeof(struct negcache_hdr) + len) {
+	memcpy(opts, (char *) data + sizeof(struct negcache_hdr), len);
+	ok = 1;
+    }
+    free(data);
+    return ok;
+}
+
+/*
+ * negcache_store - called when a protocol comes up, with the options
+ * that were agreed.  Saves them if they didn't come from the cache,
+ * and counts what the cache has saved.
+ */
+void
+negcache_store(fsm *f, const void *opts, int len)
+{
+    char key[MAXNAMELEN + 32], buf[sizeof(struct negcache_hdr) + NEGCACHE_MAXLEN];
+    struct negcache_hdr h;
+    void *data;
+    int dlen;
+
+    if (!negotiation_cache || len > NEGCACHE_MAXLEN
+	|| !negcache_key(f, key, sizeof(key)))
+	return;
+
+    if (f->flags & OPT_CACHED) {
+	/* agreed first time, so the record is still right */
+	++hits;
+	if (ppp_db_fetch(key, &data, &dlen) == 0) {
+	    if (dlen >= sizeof(h)) {
+		memcpy(&h, data, sizeof(h));
+		saved += h.nakrej;
+		dbglog("%s: negotiation cache saved %d round trip(s)",
+		       f->callbacks->proto_name, h.nakrej);
+	    }
+	    free(data);
+	}
+    } else {
+	h.nakrej = f->nakrej;
+	if (f->flags & OPT_NOCACHE) {
+	    /*
+	     * We started from the cache, so f->nakrej isn't what the
+	     * configured options cost; keep the count we had.
+	     */
+	    ++misses;
+	    if (ppp_db_fetch(key, &data, &dlen) == 0) {
+		if (dlen >= sizeof(h))
+		    memcpy(&h, data, sizeof(h));
+		free(data);
+	    }
+	}
+	if (h.nakrej > 0) {
+	    memcpy(buf, &h, sizeof(h));
+	    memcpy(buf + sizeof(h), opts, len);
+	    ppp_db_store(key, buf, sizeof(h) + len);
+	}
+    }
+
+    slprintf(buf, sizeof(buf), "%d", hits);
+    ppp_script_setenv("NEGCACHE_HITS", buf, 0);
+    slprintf(buf, sizeof(buf), "%d", misses);
+    ppp_script_setenv("NEGCACHE_MISSES", buf, 0);
+    slprintf(buf, sizeof(buf), "%d", saved);
+    ppp_script_setenv("NEGCACHE_SAVED", buf, 0);
+}
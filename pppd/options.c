@@ -130,12 +130,14 @@ char	path_ippreup[MAXPATHLEN]; /* pathname of ip-pre-up script */
 char	req_ifname[IFNAMSIZ];	/* requested interface name */
 #ifdef __linux__
 char	req_vrf[IFNAMSIZ];	/* VRF name to bind with PPP interface */
+bool	recheck_kernel;		/* ignore cached kernel features */
 #endif
 bool	multilink = 0;		/* Enable multilink operation */
 char	*bundle_name = NULL;	/* bundle name for multilink */
 bool	dump_options;		/* print out option values */
 bool	show_options;		/* print all supported options and exit */
 bool	dryrun;			/* print out option values and exit */
+bool	startup_profile;	/* log time taken by each startup stage */
 char	*domain;		/* domain name set by domain option */
 int	child_wait = 5;		/* # seconds to wait for children at exit */
 struct userenv *userenv_list;	/* user environment variables */
@@ -243,6 +245,12 @@ struct option general_options[] = {
     { "holdoff", o_int, &holdoff,
       "Set time in seconds before retrying connection",
       OPT_PRIO, &holdoff_specified },
+    { "holdoff-max", o_int, &holdoff_max,
+      "Back off up to this many seconds between failed connections",
+      OPT_PRIO },
+    { "holdoff-reset", o_int, &holdoff_reset,
+      "Time in seconds a connection must last to reset the backoff",
+      OPT_PRIO },
 
     { "idle", o_int, &idle_time_limit,
       "Set time in seconds before disconnecting idle link", OPT_PRIO },
@@ -321,12 +329,34 @@ struct option general_options[] = {
     { "vrf", o_string, req_vrf,
       "Bind PPP interface to the specified VRF and install routes in its routing table",
       OPT_PRIO | OPT_PRIV | OPT_STATIC, NULL, IFNAMSIZ },
+    { "recheck-kernel", o_bool, &recheck_kernel,
+      "Probe kernel features again rather than using cached results",
+      OPT_PRIO | 1 },
 #endif
 
     { "dump", o_bool, &dump_options,
       "Print out option values after parsing all options", 1 },
     { "dryrun", o_bool, &dryrun,
       "Stop after parsing, printing, and checking options", 1 },
+    { "startup-profile", o_bool, &startup_profile,
+      "Log the time taken by each stage of starting up", 1 },
+
+    { "cpu-accounting", o_bool, &cpu_accounting,
+      "Measure the CPU time used by each protocol and callback", 1 },
+    { "cpu-accounting-log", o_bool, &cpu_accounting_log,
+      "Log CPU usage at disconnect", OPT_A2COPY | 1, &cpu_accounting },
+    { "cpu-accounting-interval", o_int, &cpu_accounting_interval,
+      "Seconds between CPU usage updates",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 1 },
+
+#ifdef PPP_WITH_TDB
+    { "db-gc-interval", o_int, &db_gc_interval,
+      "Seconds between removals of stale database records",
+      OPT_PRIO | OPT_PRIV | OPT_LLIMIT, NULL, 0, 0 },
+    { "negotiation-cache", o_bool, &negotiation_cache,
+      "Start negotiation from the options the peer agreed to last time",
+      OPT_PRIO | 1 },
+#endif
 
     { "child-timeout", o_int, &child_wait,
       "Number of seconds to wait for child processes at exit",
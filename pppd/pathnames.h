@@ -118,6 +118,7 @@
 #endif
 
 #define PPP_PATH_PPPDB          PPP_PATH_VARRUN  "/pppd2.tdb"
+#define PPP_PATH_KFEATURES      PPP_PATH_VARRUN  "/pppd-kernel.features"
 
 #ifdef __linux__
 #define PPP_PATH_LOCKDIR        "/var/lock"
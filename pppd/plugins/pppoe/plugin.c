@@ -100,6 +100,17 @@ static struct option Options[] = {
       "Initial timeout for discovery packets in seconds" },
     { "pppoe-padi-attempts", o_int, &pppoe_padi_attempts,
       "Number of discovery attempts" },
+    { "pppoe-server", o_bool, &pppoe_server,
+      "Act as a PPPoE access concentrator", 1 },
+    { "pppoe-listen", o_special, (void *) pppoe_add_listen,
+      "Also accept PPPoE sessions on this interface", OPT_A2LIST },
+    { "pppoe-max-sessions", o_int, &pppoe_max_sessions,
+      "Most PPPoE sessions to serve at once",
+      OPT_LLIMIT, NULL, 0, 1 },
+    { "pppoe-mac-sessions", o_int, &pppoe_mac_sessions,
+      "Most PPPoE sessions to serve for one host" },
+    { "pppoe-mac-rate", o_int, &pppoe_mac_rate,
+      "Most PPPoE discovery packets per second from one host" },
     { NULL }
 };
 int (*OldDevnameHook)(char *cmd, char **argv, int doit) = NULL;
@@ -145,6 +156,10 @@ PPPOEConnectDevice(void)
     int s;
     char remote_number[MAXNAMELEN];
 
+    /* As an access concentrator, the session socket is made for us */
+    if (pppoe_server)
+	goto skip_socket;
+
     /* Open session socket before discovery phase, to avoid losing session */
     /* packets sent by peer just after PADS packet (noted on some Cisco    */
     /* server equipment).                                                  */
@@ -156,6 +171,7 @@ PPPOEConnectDevice(void)
 	return -1;
     }
 
+ skip_socket:
     /* Restore configuration */
     lcp_allowoptions[0].mru = conn->mtu = conn->storedmtu;
     lcp_wantoptions[0].mru = conn->mru = conn->storedmru;
@@ -179,7 +195,9 @@ PPPOEConnectDevice(void)
     if (lcp_wantoptions[0].mru > ifr.ifr_mtu - TOTAL_OVERHEAD)
 	lcp_wantoptions[0].mru = conn->mru = ifr.ifr_mtu - TOTAL_OVERHEAD;
 
-    if (pppoe_host_uniq) {
+    if (pppoe_server) {
+	/* the client's Host-Uniq is echoed, we don't send our own */
+    } else if (pppoe_host_uniq) {
 	if (!parseHostUniq(pppoe_host_uniq, &conn->hostUniq))
 	    fatal("Illegal value for pppoe-host-uniq option");
     } else {
@@ -193,7 +211,10 @@ PPPOEConnectDevice(void)
     conn->acName = acName;
     conn->serviceName = pppd_pppoe_service;
     ppp_set_pppdevnam(devnam);
-    if (existingSession) {
+    if (pppoe_server) {
+	if (pppoe_ac_listen(conn) < 0)
+	    return -1;
+    } else if (existingSession) {
 	unsigned int mac[ETH_ALEN];
 	int i, ses;
 	if (sscanf(existingSession, "%d:%x:%x:%x:%x:%x:%x",
@@ -254,7 +275,7 @@ PPPOEConnectDevice(void)
     if (conn->actualACname)
 	ppp_script_setenv("ACNAME", conn->actualACname, 0);
 
-    if (connect(conn->sessionSocket, (struct sockaddr *) &sp,
+    if (!pppoe_server && connect(conn->sessionSocket, (struct sockaddr *) &sp,
 		sizeof(struct sockaddr_pppox)) < 0) {
 	error("Failed to connect PPPoE socket: %d %m", errno);
 	goto errout;
@@ -444,6 +465,18 @@ void pppoe_check_options(void)
 	conn->req_peer = 1;
     }
 
+    if (pppoe_server) {
+	if (existingSession) {
+	    ppp_option_error("pppoe-sess can't be used with pppoe-server");
+	    exit(EXIT_OPTION_ERROR);
+	}
+	if (ppp_persist()) {
+	    /* each session gets a new pppd; this one only listens */
+	    ppp_option_error("persist can't be used with pppoe-server");
+	    exit(EXIT_OPTION_ERROR);
+	}
+    }
+
     lcp_allowoptions[0].neg_accompression = 0;
     lcp_wantoptions[0].neg_accompression = 0;
 
@@ -277,6 +277,14 @@ unsigned char *findTag(PPPoEPacket *packet, UINT16_t tagType,
 		       PPPoETag *tag);
 
 extern int pppoe_verbose;
+
+/* Access concentrator mode (server.c) */
+extern bool pppoe_server;
+extern int pppoe_max_sessions;
+extern int pppoe_mac_sessions;
+extern int pppoe_mac_rate;
+int pppoe_add_listen(char **argv);
+int pppoe_ac_listen(PPPoEConnection *conn);
 void pppoe_printpkt(PPPoEPacket *packet,
 		    void (*printer)(void *, char *, ...), void *arg);
 void pppoe_log_packet(const char *prefix, PPPoEPacket *packet);
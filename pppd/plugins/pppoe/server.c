@@ -0,0 +1,615 @@
+/***********************************************************************
+*
+* server.c
+*
+* Access concentrator side of PPPoE discovery, for the pppoe-server
+* option.
+*
+* Copyright (C) 2001 by Roaring Penguin Software Inc., Michal Ostrowski
+* and Jamal Hadi Salim.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version
+* 2 of the License, or (at your option) any later version.
+*
+* With pppoe-server, pppd answers PADIs and PADRs on its interface (and
+* any given with pppoe-listen) instead of sending them.  For each PADR
+* it accepts, it allocates a session ID, connects a PPPoX session
+* socket for it, sends the PADS and forks; the child carries on as an
+* ordinary pppd for that session, while the parent goes back to
+* listening.  So there is no separate pppoe-server program, and each
+* session uses the kernel PPPoE driver from its first frame.
+*
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE 1
+#include "pppoe.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <linux/if_pppox.h>
+
+#include <pppd/pppd.h>
+#include <pppd/options.h>
+#include <pppd/magic.h>
+#include <pppd/crypto.h>
+
+#define signaled(x) ppp_signaled(x)
+#define get_time(x) ppp_get_time(x)
+
+bool pppoe_server = 0;		/* act as an access concentrator */
+int pppoe_max_sessions = 1024;	/* most sessions at once */
+int pppoe_mac_sessions = 0;	/* most sessions per MAC; 0 => no limit */
+int pppoe_mac_rate = 0;		/* discovery pkts/sec per MAC; 0 => no limit */
+
+#define AC_MAX_IFACES	16
+#define AC_RATE_SLOTS	256	/* MAC addresses tracked for pppoe-mac-rate */
+#define AC_COOKIE_LEN	16
+#define AC_STATS_SECS	300	/* how often to log the counters */
+
+struct ac_iface {
+    char name[IFNAMSIZ];
+    int sock;
+    unsigned char mac[ETH_ALEN];
+};
+
+struct ac_session {
+    pid_t pid;
+    UINT16_t sid;		/* network byte order */
+    unsigned char mac[ETH_ALEN];
+};
+
+struct ac_rate {
+    unsigned char mac[ETH_ALEN];
+    time_t second;
+    int count;
+};
+
+/* What we need from the tags in a PADI or PADR */
+struct ac_request {
+    int seenServiceName;
+    int serviceNameOK;
+    PPPoETag serviceName;
+    PPPoETag hostUniq;
+    PPPoETag relayId;
+    PPPoETag cookie;
+};
+
+static char *listen_ifs[AC_MAX_IFACES];
+static int n_listen_ifs;
+
+static struct ac_iface ifaces[AC_MAX_IFACES];
+static int n_ifaces;
+static struct ac_session *sessions;
+static int n_sessions;
+static struct ac_rate rates[AC_RATE_SLOTS];
+static unsigned char cookie_secret[16];
+static UINT16_t next_sid = 1;
+static char ac_name[MAXNAMELEN];
+static char *ac_service;	/* service we offer; NULL => any */
+
+static struct {
+    unsigned long padi, pado, padr, pads, rejected, limited;
+} stats;
+
+/**********************************************************************
+*%FUNCTION: pppoe_add_listen
+*%ARGUMENTS:
+* argv -- the interface name
+*%RETURNS:
+* 1 if OK, 0 if there are too many interfaces
+*%DESCRIPTION:
+* Handles the pppoe-listen option.
+***********************************************************************/
+int
+pppoe_add_listen(char **argv)
+{
+    if (n_listen_ifs >= AC_MAX_IFACES - 1) {
+	ppp_option_error("too many pppoe-listen interfaces");
+	return 0;
+    }
+    listen_ifs[n_listen_ifs++] = strdup(*argv);
+    return 1;
+}
+
+/* Compute the AC-Cookie for a peer, so we don't have to remember PADIs */
+static void
+make_cookie(unsigned char *mac, unsigned char *cookie)
+{
+    PPP_MD_CTX *ctx;
+    unsigned int len = AC_COOKIE_LEN;
+
+    memset(cookie, 0, AC_COOKIE_LEN);
+    ctx = PPP_MD_CTX_new();
+    if (ctx) {
+	if (PPP_DigestInit(ctx, PPP_md5())) {
+	    PPP_DigestUpdate(ctx, cookie_secret, sizeof(cookie_secret));
+	    PPP_DigestUpdate(ctx, mac, ETH_ALEN);
+	    PPP_DigestFinal(ctx, cookie, &len);
+	}
+	PPP_MD_CTX_free(ctx);
+    }
+}
+
+static void
+parseRequestTags(UINT16_t type, UINT16_t len, unsigned char *data,
+		 void *extra)
+{
+    struct ac_request *req = (struct ac_request *) extra;
+    PPPoETag *tag = NULL;
+
+    switch (type) {
+    case TAG_SERVICE_NAME:
+	req->seenServiceName = 1;
+	/* An empty Service-Name means any service will do */
+	if (len == 0 || ac_service == NULL
+	    || (len == strlen(ac_service)
+		&& !memcmp(data, ac_service, len)))
+	    req->serviceNameOK = 1;
+	tag = &req->serviceName;
+	break;
+    case TAG_HOST_UNIQ:
+	tag = &req->hostUniq;
+	break;
+    case TAG_RELAY_SESSION_ID:
+	tag = &req->relayId;
+	break;
+    case TAG_AC_COOKIE:
+	tag = &req->cookie;
+	break;
+    }
+    if (tag != NULL && len <= sizeof(tag->payload)) {
+	tag->type = htons(type);
+	tag->length = htons(len);
+	memcpy(tag->payload, data, len);
+    }
+}
+
+/* Append a tag to a packet being built; returns 0 if there's no room */
+static int
+add_tag(PPPoEPacket *packet, unsigned char **cursor, UINT16_t type,
+	const void *data, int len)
+{
+    unsigned char *p = *cursor;
+
+    if ((p - packet->payload) + TAG_HDR_SIZE + len > MAX_PPPOE_PAYLOAD) {
+	error("Would create too-long packet");
+	return 0;
+    }
+    p[0] = type >> 8;
+    p[1] = type;
+    p[2] = len >> 8;
+    p[3] = len;
+    memcpy(p + TAG_HDR_SIZE, data, len);
+    *cursor = p + TAG_HDR_SIZE + len;
+    return 1;
+}
+
+/* Copy a tag we received into a reply, if it was there */
+static int
+echo_tag(PPPoEPacket *packet, unsigned char **cursor, PPPoETag *tag)
+{
+    if (!tag->type)
+	return 1;
+    return add_tag(packet, cursor, ntohs(tag->type), tag->payload,
+		   ntohs(tag->length));
+}
+
+/**********************************************************************
+*%FUNCTION: sendReply
+*%ARGUMENTS:
+* ifc -- interface to send on
+* req -- the PADI or PADR being answered
+* peer -- its source address
+* code -- CODE_PADO or CODE_PADS
+* sid -- session ID for a PADS (0 for an error)
+* errtag -- if non-zero, an error tag to include
+* msg -- message for the error tag
+*%RETURNS:
+* Nothing
+*%DESCRIPTION:
+* Sends a PADO or PADS packet
+***********************************************************************/
+static void
+sendReply(struct ac_iface *ifc, struct ac_request *req, unsigned char *peer,
+	  int code, UINT16_t sid, UINT16_t errtag, char const *msg)
+{
+    PPPoEPacket packet;
+    unsigned char *cursor = packet.payload;
+    unsigned char cookie[AC_COOKIE_LEN];
+    char const *svc;
+
+    memcpy(packet.ethHdr.h_dest, peer, ETH_ALEN);
+    memcpy(packet.ethHdr.h_source, ifc->mac, ETH_ALEN);
+    packet.ethHdr.h_proto = htons(Eth_PPPOE_Discovery);
+    packet.vertype = PPPOE_VER_TYPE(1, 1);
+    packet.code = code;
+    packet.session = sid;
+
+    if (code == CODE_PADO
+	&& !add_tag(&packet, &cursor, TAG_AC_NAME, ac_name, strlen(ac_name)))
+	return;
+
+    /* Echo the Service-Name asked for, or name the one we offer */
+    if (req->serviceName.type && ntohs(req->serviceName.length) > 0) {
+	if (!echo_tag(&packet, &cursor, &req->serviceName))
+	    return;
+    } else {
+	svc = ac_service? ac_service: "";
+	if (!add_tag(&packet, &cursor, TAG_SERVICE_NAME, svc, strlen(svc)))
+	    return;
+    }
+
+    if (code == CODE_PADO) {
+	make_cookie(peer, cookie);
+	if (!add_tag(&packet, &cursor, TAG_AC_COOKIE, cookie, sizeof(cookie)))
+	    return;
+    }
+    if (errtag && !add_tag(&packet, &cursor, errtag, msg, strlen(msg)))
+	return;
+    if (!echo_tag(&packet, &cursor, &req->hostUniq)
+	|| !echo_tag(&packet, &cursor, &req->relayId))
+	return;
+
+    packet.length = htons(cursor - packet.payload);
+    sendPacket(NULL, ifc->sock, &packet,
+	       (int) (cursor - packet.payload + HDR_SIZE));
+}
+
+/* Has this MAC address sent more discovery packets than we allow? */
+static int
+rate_limited(unsigned char *mac)
+{
+    struct timeval now;
+    struct ac_rate *r;
+    unsigned int h;
+    int i;
+
+    if (pppoe_mac_rate <= 0)
+	return 0;
+    get_time(&now);
+    for (h = i = 0; i < ETH_ALEN; ++i)
+	h = h * 31 + mac[i];
+    r = &rates[h % AC_RATE_SLOTS];
+    if (memcmp(r->mac, mac, ETH_ALEN) != 0 || r->second != now.tv_sec) {
+	memcpy(r->mac, mac, ETH_ALEN);
+	r->second = now.tv_sec;
+	r->count = 0;
+    }
+    return ++r->count > pppoe_mac_rate;
+}
+
+static int
+sessions_for_mac(unsigned char *mac)
+{
+    int i, n = 0;
+
+    for (i = 0; i < n_sessions; ++i)
+	if (!memcmp(sessions[i].mac, mac, ETH_ALEN))
+	    ++n;
+    return n;
+}
+
+static int
+sid_in_use(UINT16_t sid)
+{
+    int i;
+
+    for (i = 0; i < n_sessions; ++i)
+	if (sessions[i].sid == sid)
+	    return 1;
+    return 0;
+}
+
+/* Forget the sessions whose pppd has exited */
+static void
+reap_sessions(void)
+{
+    pid_t pid;
+    int i, status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+	for (i = 0; i < n_sessions; ++i) {
+	    if (sessions[i].pid == pid) {
+		dbglog("PPPoE session %d ended (pid %d)",
+		       ntohs(sessions[i].sid), pid);
+		sessions[i] = sessions[--n_sessions];
+		break;
+	    }
+	}
+    }
+}
+
+static void
+log_stats(void)
+{
+    info("PPPoE AC: %d sessions; %lu PADI, %lu PADO, %lu PADR, %lu PADS, "
+	 "%lu rejected, %lu rate-limited", n_sessions, stats.padi, stats.pado,
+	 stats.padr, stats.pads, stats.rejected, stats.limited);
+}
+
+/**********************************************************************
+*%FUNCTION: startSession
+*%ARGUMENTS:
+* conn -- PPPoE connection, filled in for the child
+* ifc -- interface the PADR came in on
+* req -- the PADR
+* peer -- its source address
+*%RETURNS:
+* 1 in the child process, which goes on to run the session; 0 in the
+* parent
+*%DESCRIPTION:
+* Accepts a PADR: connects a session socket, sends the PADS and forks
+***********************************************************************/
+static int
+startSession(PPPoEConnection *conn, struct ac_iface *ifc,
+	     struct ac_request *req, unsigned char *peer)
+{
+    struct sockaddr_pppox sp;
+    UINT16_t sid;
+    pid_t pid;
+    int s, i, tries;
+
+    if (n_sessions >= pppoe_max_sessions) {
+	sendReply(ifc, req, peer, CODE_PADS, 0, TAG_AC_SYSTEM_ERROR,
+		  "Too many sessions");
+	++stats.rejected;
+	return 0;
+    }
+
+    for (tries = 0; tries < 0xFFFF; ++tries) {
+	sid = htons(next_sid);
+	if (++next_sid == 0xFFFF)
+	    next_sid = 1;
+	if (!sid_in_use(sid))
+	    break;
+    }
+
+    s = socket(AF_PPPOX, SOCK_STREAM, PX_PROTO_OE);
+    if (s < 0) {
+	error("Failed to create PPPoE socket: %m");
+	return 0;
+    }
+    sp.sa_family = AF_PPPOX;
+    sp.sa_protocol = PX_PROTO_OE;
+    sp.sa_addr.pppoe.sid = sid;
+    memcpy(sp.sa_addr.pppoe.dev, ifc->name, IFNAMSIZ);
+    memcpy(sp.sa_addr.pppoe.remote, peer, ETH_ALEN);
+    if (connect(s, (struct sockaddr *) &sp, sizeof(sp)) < 0) {
+	error("Failed to connect PPPoE socket: %m");
+	close(s);
+	sendReply(ifc, req, peer, CODE_PADS, 0, TAG_AC_SYSTEM_ERROR,
+		  "Can't create session");
+	++stats.rejected;
+	return 0;
+    }
+
+    sendReply(ifc, req, peer, CODE_PADS, sid, 0, NULL);
+    ++stats.pads;
+
+    pid = fork();
+    if (pid < 0) {
+	error("Failed to fork for PPPoE session: %m");
+	close(s);
+	return 0;
+    }
+    if (pid > 0) {
+	close(s);
+	sessions[n_sessions].pid = pid;
+	sessions[n_sessions].sid = sid;
+	memcpy(sessions[n_sessions].mac, peer, ETH_ALEN);
+	++n_sessions;
+	info("PPPoE session %d for %02x:%02x:%02x:%02x:%02x:%02x on %s "
+	     "(pid %d)", ntohs(sid), peer[0], peer[1], peer[2], peer[3],
+	     peer[4], peer[5], ifc->name, pid);
+	return 0;
+    }
+
+    /* In the child: this pppd runs the session */
+    ppp_reseed();
+    ppp_forget_pidfiles();
+    for (i = 0; i < n_ifaces; ++i)
+	close(ifaces[i].sock);
+    free(sessions);
+    sessions = NULL;
+    n_sessions = 0;
+
+    if (conn->sessionSocket >= 0)
+	close(conn->sessionSocket);
+    conn->sessionSocket = s;
+    conn->discoverySocket = -1;
+    conn->ifName = strdup(ifc->name);
+    memcpy(conn->myEth, ifc->mac, ETH_ALEN);
+    memcpy(conn->peerEth, peer, ETH_ALEN);
+    conn->session = sid;
+    conn->hostUniq.length = 0;
+    conn->cookie.type = 0;
+    conn->relayId = req->relayId;
+    conn->discoveryState = STATE_SESSION;
+    return 1;
+}
+
+/* Deal with one discovery packet; returns 1 in a new session's child */
+static int
+handlePacket(PPPoEConnection *conn, struct ac_iface *ifc)
+{
+    PPPoEPacket packet;
+    struct ac_request req;
+    unsigned char cookie[AC_COOKIE_LEN];
+    unsigned char *peer = packet.ethHdr.h_source;
+    int len;
+
+    if (receivePacket(ifc->sock, &packet, &len) < 0)
+	return 0;
+    if (len < HDR_SIZE || ntohs(packet.length) + HDR_SIZE > len) {
+	error("Bogus PPPoE length field (%u)",
+	      (unsigned int) ntohs(packet.length));
+	return 0;
+    }
+    if (packet.code != CODE_PADI && packet.code != CODE_PADR)
+	return 0;
+    if (NOT_UNICAST(peer))
+	return 0;
+    if (packet.code == CODE_PADR
+	&& memcmp(packet.ethHdr.h_dest, ifc->mac, ETH_ALEN) != 0)
+	return 0;
+    if (rate_limited(peer)) {
+	++stats.limited;
+	return 0;
+    }
+
+    memset(&req, 0, sizeof(req));
+    if (parsePacket(&packet, parseRequestTags, &req) < 0)
+	return 0;
+
+    if (packet.code == CODE_PADI) {
+	++stats.padi;
+	/* Don't offer a service we don't provide */
+	if (!req.seenServiceName || !req.serviceNameOK)
+	    return 0;
+	/* nor one we'd have to refuse at the PADR */
+	if (n_sessions >= pppoe_max_sessions
+	    || (pppoe_mac_sessions > 0
+		&& sessions_for_mac(peer) >= pppoe_mac_sessions)) {
+	    ++stats.rejected;
+	    return 0;
+	}
+	sendReply(ifc, &req, peer, CODE_PADO, 0, 0, NULL);
+	++stats.pado;
+	return 0;
+    }
+
+    ++stats.padr;
+    make_cookie(peer, cookie);
+    if (ntohs(req.cookie.length) != AC_COOKIE_LEN
+	|| memcmp(req.cookie.payload, cookie, AC_COOKIE_LEN) != 0) {
+	/* not from a PADO of ours, or from another host */
+	++stats.rejected;
+	return 0;
+    }
+    if (!req.seenServiceName || !req.serviceNameOK) {
+	sendReply(ifc, &req, peer, CODE_PADS, 0, TAG_SERVICE_NAME_ERROR,
+		  "Service not offered");
+	++stats.rejected;
+	return 0;
+    }
+    if (pppoe_mac_sessions > 0
+	&& sessions_for_mac(peer) >= pppoe_mac_sessions) {
+	sendReply(ifc, &req, peer, CODE_PADS, 0, TAG_AC_SYSTEM_ERROR,
+		  "Too many sessions for this host");
+	++stats.rejected;
+	return 0;
+    }
+    return startSession(conn, ifc, &req, peer);
+}
+
+/**********************************************************************
+*%FUNCTION: pppoe_ac_listen
+*%ARGUMENTS:
+* conn -- PPPoE connection
+*%RETURNS:
+* 0 in a child process once a session has been set up, with conn
+* filled in for it; -1 in the original process if something goes wrong
+* or we get SIGTERM, SIGINT or SIGHUP.
+*%DESCRIPTION:
+* Acts as a PPPoE access concentrator.  pppd's main loop isn't running
+* while we listen, so we run its timeouts ourselves.
+***********************************************************************/
+int
+pppoe_ac_listen(PPPoEConnection *conn)
+{
+    struct timeval tv, last_stats, now;
+    fd_set readable;
+    int i, r, maxfd, ms;
+
+    if (ac_name[0] == 0) {
+	if (conn->acName)
+	    strlcpy(ac_name, conn->acName, sizeof(ac_name));
+	else if (gethostname(ac_name, sizeof(ac_name)) < 0)
+	    strlcpy(ac_name, "pppd", sizeof(ac_name));
+    }
+    ac_service = conn->serviceName;
+    for (i = 0; i < sizeof(cookie_secret); i += sizeof(u_int32_t)) {
+	u_int32_t m = magic();
+	memcpy(cookie_secret + i, &m, sizeof(m));
+    }
+
+    sessions = malloc(pppoe_max_sessions * sizeof(struct ac_session));
+    if (sessions == NULL)
+	novm("PPPoE session table");
+
+    /* The device interface, then any others we were given */
+    listen_ifs[n_listen_ifs] = conn->ifName;
+    for (i = n_listen_ifs; i >= 0; --i) {
+	strlcpy(ifaces[n_ifaces].name, listen_ifs[i], IFNAMSIZ);
+	ifaces[n_ifaces].sock = openInterface(listen_ifs[i], Eth_PPPOE_Discovery,
+					      ifaces[n_ifaces].mac);
+	if (ifaces[n_ifaces].sock < 0) {
+	    error("Failed to create PPPoE discovery socket on %s: %m",
+		  listen_ifs[i]);
+	    continue;
+	}
+	++n_ifaces;
+    }
+    if (n_ifaces == 0)
+	return -1;
+    info("PPPoE access concentrator %s listening on %d interface(s)",
+	 ac_name, n_ifaces);
+
+    get_time(&last_stats);
+    for (;;) {
+	reap_sessions();
+	get_time(&now);
+	if (now.tv_sec - last_stats.tv_sec >= AC_STATS_SECS) {
+	    log_stats();
+	    last_stats = now;
+	}
+
+	FD_ZERO(&readable);
+	maxfd = 0;
+	for (i = 0; i < n_ifaces; ++i) {
+	    FD_SET(ifaces[i].sock, &readable);
+	    if (ifaces[i].sock > maxfd)
+		maxfd = ifaces[i].sock;
+	}
+	/* wake up at least once a second to reap sessions */
+	ms = ppp_advance_time();
+	if (ms < 0 || ms > 1000)
+	    ms = 1000;
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	r = select(maxfd + 1, &readable, NULL, NULL, &tv);
+	if (signaled(SIGTERM) || signaled(SIGINT) || signaled(SIGHUP))
+	    break;
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    error("select (pppoe_ac_listen): %m");
+	    break;
+	}
+	for (i = 0; i < n_ifaces && r > 0; ++i) {
+	    if (!FD_ISSET(ifaces[i].sock, &readable))
+		continue;
+	    if (handlePacket(conn, &ifaces[i]))
+		return 0;
+	}
+    }
+
+    log_stats();
+    for (i = 0; i < n_ifaces; ++i)
+	close(ifaces[i].sock);
+    n_ifaces = 0;
+    return -1;
+}
@@ -68,8 +68,10 @@
 const char pppd_version[] = PPPD_VERSION;
 
 static int setdevname_pppol2tp(char **argv);
+static int setbridge_pppol2tp(char **argv);
 
 static int pppol2tp_fd = -1;
+static int pppol2tp_bridge_fd = -1;
 static char *pppol2tp_fd_str;
 static bool pppol2tp_lns_mode = 0;
 static bool pppol2tp_recv_seq = 0;
@@ -123,6 +125,9 @@ static struct option pppol2tp_options[] = {
 	{ "pppol2tp_session_id", o_int, &pppol2tp_session_id,
 	  "PPPoL2TP session_id.",
 	  OPT_PRIO },
+	{ "pppol2tp_bridge", o_special, &setbridge_pppol2tp,
+	  "FD for PPPoL2TP socket to bridge the session to (LAC mode)",
+	  OPT_PRIO | OPT_PRIV },
 	{ NULL }
 };
 
@@ -188,6 +193,35 @@ static int setdevname_pppol2tp(char **argv)
 	return 1;
 }
 
+/*
+ * In LAC mode, pppd runs on another channel (PPPoE, say) and, once
+ * the peer has authenticated, the kernel bridges that channel to the
+ * PPPoL2TP session given here.
+ */
+static int bridge_pppol2tp(void)
+{
+	return pppol2tp_bridge_fd;
+}
+
+static int setbridge_pppol2tp(char **argv)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+	int fd;
+
+	if (!ppp_int_option(*argv, &fd))
+		return 0;
+	if (getsockname(fd, (struct sockaddr *)&ss, &len) < 0
+	    || ss.ss_family != AF_PPPOX) {
+		ppp_option_error("pppol2tp_bridge: FD %d is not a PPPoX socket",
+				 fd);
+		return 0;
+	}
+	pppol2tp_bridge_fd = fd;
+	bridge_hook = bridge_pppol2tp;
+	return 1;
+}
+
 static int connect_pppol2tp(void)
 {
 	if(pppol2tp_fd == -1) {
@@ -18,6 +18,26 @@
 static void rc_extract_vendor_specific_attributes(int attrlen,
 						  unsigned char *ptr,
 						  VALUE_PAIR **vp);
+
+/*
+ * A/v pairs are made and freed for every request, so they come from a
+ * pool rather than straight from malloc.
+ */
+static struct ppp_pool *vp_pool;
+
+static VALUE_PAIR *rc_avpair_alloc(void)
+{
+	if (vp_pool == NULL)
+		vp_pool = ppp_pool_create("radius-avpair", sizeof(VALUE_PAIR));
+	if (vp_pool == NULL)
+		return NULL;
+	return ppp_pool_alloc(vp_pool);
+}
+
+static void rc_avpair_release(VALUE_PAIR *vp)
+{
+	ppp_pool_free(vp_pool, vp);
+}
 /*
  * Function: rc_avpair_add
  *
@@ -116,7 +136,7 @@ VALUE_PAIR *rc_avpair_new (int attrid, const void *pval, int len, int vendorcode
 	}
 	else
 	{
-		if ((vp = (VALUE_PAIR *) malloc (sizeof (VALUE_PAIR)))
+		if ((vp = rc_avpair_alloc ())
 							!= (VALUE_PAIR *) NULL)
 		{
 			strlcpy (vp->name, pda->name, NAME_LENGTH);
@@ -128,7 +148,7 @@ VALUE_PAIR *rc_avpair_new (int attrid, const void *pval, int len, int vendorcode
 			{
 				return vp;
 			}
-			free (vp);
+			rc_avpair_release (vp);
 			vp = (VALUE_PAIR *) NULL;
 		}
 		else
@@ -203,7 +223,7 @@ VALUE_PAIR *rc_avpair_gen (AUTH_HDR *auth)
 		else
 		{
 			if ((pair =
-				(VALUE_PAIR *) malloc (sizeof (VALUE_PAIR))) ==
+				rc_avpair_alloc ()) ==
 					(VALUE_PAIR *) NULL)
 			{
 				novm("rc_avpair_gen");
@@ -239,7 +259,7 @@ VALUE_PAIR *rc_avpair_gen (AUTH_HDR *auth)
 
 			    default:
 				warn("rc_avpair_gen: %s has unknown type", attr->name);
-				free (pair);
+				rc_avpair_release (pair);
 				break;
 			}
 
@@ -306,7 +326,7 @@ static void rc_extract_vendor_specific_attributes(int attrlen,
 	}
 
 	/* TODO: Check that length matches data size!!!!! */
-	pair = (VALUE_PAIR *) malloc(sizeof(VALUE_PAIR));
+	pair = rc_avpair_alloc();
 	if (!pair) {
 	    novm("rc_avpair_gen");
 	    return;
@@ -334,7 +354,7 @@ static void rc_extract_vendor_specific_attributes(int attrlen,
 
 	default:
 	    warn("rc_avpair_gen: %s has unknown type", attr->name);
-	    free (pair);
+	    rc_avpair_release (pair);
 	    break;
 	}
     }
@@ -370,7 +390,7 @@ VALUE_PAIR *rc_avpair_copy(VALUE_PAIR *p)
 	VALUE_PAIR *vp, *fp = NULL, *lp = NULL;
 
 	while (p) {
-		vp = malloc(sizeof(VALUE_PAIR));
+		vp = rc_avpair_alloc();
 		if (!vp) {
 		    novm("rc_avpair_copy");
 		    return NULL; /* leaks a little but so what */
@@ -460,7 +480,7 @@ void rc_avpair_free (VALUE_PAIR *pair)
 	while (pair != (VALUE_PAIR *) NULL)
 	{
 		next = pair->next;
-		free (pair);
+		rc_avpair_release (pair);
 		pair = next;
 	}
 }
@@ -579,7 +599,7 @@ int rc_avpair_parse (char *buffer, VALUE_PAIR **first_pair)
 			rc_fieldcpy (valstr, &buffer);
 
 			if ((pair =
-				(VALUE_PAIR *) malloc (sizeof (VALUE_PAIR)))
+				rc_avpair_alloc ())
 							== (VALUE_PAIR *) NULL)
 			{
 				novm("rc_avpair_parse");
@@ -617,7 +637,7 @@ int rc_avpair_parse (char *buffer, VALUE_PAIR **first_pair)
 							rc_avpair_free(*first_pair);
 							*first_pair = (VALUE_PAIR *) NULL;
 						}
-						free (pair);
+						rc_avpair_release (pair);
 						return (-1);
 					}
 					else
@@ -651,7 +671,7 @@ int rc_avpair_parse (char *buffer, VALUE_PAIR **first_pair)
 					rc_avpair_free(*first_pair);
 					*first_pair = (VALUE_PAIR *) NULL;
 				}
-				free (pair);
+				rc_avpair_release (pair);
 				return (-1);
 			}
 			pair->next = (VALUE_PAIR *) NULL;
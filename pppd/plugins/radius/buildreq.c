@@ -215,7 +215,7 @@ int rc_auth_using_server(SERVER *authserver,
 
 	result = ERROR_RC;
 	for(i=0; (i<authserver->max) && (result != OK_RC) && (result != BADRESP_RC)
-		; i++)
+		&& (result != CHALLENGE_RC); i++)
 	{
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
@@ -259,7 +259,7 @@ int rc_auth_proxy(VALUE_PAIR *send, VALUE_PAIR **received, char *msg)
 
 	result = ERROR_RC;
 	for(i=0; (i<authserver->max) && (result != OK_RC) && (result != BADRESP_RC)
-		; i++)
+		&& (result != CHALLENGE_RC); i++)
 	{
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
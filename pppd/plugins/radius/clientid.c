@@ -17,7 +17,22 @@ struct map2id_s {
 	struct map2id_s *next;
 };
 
-static struct map2id_s *map2id_list = NULL;
+/*
+ * The map is kept in a hash table, since it is consulted for every
+ * session whose interface isn't called pppN.
+ */
+#define MAP2ID_HASH_SIZE	256
+
+static struct map2id_s *map2id_hash[MAP2ID_HASH_SIZE];
+
+static unsigned int map2id_hashfn(const char *name)
+{
+	unsigned int h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (unsigned char) *name++) * 16777619U;
+	return h % MAP2ID_HASH_SIZE;
+}
 
 /*
  * Function: rc_read_mapfile
@@ -35,6 +50,7 @@ int rc_read_mapfile(char *filename)
 	FILE *mapfd;
 	char *c, *name, *id, *q;
 	struct map2id_s *p;
+	unsigned int h;
 	int lnr = 0;
 
 	if ((mapfd = fopen(filename,"r")) == NULL)
@@ -76,8 +92,9 @@ int rc_read_mapfile(char *filename)
 				return (-1);
 			}
 			p->id = atoi(id);
-			p->next = map2id_list;
-			map2id_list = p;
+			h = map2id_hashfn(p->name);
+			p->next = map2id_hash[h];
+			map2id_hash[h] = p;
 
 		} else {
 
@@ -96,16 +113,16 @@ int rc_read_mapfile(char *filename)
 }
 
 /*
- * Function: rc_map2id
+ * Function: rc_find_map2id
  *
- * Purpose: Map ttyname to port id
+ * Purpose: Look up the port id for a ttyname in the map
  *
- * Arguments: full pathname of the tty
+ * Arguments: full pathname of the tty, pointer for the port id
  *
- * Returns: port id, zero if no entry found
+ * Returns: 1 if found, 0 if there is no entry
  */
 
-UINT4 rc_map2id(const char *name)
+int rc_find_map2id(const char *name, UINT4 *id)
 {
 	struct map2id_s *p;
 	char ttyname[PATH_MAX];
@@ -116,10 +133,33 @@ UINT4 rc_map2id(const char *name)
 
 	strncat(ttyname, name, sizeof(ttyname) - strlen(ttyname) -1);
 
-	for(p = map2id_list; p; p = p->next)
-		if (!strcmp(ttyname, p->name)) return p->id;
+	for (p = map2id_hash[map2id_hashfn(ttyname)]; p; p = p->next)
+		if (!strcmp(ttyname, p->name)) {
+			*id = p->id;
+			return 1;
+		}
+
+	return 0;
+}
+
+/*
+ * Function: rc_map2id
+ *
+ * Purpose: Map ttyname to port id
+ *
+ * Arguments: full pathname of the tty
+ *
+ * Returns: port id, zero if no entry found
+ */
+
+UINT4 rc_map2id(const char *name)
+{
+	UINT4 id;
+
+	if (rc_find_map2id(name, &id))
+		return id;
 
-	warn("rc_map2id: can't find tty %s in map database", ttyname);
+	warn("rc_map2id: can't find tty %s in map database", name);
 
 	return 0;
 }
@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <string.h>
 
 #include <pppd/crypto.h>
 
@@ -25,3 +26,55 @@ int rc_md5_calc(unsigned char *out, const unsigned char *in, unsigned int inl)
     }
     return retval;
 }
+
+/*
+ * HMAC-MD5 (RFC 2104), as used for the Message-Authenticator attribute.
+ */
+int rc_hmac_md5(unsigned char *out, const unsigned char *in, unsigned int inl,
+		const unsigned char *key, unsigned int keyl)
+{
+    unsigned char k_pad[64], inner[MD5_DIGEST_LENGTH], tk[MD5_DIGEST_LENGTH];
+    unsigned int outl = MD5_DIGEST_LENGTH;
+    PPP_MD_CTX *ctx;
+    int retval = 0;
+    int i;
+
+    if (keyl > sizeof(k_pad)) {
+        if (!rc_md5_calc(tk, key, keyl))
+            return 0;
+        key = tk;
+        keyl = sizeof(tk);
+    }
+
+    ctx = PPP_MD_CTX_new();
+    if (ctx) {
+
+        /* inner hash */
+        memset(k_pad, 0, sizeof(k_pad));
+        memcpy(k_pad, key, keyl);
+        for (i = 0; i < sizeof(k_pad); i++)
+            k_pad[i] ^= 0x36;
+
+        if (PPP_DigestInit(ctx, PPP_md5())
+            && PPP_DigestUpdate(ctx, k_pad, sizeof(k_pad))
+            && PPP_DigestUpdate(ctx, in, inl)
+            && PPP_DigestFinal(ctx, inner, &outl)) {
+
+            /* outer hash */
+            for (i = 0; i < sizeof(k_pad); i++)
+                k_pad[i] ^= 0x36 ^ 0x5c;
+            outl = MD5_DIGEST_LENGTH;
+
+            if (PPP_DigestInit(ctx, PPP_md5())
+                && PPP_DigestUpdate(ctx, k_pad, sizeof(k_pad))
+                && PPP_DigestUpdate(ctx, inner, sizeof(inner))
+                && PPP_DigestFinal(ctx, out, &outl)) {
+
+                retval = 1;
+            }
+        }
+
+        PPP_MD_CTX_free(ctx);
+    }
+    return retval;
+}
@@ -0,0 +1,140 @@
+/***********************************************************************
+*
+* radattr-query.c
+*
+* Prints the RADIUS attributes which the radattr plugin has stored in
+* the pppd database for a session.
+*
+* Copyright (C) 2002 Roaring Penguin Software Inc.
+*
+* This plugin may be distributed according to the terms of the GNU
+* General Public License, version 2 or (at your option) any later version.
+*
+***********************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <pppd/pathnames.h>
+#include <pppd/tdb.h>
+#include "radattr.h"
+
+/* tdb.c uses this when creating the database, which we never do */
+int
+mkdir_recursive(const char *path)
+{
+    return -1;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: radattr-query [-d database] interface [attribute ...]\n");
+    exit(2);
+}
+
+static void
+print_value(const struct radattr *ra)
+{
+    int i;
+
+    switch (ra->type) {
+    case RADATTR_STRING:
+	printf("%.*s", ra->len, (const char *) ra->value);
+	break;
+    case RADATTR_IPADDR:
+	printf("%u.%u.%u.%u", ra->ival >> 24, (ra->ival >> 16) & 0xff,
+	       (ra->ival >> 8) & 0xff, ra->ival & 0xff);
+	break;
+    case RADATTR_SIGNED:
+	printf("%d", (int) ra->ival);
+	break;
+    default:
+	if (RADATTR_NUMERIC(ra->type)) {
+	    printf("%u", ra->ival);
+	    break;
+	}
+	printf("0x");
+	for (i = 0; i < ra->len; ++i)
+	    printf("%02x", ra->value[i]);
+    }
+    printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    char *dbname = PPP_PATH_PPPDB;
+    TDB_CONTEXT *db;
+    TDB_DATA key, rec;
+    struct radattr_iter it;
+    struct radattr ra;
+    int c, i, r, status = 0;
+
+    while ((c = getopt(argc, argv, "d:")) != -1) {
+	switch (c) {
+	case 'd':
+	    dbname = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind >= argc)
+	usage();
+
+    db = tdb_open(dbname, 0, 0, O_RDONLY, 0);
+    if (db == NULL) {
+	perror(dbname);
+	exit(1);
+    }
+
+    key.dsize = strlen(RADATTR_KEY_PREFIX) + strlen(argv[optind]);
+    key.dptr = malloc(key.dsize + 1);
+    if (key.dptr == NULL) {
+	fprintf(stderr, "radattr-query: out of memory\n");
+	exit(1);
+    }
+    sprintf(key.dptr, "%s%s", RADATTR_KEY_PREFIX, argv[optind]);
+    rec = tdb_fetch(db, key);
+    if (rec.dptr == NULL) {
+	fprintf(stderr, "radattr-query: no attributes for %s\n", argv[optind]);
+	exit(1);
+    }
+    if (radattr_begin(&it, rec.dptr, rec.dsize) < 0) {
+	fprintf(stderr, "radattr-query: bad record for %s\n", argv[optind]);
+	exit(1);
+    }
+
+    if (optind + 1 == argc) {
+	/*
+	 * print them all, one "name value" per line as in
+	 * /var/run/radattr.pppN, except that we have no dictionary,
+	 * so integers are printed as numbers, not value names.
+	 */
+	while ((r = radattr_next(&it, &ra)) > 0) {
+	    printf("%s ", ra.name);
+	    print_value(&ra);
+	}
+	if (r < 0)
+	    status = 1;
+    } else {
+	for (i = optind + 1; i < argc; ++i) {
+	    if (radattr_find(rec.dptr, rec.dsize, argv[i], &ra) > 0)
+		print_value(&ra);
+	    else
+		status = 1;
+	}
+    }
+
+    free(rec.dptr);
+    tdb_close(db);
+    return status;
+}
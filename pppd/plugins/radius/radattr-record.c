@@ -0,0 +1,120 @@
+/***********************************************************************
+*
+* radattr-record.c
+*
+* Routines for reading the RADIUS attribute records which the radattr
+* plugin stores in the pppd database.  Used by the radattr-query
+* program, and suitable for copying into other programs which want
+* the attributes for a session without parsing text files.
+*
+* Copyright (C) 2002 Roaring Penguin Software Inc.
+*
+* This plugin may be distributed according to the terms of the GNU
+* General Public License, version 2 or (at your option) any later version.
+*
+***********************************************************************/
+
+#include <string.h>
+
+#include "radattr.h"
+
+#define RADATTR_ALIGN(n)	(((n) + 3) & ~3)
+
+/**********************************************************************
+* %FUNCTION: radattr_begin
+* %ARGUMENTS:
+*  it -- iterator to set up
+*  rec, len -- the record, as fetched from the database
+* %RETURNS:
+*  0 if the record looks valid, -1 if not
+* %DESCRIPTION:
+*  Prepares to step through the attributes in a record.
+***********************************************************************/
+int
+radattr_begin(struct radattr_iter *it, const void *rec, int len)
+{
+    struct radattr_hdr hdr;
+
+    if (len < sizeof(hdr))
+	return -1;
+    memcpy(&hdr, rec, sizeof(hdr));
+    if (memcmp(hdr.magic, RADATTR_MAGIC, 4) != 0
+	|| hdr.version != RADATTR_VERSION)
+	return -1;
+    it->p = (const unsigned char *) rec + sizeof(hdr);
+    it->end = (const unsigned char *) rec + len;
+    it->left = hdr.count;
+    return 0;
+}
+
+/**********************************************************************
+* %FUNCTION: radattr_next
+* %ARGUMENTS:
+*  it -- iterator from radattr_begin
+*  ra -- filled in with the next attribute
+* %RETURNS:
+*  1 if there was another attribute, 0 at the end, -1 if the record
+*  is corrupt
+* %DESCRIPTION:
+*  Returns the next attribute in a record.  ra->name and ra->value
+*  point into the record.
+***********************************************************************/
+int
+radattr_next(struct radattr_iter *it, struct radattr *ra)
+{
+    struct radattr_ent ent;
+    size_t need;
+
+    if (it->left <= 0)
+	return 0;
+    if (it->end - it->p < sizeof(ent))
+	return -1;
+    memcpy(&ent, it->p, sizeof(ent));
+    /* check the lengths before adding them up, so they can't wrap */
+    if (ent.namelen == 0 || ent.namelen > it->end - it->p - sizeof(ent)
+	|| ent.len > it->end - it->p - sizeof(ent) - ent.namelen
+	|| it->p[sizeof(ent) + ent.namelen - 1] != 0)
+	return -1;
+    need = sizeof(ent) + RADATTR_ALIGN((size_t) ent.namelen + ent.len);
+    if (need > it->end - it->p)
+	return -1;
+
+    ra->attribute = ent.attribute;
+    ra->vendor = ent.vendor;
+    ra->type = ent.type;
+    ra->name = (const char *) it->p + sizeof(ent);
+    ra->value = it->p + sizeof(ent) + ent.namelen;
+    ra->len = ent.len;
+    ra->ival = 0;
+    if (RADATTR_NUMERIC(ra->type) && ra->len == sizeof(ra->ival))
+	memcpy(&ra->ival, ra->value, sizeof(ra->ival));
+
+    it->p += need;
+    --it->left;
+    return 1;
+}
+
+/**********************************************************************
+* %FUNCTION: radattr_find
+* %ARGUMENTS:
+*  rec, len -- the record, as fetched from the database
+*  name -- attribute name, e.g. "Framed-IP-Address"
+*  ra -- filled in with the attribute
+* %RETURNS:
+*  1 if found, 0 if not, -1 if the record is corrupt
+* %DESCRIPTION:
+*  Looks up the first occurrence of an attribute by name.
+***********************************************************************/
+int
+radattr_find(const void *rec, int len, const char *name, struct radattr *ra)
+{
+    struct radattr_iter it;
+    int r;
+
+    if (radattr_begin(&it, rec, len) < 0)
+	return -1;
+    while ((r = radattr_next(&it, ra)) > 0)
+	if (strcmp(ra->name, name) == 0)
+	    return 1;
+    return r;
+}
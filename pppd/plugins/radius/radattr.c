@@ -5,7 +5,9 @@
 * A plugin which is stacked on top of radius.so.  This plugin writes
 * all RADIUS attributes from the server's authentication confirmation
 * into /var/run/radattr.pppN.  These attributes are available for
-* consumption by /etc/ppp/ip-{up,down} scripts.
+* consumption by /etc/ppp/ip-{up,down} scripts.  They can also be
+* stored in the pppd database as a binary record (see radattr.h), for
+* programs which look up attributes for many sessions.
 *
 * Copyright (C) 2002 Roaring Penguin Software Inc.
 *
@@ -15,6 +17,8 @@
 ***********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdint.h>
@@ -23,13 +27,26 @@
 #include <pppd/pppd.h>
 
 #include "radiusclient.h"
+#include "radattr.h"
 
 extern void (*radius_attributes_hook)(VALUE_PAIR *);
 static void print_attributes(VALUE_PAIR *);
+static int store_attributes(VALUE_PAIR *);
 static void cleanup(void *opaque, int arg);
 
 char pppd_version[] = PPPD_VERSION;
 
+static bool radattr_db = 0;	/* store attributes in the pppd database */
+static bool radattr_nofile = 0;	/* ... and not in /var/run/radattr.pppN */
+
+static option_t Options[] = {
+    { "radattr-db", o_bool, &radattr_db,
+      "Store RADIUS attributes in the pppd database", 1 },
+    { "radattr-nofile", o_bool, &radattr_nofile,
+      "Don't write RADIUS attributes to /var/run/radattr.pppN", 1 },
+    { NULL }
+};
+
 /**********************************************************************
 * %FUNCTION: plugin_init
 * %ARGUMENTS:
@@ -53,6 +70,7 @@ plugin_init(void)
 
     /* Just in case... */
     ppp_add_notify(NF_EXIT, cleanup, NULL);
+    ppp_add_options(Options);
     info("RADATTR plugin initialized.");
 }
 
@@ -76,6 +94,10 @@ print_attributes(VALUE_PAIR *vp)
     int cnt = 0;
     mode_t old_umask;
 
+    /* If we can't use the database, fall back to the file */
+    if (radattr_db && store_attributes(vp) == 0 && radattr_nofile)
+	return;
+
     slprintf(fname, sizeof(fname), "/var/run/radattr.%s", ppp_ifname());
     old_umask = umask(077);
     fp = fopen(fname, "w");
@@ -96,6 +118,74 @@ print_attributes(VALUE_PAIR *vp)
     dbglog("RADATTR plugin wrote %d line(s) to file %s.", cnt, fname);
 }
 
+/**********************************************************************
+* %FUNCTION: store_attributes
+* %ARGUMENTS:
+*  vp -- linked-list of RADIUS attribute-value pairs
+* %RETURNS:
+*  0 on success, -1 if the attributes couldn't be stored
+* %DESCRIPTION:
+*  Stores the attribute pairs in the pppd database under the key
+*  "radattr:pppN", in the format described in radattr.h.
+***********************************************************************/
+static int
+store_attributes(VALUE_PAIR *vp)
+{
+    VALUE_PAIR *p;
+    struct radattr_hdr hdr;
+    struct radattr_ent ent;
+    char key[64];
+    unsigned char *rec, *q;
+    uint32_t ival;
+    size_t len;
+    int ret;
+
+    len = sizeof(hdr);
+    for (p = vp; p; p = p->next)
+	len += sizeof(ent) + ((strlen(p->name) + 1 + AUTH_STRING_LEN + 3) & ~3);
+    rec = calloc(1, len);
+    if (rec == NULL) {
+	warn("radattr plugin: out of memory");
+	return -1;
+    }
+
+    memcpy(hdr.magic, RADATTR_MAGIC, 4);
+    hdr.version = RADATTR_VERSION;
+    hdr.count = 0;
+    q = rec + sizeof(hdr);
+    for (p = vp; p; p = p->next) {
+	ent.attribute = p->attribute;
+	ent.vendor = p->vendorcode;
+	ent.type = p->type;
+	ent.namelen = strlen(p->name) + 1;
+	memcpy(q + sizeof(ent), p->name, ent.namelen);
+	if (RADATTR_NUMERIC(p->type)) {
+	    ival = p->lvalue;
+	    ent.len = sizeof(ival);
+	    memcpy(q + sizeof(ent) + ent.namelen, &ival, sizeof(ival));
+	} else {
+	    ent.len = p->lvalue;
+	    if (ent.len > AUTH_STRING_LEN)
+		ent.len = AUTH_STRING_LEN;
+	    memcpy(q + sizeof(ent) + ent.namelen, p->strvalue, ent.len);
+	}
+	memcpy(q, &ent, sizeof(ent));
+	q += sizeof(ent) + ((ent.namelen + ent.len + 3) & ~3);
+	hdr.count++;
+    }
+    memcpy(rec, &hdr, sizeof(hdr));
+
+    slprintf(key, sizeof(key), RADATTR_KEY_PREFIX "%s", ppp_ifname());
+    ret = ppp_db_store(key, rec, q - rec);
+    free(rec);
+    if (ret < 0) {
+	warn("radattr plugin: Could not store attributes in pppd database");
+	return -1;
+    }
+    dbglog("RADATTR plugin stored %d attribute(s) under %s.", hdr.count, key);
+    return 0;
+}
+
 /**********************************************************************
 * %FUNCTION: cleanup
 * %ARGUMENTS:
@@ -104,13 +194,17 @@ print_attributes(VALUE_PAIR *vp)
 * %RETURNS:
 *  Nothing
 * %DESCRIPTION:
-*  Deletes /var/run/radattr.pppN
+*  Deletes /var/run/radattr.pppN and our database record
 ***********************************************************************/
 static void
 cleanup(void *opaque, int arg)
 {
     char fname[512];
 
+    if (radattr_db) {
+	slprintf(fname, sizeof(fname), RADATTR_KEY_PREFIX "%s", ppp_ifname());
+	(void) ppp_db_delete(fname);
+    }
     slprintf(fname, sizeof(fname), "/var/run/radattr.%s", ppp_ifname());
     (void) remove(fname);
     dbglog("RADATTR plugin removed file %s.", fname);
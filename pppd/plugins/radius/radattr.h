@@ -0,0 +1,85 @@
+/***********************************************************************
+*
+* radattr.h
+*
+* Format of the RADIUS attribute records which the radattr plugin
+* stores in the pppd database, and routines for reading them.
+*
+* Copyright (C) 2002 Roaring Penguin Software Inc.
+*
+* This plugin may be distributed according to the terms of the GNU
+* General Public License, version 2 or (at your option) any later version.
+*
+***********************************************************************/
+
+#ifndef RADATTR_H
+#define RADATTR_H
+
+#include <stdint.h>
+
+/*
+ * The attributes for a session are stored as one record under the
+ * key "radattr:<ifname>".  The record is a header followed by the
+ * attributes, each an entry header, the attribute name (with its
+ * terminating null) and the value, padded to a multiple of 4 bytes.
+ * Everything is in host byte order.
+ */
+#define RADATTR_KEY_PREFIX	"radattr:"
+#define RADATTR_MAGIC		"RADA"
+#define RADATTR_VERSION		1
+
+struct radattr_hdr {
+    char	magic[4];
+    uint16_t	version;
+    uint16_t	count;		/* # attributes */
+};
+
+struct radattr_ent {
+    uint32_t	attribute;
+    uint32_t	vendor;
+    uint16_t	type;		/* RADATTR_* below */
+    uint16_t	namelen;	/* including the null */
+    uint32_t	len;		/* length of the value */
+};
+
+/*
+ * Value types; these are the same as the radiusclient PW_TYPE_* codes.
+ * Values of the numeric types are stored as a uint32_t, IP addresses
+ * in host byte order; other values are stored as they were received.
+ */
+#define RADATTR_STRING		0
+#define RADATTR_INTEGER		1
+#define RADATTR_IPADDR		2
+#define RADATTR_DATE		3
+#define RADATTR_BYTE		9
+#define RADATTR_SHORT		10
+#define RADATTR_SIGNED		12
+
+#define RADATTR_NUMERIC(t)	((t) == RADATTR_INTEGER || (t) == RADATTR_IPADDR \
+				 || (t) == RADATTR_DATE || (t) == RADATTR_BYTE \
+				 || (t) == RADATTR_SHORT || (t) == RADATTR_SIGNED)
+
+/* One attribute, as returned by radattr_next */
+struct radattr {
+    uint32_t		attribute;
+    uint32_t		vendor;
+    int			type;
+    const char		*name;
+    const unsigned char	*value;
+    int			len;
+    uint32_t		ival;		/* value of a numeric type */
+};
+
+/* Position in a record */
+struct radattr_iter {
+    const unsigned char	*p;
+    const unsigned char	*end;
+    int			left;		/* # attributes still to come */
+};
+
+int radattr_begin(struct radattr_iter *it, const void *rec, int len);
+int radattr_next(struct radattr_iter *it, struct radattr *ra);
+int radattr_find(const void *rec, int len, const char *name,
+		 struct radattr *ra);
+
+#endif /* RADATTR_H */
@@ -33,11 +33,15 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include <pppd/pppd.h>
 #include <pppd/options.h>
 #include <pppd/chap.h>
 #include <pppd/upap.h>
+#include <pppd/eap.h>
 #ifdef PPP_WITH_CHAPMS
 #include <pppd/chap_ms.h>
 #ifdef PPP_WITH_MPPE
@@ -47,6 +51,7 @@
 #include <pppd/crypto.h>
 #include <pppd/fsm.h>
 #include <pppd/ipcp.h>
+#include <pppd/lcp.h>
 
 #include "radiusclient.h"
 
@@ -61,6 +66,9 @@ static struct avpopt {
     struct avpopt *next;
 } *avpopt = NULL;
 static bool portnummap = 0;
+static int set_port_range(char **);
+static UINT4 port_range_lo, port_range_hi;
+static int set_eap_passthrough(char **);
 
 static option_t Options[] = {
     { "radius-config-file", o_string, &config_file },
@@ -69,15 +77,21 @@ static option_t Options[] = {
 	"Set Radius NAS-Port attribute value via libradiusclient library", OPT_PRIO | 1 },
     { "map-to-ifname", o_bool, &portnummap,
 	"Set Radius NAS-Port attribute to number as in interface name (Default)", OPT_PRIOSUB | 0 },
+    { "nas-port-range", o_special, set_port_range,
+	"Allocate stable NAS-Port values from this range for other names" },
+    { "eap-passthrough", o_special_noarg, (void *)set_eap_passthrough,
+	"Relay EAP to the RADIUS server rather than doing it here" },
     { NULL }
 };
 
 static pap_check_hook_fn radius_secret_check;
 static pap_auth_hook_fn radius_pap_auth;
 static chap_verify_hook_fn radius_chap_verify;
+static eap_passthrough_hook_fn radius_eap_passthrough;
 
 static void radius_ip_up(void *opaque, int arg);
 static void radius_ip_down(void *opaque, int arg);
+static void release_client_port(void *opaque, int arg);
 static void make_username_realm(const char *user);
 static int radius_setparams(VALUE_PAIR *vp, char *msg, REQUEST_INFO *req_info,
 			    struct chap_digest_type *digest,
@@ -119,6 +133,10 @@ struct radius_state {
     int class_len;
     char class[MAXCLASSLEN];
     VALUE_PAIR *avp;	/* Additional (user supplied) vp's to send to server */
+    int eap;		/* authenticating the peer with EAP passthrough */
+    int eap_state_len;
+    u_char eap_state[AUTH_STRING_LEN];	/* State from Access-Challenge */
+    UINT4 nas_port;	/* port we hold from nas-port-range, or 0 */
 };
 
 void (*radius_attributes_hook)(VALUE_PAIR *) = NULL;
@@ -156,6 +174,7 @@ plugin_init(void)
 
     ppp_add_notify(NF_IP_UP, radius_ip_up, NULL);
     ppp_add_notify(NF_IP_DOWN, radius_ip_down, NULL);
+    ppp_add_notify(NF_EXIT, release_client_port, NULL);
 
     memset(&rstate, 0, sizeof(rstate));
 
@@ -189,6 +208,54 @@ add_avp(char **argv)
     return 1;
 }
 
+/**********************************************************************
+* %FUNCTION: set_port_range
+* %ARGUMENTS:
+*  argv -- the range, as <low>-<high>
+* %RETURNS:
+*  1 if the range is valid, 0 if not
+* %DESCRIPTION:
+*  Sets the range of NAS-Port values handed out to names which are
+*  neither pppN nor in the map file.
+***********************************************************************/
+static int
+set_port_range(char **argv)
+{
+    unsigned long lo, hi;
+    char *end;
+
+    lo = strtoul(*argv, &end, 10);
+    if (end == *argv || *end != '-')
+	goto bad;
+    hi = strtoul(end + 1, &end, 10);
+    if (*end != 0 || lo == 0 || hi < lo)
+	goto bad;
+    port_range_lo = lo;
+    port_range_hi = hi;
+    return 1;
+
+ bad:
+    ppp_option_error("invalid NAS-Port range %s", *argv);
+    return 0;
+}
+
+/**********************************************************************
+* %FUNCTION: set_eap_passthrough
+* %ARGUMENTS:
+*  argv -- unused
+* %RETURNS:
+*  1
+* %DESCRIPTION:
+*  Has pppd relay EAP to the RADIUS server, which then does the EAP
+*  method (EAP-TLS, PEAP, ...) itself.
+***********************************************************************/
+static int
+set_eap_passthrough(char **argv)
+{
+    eap_passthrough_hook = radius_eap_passthrough;
+    return 1;
+}
+
 /**********************************************************************
 * %FUNCTION: radius_secret_check
 * %ARGUMENTS:
@@ -495,6 +562,164 @@ radius_chap_verify(char *user, char *ourname, int id,
     return (result == OK_RC);
 }
 
+/**********************************************************************
+* %FUNCTION: radius_eap_passthrough
+* %ARGUMENTS:
+*  user -- the name the peer gave in its EAP Identity
+*  resp -- the EAP Response from the peer
+*  len -- its length
+*  pkt -- where to put the EAP packet the server sends back
+*  pktlen -- the space at pkt; set to the length of that packet
+* %RETURNS:
+*  EAP_PT_CONTINUE, EAP_PT_SUCCESS, EAP_PT_FAILURE or EAP_PT_ERROR
+* %DESCRIPTION:
+* Relays EAP between the peer and the RADIUS server (RFC 3579).  Each
+* Response goes in an Access-Request as EAP-Message attributes, along
+* with the State from the last Access-Challenge, and the EAP packet in
+* the server's reply goes back to the peer.  The MPPE keys come from
+* the Access-Accept.
+***********************************************************************/
+static int
+radius_eap_passthrough(char *user, unsigned char *resp, int len,
+		       unsigned char *pkt, int *pktlen)
+{
+    VALUE_PAIR *send, *received, *vp;
+    UINT4 av_type;
+    static char radius_msg[BUF_LEN];
+    u_char msgauth[AUTH_VECTOR_LEN];
+    REQUEST_INFO request_info;
+    int result, n, chunk, space;
+    const char *remote_number;
+    const char *ipparam;
+
+    radius_msg[0] = 0;
+
+    if (radius_init(radius_msg) < 0) {
+	error("%s", radius_msg);
+	return EAP_PT_ERROR;
+    }
+
+    /* An Identity starts a new conversation with the server */
+    if (len > EAP_HEADERLEN && resp[EAP_HEADERLEN] == EAPT_IDENTITY) {
+	rstate.eap_state_len = 0;
+	if (!rstate.done_chap_once) {
+	    make_username_realm(user);
+	    rstate.client_port = get_client_port (portnummap ? ppp_devnam() : ppp_ifname());
+	    if (radius_pre_auth_hook) {
+		radius_pre_auth_hook(rstate.user,
+				     &rstate.authserver,
+				     &rstate.acctserver);
+	    }
+	}
+    }
+
+    send = received = NULL;
+
+    av_type = PW_FRAMED;
+    rc_avpair_add (&send, PW_SERVICE_TYPE, &av_type, 0, VENDOR_NONE);
+
+    av_type = PW_PPP;
+    rc_avpair_add (&send, PW_FRAMED_PROTOCOL, &av_type, 0, VENDOR_NONE);
+
+    rc_avpair_add (&send, PW_USER_NAME, rstate.user , 0, VENDOR_NONE);
+
+    /* Tell the server how big an EAP packet the peer can take */
+    av_type = lcp_hisoptions[0].neg_mru? lcp_hisoptions[0].mru: DEFMRU;
+    if (av_type > *pktlen)
+	av_type = *pktlen;
+    rc_avpair_add (&send, PW_FRAMED_MTU, &av_type, 0, VENDOR_NONE);
+
+    /* The Response, split up to fit in attributes */
+    for (n = 0; n < len; n += chunk) {
+	chunk = len - n;
+	if (chunk > AUTH_STRING_LEN)
+	    chunk = AUTH_STRING_LEN;
+	rc_avpair_add(&send, PW_EAP_MESSAGE, resp + n, chunk, VENDOR_NONE);
+    }
+
+    if (rstate.eap_state_len > 0)
+	rc_avpair_add(&send, PW_STATE, rstate.eap_state,
+		      rstate.eap_state_len, VENDOR_NONE);
+
+    /* Filled in by rc_send_server */
+    memset(msgauth, 0, sizeof(msgauth));
+    rc_avpair_add(&send, PW_MESSAGE_AUTHENTICATOR, msgauth, sizeof(msgauth),
+		  VENDOR_NONE);
+
+    remote_number = ppp_get_remote_number();
+    ipparam = ppp_ipparam();
+    if (remote_number) {
+	rc_avpair_add(&send, PW_CALLING_STATION_ID, remote_number, 0,
+		       VENDOR_NONE);
+    } else if (ipparam)
+	rc_avpair_add(&send, PW_CALLING_STATION_ID, ipparam, 0, VENDOR_NONE);
+
+    /* Add user specified vp's */
+    if (rstate.avp)
+	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
+
+    if (rstate.authserver) {
+	result = rc_auth_using_server(rstate.authserver,
+				      rstate.client_port, send,
+				      &received, radius_msg, &request_info);
+    } else {
+	result = rc_auth(rstate.client_port, send, &received, radius_msg,
+			 &request_info);
+    }
+    rc_avpair_free(send);
+
+    if (result != OK_RC && result != CHALLENGE_RC && result != BADRESP_RC) {
+	rc_avpair_free(received);
+	return EAP_PT_ERROR;
+    }
+
+    /* Put the EAP-Message attributes back together */
+    space = *pktlen;
+    *pktlen = 0;
+    rstate.eap_state_len = 0;
+    for (vp = received; vp != NULL; vp = vp->next) {
+	if (vp->vendorcode != VENDOR_NONE)
+	    continue;
+	if (vp->attribute == PW_EAP_MESSAGE) {
+	    if (*pktlen + vp->lvalue > space) {
+		error("RADIUS: EAP packet from server too long");
+		rc_avpair_free(received);
+		return EAP_PT_ERROR;
+	    }
+	    memcpy(pkt + *pktlen, vp->strvalue, vp->lvalue);
+	    *pktlen += vp->lvalue;
+	} else if (vp->attribute == PW_STATE && result == CHALLENGE_RC) {
+	    memcpy(rstate.eap_state, vp->strvalue, vp->lvalue);
+	    rstate.eap_state_len = vp->lvalue;
+	}
+    }
+
+    if (result == CHALLENGE_RC) {
+	rc_avpair_free(received);
+	return EAP_PT_CONTINUE;
+    }
+
+    if (result == OK_RC && !rstate.done_chap_once) {
+	rstate.eap = 1;
+	if (radius_setparams(received, radius_msg, &request_info, NULL,
+			     NULL, NULL, 0) < 0) {
+	    error("%s", radius_msg);
+	    result = BADRESP_RC;
+	} else {
+	    rstate.done_chap_once = 1;
+	}
+	rstate.eap = 0;
+    }
+
+    rc_avpair_free(received);
+    if (result != OK_RC) {
+	/* a Failure even if the server's EAP said otherwise */
+	pkt[0] = EAP_FAILURE;
+	return EAP_PT_FAILURE;
+    }
+    return EAP_PT_SUCCESS;
+}
+
 /**********************************************************************
 * %FUNCTION: make_username_realm
 * %ARGUMENTS:
@@ -743,8 +968,9 @@ radius_setparams(VALUE_PAIR *vp, char *msg, REQUEST_INFO *req_info,
     /*
      * Require both policy and key attributes to indicate a valid key.
      * Note that if the policy value was '0' we don't set the key!
+     * Servers doing EAP send the keys without a policy (RFC 3579).
      */
-    if (mppe_enc_policy && mppe_enc_keys) {
+    if ((mppe_enc_policy || rstate.eap) && mppe_enc_keys) {
 	/* Set/modify allowed encryption types. */
 	if (mppe_enc_types)
 	    mppe_set_enc_types(mppe_enc_policy, mppe_enc_types);
@@ -1415,6 +1641,150 @@ radius_init(char *msg)
     return 0;
 }
 
+/**********************************************************************
+* %FUNCTION: port_owner
+* %ARGUMENTS:
+*  data, len -- a "nas-port:id:<port>" record, "<pid> <name>"
+*  name -- filled in with the name (of size MAXPATHLEN)
+* %RETURNS:
+*  The pid of the pppd holding the port
+***********************************************************************/
+static int
+port_owner(const void *data, int len, char *name)
+{
+    char buf[MAXPATHLEN + 16];
+    char *p;
+    int pid;
+
+    if (len >= sizeof(buf))
+	len = sizeof(buf) - 1;
+    memcpy(buf, data, len);
+    buf[len] = 0;
+    pid = strtol(buf, &p, 10);
+    if (*p == ' ')
+	++p;
+    strlcpy(name, p, MAXPATHLEN);
+    return pid;
+}
+
+/**********************************************************************
+* %FUNCTION: alloc_client_port
+* %ARGUMENTS:
+*  name -- interface or tty name
+* %RETURNS:
+*  The NAS port number for name, or 0 if none could be allocated
+* %DESCRIPTION:
+*  Hands out a port number from the nas-port-range, recording it in
+*  the pppd database so that every pppd instance gives the same name
+*  the same number while it is in use.  The search starts at a slot
+*  chosen by hashing the name, so a name usually gets the same number
+*  each time.  The port is given back when we exit (release_client_port);
+*  one held by a pppd which died without doing so is taken over.
+***********************************************************************/
+static UINT4
+alloc_client_port(const char *name)
+{
+    char nkey[MAXPATHLEN + 16], pkey[32], val[MAXPATHLEN + 16];
+    char owner[MAXPATHLEN];
+    void *data;
+    int len, pid;
+    UINT4 n, h, i, had, port, slot;
+    const unsigned char *p;
+
+    if (port_range_hi == 0 || ppp_db_lock() < 0)
+	return 0;
+
+    /* Already have one? */
+    had = 0;
+    slprintf(nkey, sizeof(nkey), "nas-port:name:%s", name);
+    if (ppp_db_fetch(nkey, &data, &len) == 0) {
+	if (len < 16) {
+	    memcpy(val, data, len);
+	    val[len] = 0;
+	    had = strtoul(val, NULL, 10);
+	}
+	free(data);
+	if (had < port_range_lo || had > port_range_hi)
+	    had = 0;
+    }
+
+    n = port_range_hi - port_range_lo + 1;
+    h = 2166136261U;
+    for (p = (const unsigned char *) name; *p; ++p)
+	h = (h ^ *p) * 16777619U;
+    port = 0;
+    for (i = 0; i <= n; ++i) {
+	if (i == 0) {
+	    if (had == 0)
+		continue;
+	    slot = had;		/* check the one we had first */
+	} else
+	    slot = port_range_lo + (h + i - 1) % n;
+	slprintf(pkey, sizeof(pkey), "nas-port:id:%u", slot);
+	if (ppp_db_fetch(pkey, &data, &len) == 0) {
+	    pid = port_owner(data, len, owner);
+	    free(data);
+	    if (strcmp(owner, name) != 0) {
+		if (pid > 0 && kill(pid, 0) < 0 && errno == ESRCH) {
+		    /* its pppd died without giving it back */
+		    slprintf(val, sizeof(val), "nas-port:name:%s", owner);
+		    ppp_db_delete(val);
+		} else
+		    continue;
+	    }
+	}
+	slprintf(val, sizeof(val), "%d %s", getpid(), name);
+	if (ppp_db_store(pkey, val, strlen(val)) < 0)
+	    break;
+	slprintf(val, sizeof(val), "%u", slot);
+	if (ppp_db_store(nkey, val, strlen(val)) < 0)
+	    break;
+	port = slot;
+	rstate.nas_port = port;
+	break;
+    }
+
+    ppp_db_unlock();
+    if (port == 0)
+	warn("RADIUS: no NAS-Port available for %s in range %u-%u",
+	     name, port_range_lo, port_range_hi);
+    return port;
+}
+
+/**********************************************************************
+* %FUNCTION: release_client_port
+* %ARGUMENTS:
+*  opaque -- ignored
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called when pppd exits.  Gives back the port alloc_client_port
+*  handed out to us, if we still hold it.
+***********************************************************************/
+static void
+release_client_port(void *opaque, int arg)
+{
+    char pkey[32], nkey[MAXPATHLEN + 16], owner[MAXPATHLEN];
+    void *data;
+    int len, pid;
+
+    if (rstate.nas_port == 0 || ppp_db_lock() < 0)
+	return;
+    slprintf(pkey, sizeof(pkey), "nas-port:id:%u", rstate.nas_port);
+    if (ppp_db_fetch(pkey, &data, &len) == 0) {
+	pid = port_owner(data, len, owner);
+	free(data);
+	if (pid == getpid()) {
+	    slprintf(nkey, sizeof(nkey), "nas-port:name:%s", owner);
+	    ppp_db_delete(nkey);
+	    ppp_db_delete(pkey);
+	}
+    }
+    ppp_db_unlock();
+    rstate.nas_port = 0;
+}
+
 /**********************************************************************
 * %FUNCTION: get_client_port
 * %ARGUMENTS:
@@ -1422,15 +1792,22 @@ radius_init(char *msg)
 * %RETURNS:
 *  The NAS port number (e.g. 7)
 * %DESCRIPTION:
-*  Extracts the port number from the interface name
+*  Extracts the port number from the interface name, or failing that
+*  looks it up in the map file or allocates one from nas-port-range
 ***********************************************************************/
 static int
 get_client_port(const char *ifname)
 {
     int port;
+    UINT4 id;
+
     if (sscanf(ifname, "ppp%d", &port) == 1) {
 	return port;
     }
+    if (rc_find_map2id(ifname, &id))
+	return id;
+    if (port_range_hi != 0)
+	return alloc_client_port(ifname);
     return rc_map2id(ifname);
 }
 
@@ -189,6 +189,10 @@ typedef struct pw_auth_hdr
 #define PW_ACCT_OUTPUT_GIGAWORDS        53	/* integer */
 #define PW_ACCT_INTERIM_INTERVAL        85	/* integer */
 
+/* From RFC 3579 */
+#define PW_EAP_MESSAGE			79	/* string */
+#define PW_MESSAGE_AUTHENTICATOR	80	/* string */
+
 /*	Merit Experimental Extensions */
 
 #define PW_USER_ID                      222     /* string */
@@ -358,6 +362,7 @@ typedef struct value_pair
 #define ERROR_RC	-1
 #define OK_RC		0
 #define TIMEOUT_RC	1
+#define CHALLENGE_RC	2
 
 typedef struct send_data /* Used to pass information to sendserver() function */
 {
@@ -428,6 +433,7 @@ int rc_check(char *, unsigned short, char *);
 /*	clientid.c		*/
 
 int rc_read_mapfile(char *);
+int rc_find_map2id(const char *, UINT4 *);
 UINT4 rc_map2id(const char *);
 
 /*	config.c		*/
@@ -470,5 +476,7 @@ void rc_mdelay(int);
 /* md5.c			*/
 
 int rc_md5_calc(unsigned char *out, const unsigned char *in, unsigned int inl);
+int rc_hmac_md5(unsigned char *out, const unsigned char *in, unsigned int inl,
+		const unsigned char *key, unsigned int keyl);
 
 #endif /* RADIUSCLIENT_H */
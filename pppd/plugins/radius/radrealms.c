@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <pppd/pppd.h>
 
@@ -41,42 +42,166 @@ extern void (*radius_pre_auth_hook)(char const *user,
 				    SERVER **authserver,
 				    SERVER **acctserver);
 
+/*
+ * Since each pppd usually authenticates only once, the realms file is
+ * compiled into the pppd database, which all pppd instances share:
+ * one record per realm under "realm:<file>:<realm>", holding its
+ * servers, so that a lookup is one database probe per label of the
+ * realm rather than a read of the whole file.  The record "realms:<file>"
+ * says which version of the file the records were compiled from, and
+ * "realms:<file>:names" lists them so that they can be removed when the
+ * file is compiled again.  Whichever pppd first notices the file has
+ * changed compiles it.
+ *
+ * If pppd has no database, the file is compiled into a hash table in
+ * this process instead, which helps only when the peer authenticates
+ * again.
+ */
+struct realm {
+    struct realm *next;		/* next in hash chain */
+    char *name;
+    SERVER auth;
+    SERVER acct;
+};
+
+struct realm_table {
+    struct realm **hash;
+    unsigned int size;		/* # hash chains, a power of 2 */
+    unsigned int count;		/* # realms */
+    int in_use;			/* servers have been handed out */
+};
+
+#define REALM_HASH_INIT	64
+
+static struct realm_table *realms;
+static struct stat realms_stat;
+
+static unsigned int
+realm_hash(const char *name)
+{
+    unsigned int h = 2166136261U;
+
+    while (*name)
+	h = (h ^ (unsigned char) *name++) * 16777619U;
+    return h;
+}
+
+static struct realm *
+find_exact_realm(struct realm_table *t, const char *name)
+{
+    struct realm *r;
+
+    for (r = t->hash[realm_hash(name) & (t->size - 1)]; r; r = r->next)
+	if (strcmp(r->name, name) == 0)
+	    return r;
+    return NULL;
+}
+
+/*
+ * find_realm - look for the realm itself, then for the longest entry
+ * of the form ".example.com" which it is a subdomain of.  That costs
+ * one hash lookup per label, however large the table is.
+ */
+static struct realm *
+find_realm(struct realm_table *t, const char *name)
+{
+    struct realm *r;
+
+    if ((r = find_exact_realm(t, name)) != NULL)
+	return r;
+    for (; (name = strchr(name + 1, '.')) != NULL; )
+	if ((r = find_exact_realm(t, name)) != NULL)
+	    return r;
+    return NULL;
+}
+
 static void
-lookup_realm(char const *user,
-	     SERVER **authserver,
-	     SERVER **acctserver)
+grow_realm_table(struct realm_table *t)
 {
-    char *realm;
-    FILE *fd;
-    SERVER *accts, *auths, *s;
-    char buffer[512], *p;
-    int line = 0;
-    
-    auths = (SERVER *) malloc(sizeof(SERVER));
-    auths->max = 0;
-    accts = (SERVER *) malloc(sizeof(SERVER));
-    accts->max = 0;
-    
-    realm = strrchr(user, '@');
-    
-    if (realm) {
-	info("Looking up servers for realm '%s'", realm);
-    } else {
-	info("Looking up servers for DEFAULT realm");
+    struct realm **hash, *r, *next;
+    unsigned int i, size = t->size * 2;
+
+    hash = calloc(size, sizeof(*hash));
+    if (hash == NULL)
+	return;		/* just have longer chains */
+    for (i = 0; i < t->size; ++i) {
+	for (r = t->hash[i]; r; r = next) {
+	    next = r->next;
+	    r->next = hash[realm_hash(r->name) & (size - 1)];
+	    hash[realm_hash(r->name) & (size - 1)] = r;
+	}
     }
-    if (realm) {
-	if (*(++realm) == '\0') {
-	    realm = NULL;
+    free(t->hash);
+    t->hash = hash;
+    t->size = size;
+}
+
+static struct realm *
+add_realm(struct realm_table *t, const char *name)
+{
+    struct realm *r;
+    unsigned int h;
+
+    if ((r = find_exact_realm(t, name)) != NULL)
+	return r;
+    if (t->count >= t->size)
+	grow_realm_table(t);
+    r = calloc(1, sizeof(*r));
+    if (r == NULL || (r->name = strdup(name)) == NULL) {
+	free(r);
+	return NULL;
+    }
+    h = realm_hash(name) & (t->size - 1);
+    r->next = t->hash[h];
+    t->hash[h] = r;
+    ++t->count;
+    return r;
+}
+
+static void
+free_realm_table(struct realm_table *t)
+{
+    struct realm *r, *next;
+    unsigned int i;
+    int j;
+
+    for (i = 0; i < t->size; ++i) {
+	for (r = t->hash[i]; r; r = next) {
+	    next = r->next;
+	    for (j = 0; j < r->auth.max; ++j)
+		free(r->auth.name[j]);
+	    for (j = 0; j < r->acct.max; ++j)
+		free(r->acct.name[j]);
+	    free(r->name);
+	    free(r);
 	}
     }
-    
-    if ((fd = fopen(radrealms_config, "r")) == NULL) {
-	ppp_option_error("cannot open %s", radrealms_config);
-	free(auths);
-	free(accts);
-	return;
+    free(t->hash);
+    free(t);
+}
+
+/*
+ * read_realms - compile the realms file.  Returns NULL if the file
+ * can't be read or has an error in it.
+ */
+static struct realm_table *
+read_realms(FILE *fd)
+{
+    struct realm_table *t;
+    struct realm *r;
+    SERVER *s;
+    char buffer[512], *p, *kind;
+    int line = 0;
+
+    t = calloc(1, sizeof(*t));
+    if (t == NULL)
+	return NULL;
+    t->size = REALM_HASH_INIT;
+    t->hash = calloc(t->size, sizeof(*t->hash));
+    if (t->hash == NULL) {
+	free(t);
+	return NULL;
     }
-    info("Reading %s", radrealms_config);
 
     while ((fgets(buffer, sizeof(buffer), fd) != NULL)) {
 	line++;
@@ -84,76 +209,374 @@ lookup_realm(char const *user,
 	if ((*buffer == '\n') || (*buffer == '#') || (*buffer == '\0'))
 	    continue;
 
-	buffer[strlen(buffer)-1] = '\0';
+	buffer[strcspn(buffer, "\n")] = '\0';
 
-	p = strtok(buffer, "\t ");
+	kind = strtok(buffer, "\t ");
 
-	if (p == NULL || (strcmp(p, "authserver") !=0
-	    && strcmp(p, "acctserver"))) {
-	    fclose(fd);
-	    ppp_option_error("%s: invalid line %d: %s", radrealms_config,
-			 line, buffer);
-	    free(auths);
-	    free(accts);
-	    return;
+	if (kind == NULL || (strcmp(kind, "authserver") !=0
+	    && strcmp(kind, "acctserver"))) {
+	    error("%s: invalid line %d: %s", radrealms_config,
+		  line, buffer);
+	    goto bad;
 	}
-	info("Parsing '%s' entry:", p);
-	s = auths;
-	if (p[1] == 'c') {
-	    s = accts;
+
+	if ((p = strtok(NULL, "\t ")) == NULL) {
+	    error("%s: realm name missing on line %d: %s",
+		  radrealms_config, line, buffer);
+	    goto bad;
 	}
+	if ((r = add_realm(t, p)) == NULL) {
+	    error("%s: out of memory", radrealms_config);
+	    goto bad;
+	}
+	s = (kind[1] == 'c')? &r->acct: &r->auth;
 	if (s->max >= SERVER_MAX)
 	    continue;
 
+	if ((p = strtok(NULL, ":")) == NULL) {
+	    error("%s: server address missing on line %d: %s",
+		  radrealms_config, line, buffer);
+	    goto bad;
+	}
+	if ((s->name[s->max] = strdup(p)) == NULL) {
+	    error("%s: out of memory", radrealms_config);
+	    goto bad;
+	}
 	if ((p = strtok(NULL, "\t ")) == NULL) {
-	    fclose(fd);
-	    ppp_option_error("%s: realm name missing on line %d: %s",
-			 radrealms_config, line, buffer);
-	    free(auths);
-	    free(accts);
-	    return;
+	    free(s->name[s->max]);
+	    error("%s: server port missing on line %d:  %s",
+		  radrealms_config, line, buffer);
+	    goto bad;
 	}
+	s->port[s->max] = atoi(p);
+	s->max++;
+    }
+    return t;
 
-	if ((realm != NULL && strcmp(p, realm) == 0) ||
-	    (realm == NULL && strcmp(p, "DEFAULT") == 0) ) {
-	    info(" - Matched realm %s", p);
-	    if ((p = strtok(NULL, ":")) == NULL) {
-		fclose(fd);
-		ppp_option_error("%s: server address missing on line %d: %s",
-			     radrealms_config, line, buffer);
-	        free(auths);
-	        free(accts);
-		return;
-	    }
-	    s->name[s->max] = strdup(p);
-	    info(" - Address is '%s'",p);
-	    if ((p = strtok(NULL, "\t ")) == NULL) {
-		fclose(fd);
-		ppp_option_error("%s: server port missing on line %d:  %s",
-			     radrealms_config, line, buffer);
-		free(auths);
-		free(accts);
-		return;
-	    }
-	    s->port[s->max] = atoi(p);
-	    info(" - Port is '%d'", s->port[s->max]);
-	    s->max++;
-	} else 
-	    info(" - Skipping realm '%s'", p);
+ bad:
+    free_realm_table(t);
+    return NULL;
+}
+
+/*
+ * load_realms - make sure we have the current contents of the realms
+ * file.  If it has changed but the new contents are bad, we carry on
+ * with what we had.
+ */
+static void
+load_realms(void)
+{
+    struct realm_table *t;
+    struct stat sbuf;
+    FILE *fd;
+
+    if ((fd = fopen(radrealms_config, "r")) == NULL
+	|| fstat(fileno(fd), &sbuf) < 0) {
+	error("cannot open %s", radrealms_config);
+	if (fd != NULL)
+	    fclose(fd);
+	return;
     }
+    if (realms != NULL && sbuf.st_mtime == realms_stat.st_mtime
+	&& sbuf.st_ino == realms_stat.st_ino
+	&& sbuf.st_size == realms_stat.st_size) {
+	fclose(fd);
+	return;
+    }
+
+    info("Reading %s", radrealms_config);
+    t = read_realms(fd);
     fclose(fd);
+    if (t == NULL)
+	return;
+    info("Read %u realms from %s", t->count, radrealms_config);
 
-    if (accts->max)
-	*acctserver = accts;
-    else
-	free(accts);
+    /*
+     * The radius plugin keeps the servers we gave it, for accounting,
+     * so the old table has to stay around if any were handed out.
+     */
+    if (realms != NULL && !realms->in_use)
+	free_realm_table(realms);
+    realms = t;
+    realms_stat = sbuf;
+}
 
-    if (auths->max)
-	*authserver = auths;
-    else
-	free(auths);
+/* What the realm records in the database were compiled from */
+struct realms_stamp {
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+};
 
-    return;
+/* The servers last found in the database, which the radius plugin keeps */
+static SERVER db_auth, db_acct;
+
+static int
+same_file(struct stat *sbuf, struct realms_stamp *st)
+{
+    return sbuf->st_dev == st->dev && sbuf->st_ino == st->ino
+	&& sbuf->st_mtime == st->mtime && sbuf->st_size == st->size;
+}
+
+/*
+ * store_realm - put a compiled realm in the database, as lines of the
+ * form "auth host:port" and "acct host:port".
+ */
+static int
+store_realm(struct realm *r)
+{
+    char key[2 * MAXPATHLEN], *buf, *p;
+    int i, len;
+
+    len = 0;
+    for (i = 0; i < r->auth.max; ++i)
+	len += strlen(r->auth.name[i]) + 16;
+    for (i = 0; i < r->acct.max; ++i)
+	len += strlen(r->acct.name[i]) + 16;
+    if ((buf = malloc(len + 1)) == NULL)
+	return -1;
+    p = buf;
+    for (i = 0; i < r->auth.max; ++i)
+	p += slprintf(p, buf + len + 1 - p, "auth %s:%d\n",
+		      r->auth.name[i], r->auth.port[i]);
+    for (i = 0; i < r->acct.max; ++i)
+	p += slprintf(p, buf + len + 1 - p, "acct %s:%d\n",
+		      r->acct.name[i], r->acct.port[i]);
+    slprintf(key, sizeof(key), "realm:%s:%s", radrealms_config, r->name);
+    i = ppp_db_store(key, buf, p - buf);
+    free(buf);
+    return i;
+}
+
+/*
+ * compile_realms_db - compile the realms file into the database,
+ * replacing what was there.  The caller holds the database lock.  If
+ * the file has an error, the records compiled from the last good
+ * version are kept.
+ */
+static void
+compile_realms_db(struct stat *sbuf)
+{
+    char key[2 * MAXPATHLEN], nkey[MAXPATHLEN + 16], *names, *p, *q;
+    struct realms_stamp st;
+    struct realm_table *t;
+    struct realm *r;
+    unsigned int i;
+    void *data;
+    int len;
+    FILE *fd;
+
+    memset(&st, 0, sizeof(st));
+    st.dev = sbuf->st_dev;
+    st.ino = sbuf->st_ino;
+    st.mtime = sbuf->st_mtime;
+    st.size = sbuf->st_size;
+
+    info("Reading %s", radrealms_config);
+    t = NULL;
+    if ((fd = fopen(radrealms_config, "r")) != NULL) {
+	t = read_realms(fd);
+	fclose(fd);
+    }
+    if (t == NULL) {
+	/* don't try again until the file changes */
+	slprintf(key, sizeof(key), "realms:%s", radrealms_config);
+	ppp_db_store(key, &st, sizeof(st));
+	return;
+    }
+
+    /* remove the old records */
+    slprintf(nkey, sizeof(nkey), "realms:%s:names", radrealms_config);
+    if (ppp_db_fetch(nkey, &data, &len) == 0) {
+	if ((names = malloc(len + 1)) != NULL) {
+	    memcpy(names, data, len);
+	    names[len] = 0;
+	    for (p = names; *p; p = q) {
+		q = p + strcspn(p, "\n");
+		if (*q)
+		    *q++ = 0;
+		slprintf(key, sizeof(key), "realm:%s:%s", radrealms_config, p);
+		ppp_db_delete(key);
+	    }
+	    free(names);
+	}
+	free(data);
+    }
+
+    /* and store the new ones */
+    len = 0;
+    for (i = 0; i < t->size; ++i)
+	for (r = t->hash[i]; r; r = r->next)
+	    len += strlen(r->name) + 1;
+    names = malloc(len + 1);
+    p = names;
+    for (i = 0; i < t->size; ++i) {
+	for (r = t->hash[i]; r; r = r->next) {
+	    if (store_realm(r) < 0)
+		error("%s: couldn't store realm %s", radrealms_config, r->name);
+	    else if (names != NULL)
+		p += slprintf(p, names + len + 1 - p, "%s\n", r->name);
+	}
+    }
+    if (names != NULL) {
+	ppp_db_store(nkey, names, p - names);
+	free(names);
+    }
+    slprintf(key, sizeof(key), "realms:%s", radrealms_config);
+    ppp_db_store(key, &st, sizeof(st));
+    info("Read %u realms from %s", t->count, radrealms_config);
+    free_realm_table(t);
+}
+
+/*
+ * set_servers - fill in s from the lines for kind ("auth" or "acct")
+ * in a realm record, and return how many there are.  If there are
+ * none, s is left as it was, since the radius plugin may still be
+ * using it.
+ */
+static int
+set_servers(SERVER *s, const char *kind, const char *rec)
+{
+    const char *p, *q, *c;
+    int i, n;
+
+    n = 0;
+    for (p = rec; *p; p = q + (*q != 0)) {
+	q = p + strcspn(p, "\n");
+	if (strncmp(p, kind, 4) == 0 && p[4] == ' ')
+	    ++n;
+    }
+    if (n == 0)
+	return 0;
+
+    for (i = 0; i < s->max; ++i)
+	free(s->name[i]);
+    s->max = 0;
+    for (p = rec; *p && s->max < SERVER_MAX; p = q + (*q != 0)) {
+	q = p + strcspn(p, "\n");
+	if (strncmp(p, kind, 4) != 0 || p[4] != ' ')
+	    continue;
+	p += 5;
+	for (c = q; c > p && c[-1] != ':'; --c)
+	    ;
+	if (c == p || (s->name[s->max] = malloc(c - p)) == NULL)
+	    continue;
+	memcpy(s->name[s->max], p, c - p - 1);
+	s->name[s->max][c - p - 1] = 0;
+	s->port[s->max] = atoi(c);
+	s->max++;
+    }
+    return s->max;
+}
+
+/*
+ * lookup_realm_db - look the realm up in the database, compiling the
+ * realms file into it first if it has changed.  Returns -1 if pppd has
+ * no database, otherwise 0.
+ */
+static int
+lookup_realm_db(const char *name, SERVER **authserver, SERVER **acctserver)
+{
+    char key[2 * MAXPATHLEN], *rec;
+    struct realms_stamp st;
+    struct stat sbuf;
+    const char *n;
+    void *data;
+    int len, found;
+
+    if (ppp_db_lock() < 0)
+	return -1;
+    if (stat(radrealms_config, &sbuf) < 0) {
+	error("cannot open %s", radrealms_config);
+	ppp_db_unlock();
+	return 0;
+    }
+    slprintf(key, sizeof(key), "realms:%s", radrealms_config);
+    found = 0;
+    if (ppp_db_fetch(key, &data, &len) == 0) {
+	if (len == sizeof(st)) {
+	    memcpy(&st, data, sizeof(st));
+	    found = same_file(&sbuf, &st);
+	}
+	free(data);
+    }
+    if (!found)
+	compile_realms_db(&sbuf);
+
+    /* the realm itself, then the longest ".example.com" it is under */
+    found = 0;
+    for (n = name; n != NULL; n = strchr(n + 1, '.')) {
+	slprintf(key, sizeof(key), "realm:%s:%s", radrealms_config, n);
+	if (ppp_db_fetch(key, &data, &len) == 0) {
+	    found = 1;
+	    break;
+	}
+    }
+    ppp_db_unlock();
+
+    if (!found) {
+	if (strcmp(name, "DEFAULT") != 0)
+	    info("No servers for realm %s", name);
+	else
+	    info("No servers for DEFAULT realm");
+	return 0;
+    }
+    info("Using servers for realm %s", n);
+    rec = malloc(len + 1);
+    if (rec != NULL) {
+	memcpy(rec, data, len);
+	rec[len] = 0;
+	if (set_servers(&db_acct, "acct", rec) > 0)
+	    *acctserver = &db_acct;
+	if (set_servers(&db_auth, "auth", rec) > 0)
+	    *authserver = &db_auth;
+	free(rec);
+    }
+    free(data);
+    return 0;
+}
+
+static void
+lookup_realm(char const *user,
+	     SERVER **authserver,
+	     SERVER **acctserver)
+{
+    char *realm;
+    struct realm *r;
+
+    realm = strrchr(user, '@');
+    if (realm) {
+	if (*(++realm) == '\0') {
+	    realm = NULL;
+	}
+    }
+
+    if (lookup_realm_db(realm? realm: "DEFAULT", authserver, acctserver) == 0)
+	return;
+
+    load_realms();
+    if (realms == NULL)
+	return;
+
+    r = find_realm(realms, realm? realm: "DEFAULT");
+    if (r == NULL) {
+	if (realm)
+	    info("No servers for realm %s", realm);
+	else
+	    info("No servers for DEFAULT realm");
+	return;
+    }
+    info("Using servers for realm %s", r->name);
+
+    if (r->acct.max) {
+	*acctserver = &r->acct;
+	realms->in_use = 1;
+    }
+    if (r->auth.max) {
+	*authserver = &r->auth;
+	realms->in_use = 1;
+    }
 }
 
 void
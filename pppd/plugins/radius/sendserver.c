@@ -19,6 +19,7 @@
 
 static void rc_random_vector (unsigned char *);
 static int rc_check_reply (AUTH_HDR *, int, char *, unsigned char *, unsigned char);
+static unsigned char *rc_find_attr (AUTH_HDR *, int, int);
 
 /*
  * Function: rc_pack_list
@@ -207,6 +208,7 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 	int		secretlen;
 	char            secret[MAX_SECRET_LENGTH + 1];
 	unsigned char   vector[AUTH_VECTOR_LEN];
+	unsigned char  *ma;
 	char            recv_buffer[BUFFER_LEN];
 	char            send_buffer[BUFFER_LEN];
 	int		retries;
@@ -283,6 +285,15 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 		total_length = rc_pack_list(data->send_pairs, secret, auth) + AUTH_HDR_LEN;
 
 		auth->length = htons ((unsigned short) total_length);
+
+		/* Sign the request if it has a Message-Authenticator (RFC 3579) */
+		ma = rc_find_attr (auth, total_length, PW_MESSAGE_AUTHENTICATOR);
+		if (ma != NULL && ma[1] == AUTH_VECTOR_LEN + 2)
+		{
+			memset (ma + 2, 0, AUTH_VECTOR_LEN);
+			rc_hmac_md5 (ma + 2, (unsigned char *) auth, total_length,
+				     (unsigned char *) secret, strlen (secret));
+		}
 	}
 
 	sin = (struct sockaddr_in *) & saremote;
@@ -374,6 +385,10 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 	{
 		result = OK_RC;
 	}
+	else if (recv_auth->code == PW_ACCESS_CHALLENGE)
+	{
+		result = CHALLENGE_RC;
+	}
 	else
 	{
 		result = BADRESP_RC;
@@ -399,6 +414,7 @@ static int rc_check_reply (AUTH_HDR *auth, int bufferlen, char *secret,
 	int             totallen;
 	unsigned char   calc_digest[AUTH_VECTOR_LEN];
 	unsigned char   reply_digest[AUTH_VECTOR_LEN];
+	unsigned char  *ma;
 
 	totallen = ntohs (auth->length);
 
@@ -467,10 +483,66 @@ static int rc_check_reply (AUTH_HDR *auth, int bufferlen, char *secret,
 		return (BADRESP_RC);
 	}
 
+	/*
+	 * Check the Message-Authenticator, which is computed with the
+	 * Request Authenticator (now in auth->vector) in place of the
+	 * Response Authenticator, and which has to be there if the reply
+	 * carries EAP (RFC 3579).
+	 */
+	ma = rc_find_attr (auth, totallen, PW_MESSAGE_AUTHENTICATOR);
+	if (ma == NULL)
+	{
+		if (rc_find_attr (auth, totallen, PW_EAP_MESSAGE) != NULL)
+		{
+			error("rc_check_reply: RADIUS server response has EAP-Message but no Message-Authenticator");
+			return (BADRESP_RC);
+		}
+		return (OK_RC);
+	}
+	if (ma[1] != AUTH_VECTOR_LEN + 2)
+	{
+		error("rc_check_reply: received Message-Authenticator with invalid length");
+		return (BADRESP_RC);
+	}
+	memcpy ((char *) reply_digest, (char *) ma + 2, AUTH_VECTOR_LEN);
+	memset (ma + 2, 0, AUTH_VECTOR_LEN);
+	rc_hmac_md5 (calc_digest, (unsigned char *) auth, totallen,
+		     (unsigned char *) secret, secretlen);
+	memcpy ((char *) ma + 2, (char *) reply_digest, AUTH_VECTOR_LEN);
+	if (memcmp ((char *) reply_digest, (char *) calc_digest,
+		    AUTH_VECTOR_LEN) != 0)
+	{
+		error("rc_check_reply: received invalid Message-Authenticator from RADIUS server");
+		return (BADRESP_RC);
+	}
+
 	return (OK_RC);
 
 }
 
+/*
+ * Function: rc_find_attr
+ *
+ * Purpose: find an attribute in a packed RADIUS packet.
+ *
+ * Returns: a pointer to the attribute's type octet, or NULL.
+ *
+ */
+
+static unsigned char *rc_find_attr (AUTH_HDR *auth, int totallen, int type)
+{
+	unsigned char   *ptr = auth->data;
+	unsigned char   *end = (unsigned char *) auth + totallen;
+
+	while (ptr + 2 <= end && ptr[1] >= 2 && ptr + ptr[1] <= end)
+	{
+		if (ptr[0] == type)
+			return (ptr);
+		ptr += ptr[1];
+	}
+	return (NULL);
+}
+
 /*
  * Function: rc_random_vector
  *
@@ -160,6 +160,8 @@ extern bool	modem;		/* Use modem control lines */
 extern int	inspeed;	/* Input/Output speed requested */
 extern u_int32_t netmask;	/* IP netmask to set on interface */
 extern bool	lockflag;	/* Create lock file to lock the serial dev */
+extern char	*lock_manager;	/* Socket of lock manager to get locks from */
+extern char	*device_pool;	/* Set of devices to choose one from */
 extern bool	nodetach;	/* Don't detach from controlling tty */
 #ifdef SYSTEMD
 extern bool	up_sdnotify;	/* Notify systemd once link is up (implies nodetach) */
@@ -177,6 +179,22 @@ extern bool	auth_required;	/* Peer is required to authenticate */
 extern bool	persist;	/* Reopen link after it goes down */
 extern bool	uselogin;	/* Use /etc/passwd for checking PAP */
 extern bool	session_mgmt;	/* Do session management (login records) */
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+extern bool	session_db;	/* Keep login records in the pppd database */
+extern int	wtmp_batch;	/* # wtmp records to write at once */
+#endif
+extern bool	negotiation_cache; /* Start from the options agreed last time */
+#ifdef PPP_WITH_TDB
+extern int	admit_rate;	/* New sessions admitted per second */
+extern int	admit_burst;	/* # sessions admitted at once */
+extern int	admit_max_wait;	/* Max secs to wait for admission */
+extern int	admit_recent;	/* Secs a reconnecting peer gets priority */
+extern int	auth_fail_limit; /* Failures before peer is held off */
+extern int	auth_fail_window; /* Secs after which failures are forgotten */
+extern int	auth_fail_holdoff; /* Initial holdoff after too many failures */
+extern int	auth_fail_holdoff_max; /* Longest holdoff */
+extern int	db_gc_interval;	/* Secs between database collections */
+#endif
 extern char	our_name[MAXNAMELEN];/* Our name for authentication purposes */
 extern char	remote_name[MAXNAMELEN]; /* Peer's name for authentication */
 extern char	path_upapfile[];/* Pathname of pap-secrets file */
@@ -187,6 +205,8 @@ extern char	*ipparam;	/* Extra parameter for ip up/down scripts */
 extern bool	cryptpap;	/* Others' PAP passwords are encrypted */
 extern int	holdoff;	/* Dead time before restarting */
 extern bool	holdoff_specified; /* true if user gave a holdoff value */
+extern int	holdoff_max;	/* Longest backoff between failed connections */
+extern int	holdoff_reset;	/* Secs up before the backoff is reset */
 extern bool	notty;		/* Stdin/out is not a tty */
 extern char	*pty_socket;	/* Socket to connect to pty */
 extern char	*record_file;	/* File to record chars sent/received */
@@ -205,6 +225,7 @@ extern char	path_ippreup[];	/* pathname of ip-pre-up script */
 extern char	req_ifname[]; /* interface name to use (IFNAMSIZ) */
 #ifdef __linux__
 extern char	req_vrf[];	/* VRF name to bind with PPP interface */
+extern bool	recheck_kernel;	/* ignore cached kernel features */
 #endif
 extern bool	multilink;	/* enable multilink operation (options.c) */
 extern bool	noendpoint;	/* don't send or accept endpt. discrim. */
@@ -212,6 +233,10 @@ extern char	*bundle_name;	/* bundle name for multilink */
 extern bool	dump_options;	/* print out option values */
 extern bool	show_options;	/* show all option names and descriptions */
 extern bool	dryrun;		/* check everything, print options, exit */
+extern bool	startup_profile; /* log time taken by startup stages */
+extern bool	cpu_accounting;	/* measure CPU time per subsystem */
+extern bool	cpu_accounting_log; /* log CPU usage at disconnect */
+extern int	cpu_accounting_interval; /* secs between CPU usage updates */
 extern int	child_wait;	/* # seconds to wait for children at end */
 extern char *current_option;    /* the name of the option being parsed */
 extern int  privileged_option;  /* set iff the current option came from root */
@@ -327,9 +352,57 @@ void remove_pidfiles(void);
 void lock_db(void);
 void unlock_db(void);
 
+/* Procedures exported from session.c. */
+void session_flush(void);	/* Write out the wtmp records we queued */
+
+/* Procedures exported from cpu-acct.c. */
+#define CPU_ACCT_PROTO	0	/* id is a protocol number */
+#define CPU_ACCT_TIMER	1	/* id is a timeout routine */
+#define CPU_ACCT_FD	2	/* id is an fd callback */
+struct timespec;
+void cpu_acct_init(void);	/* Start publishing CPU usage */
+void cpu_acct_start(struct timespec *);
+				/* Note CPU time before a call */
+void cpu_acct_end(struct timespec *, int, uintptr_t);
+				/* Charge CPU time since cpu_acct_start */
+void cpu_acct_report(int);	/* Publish (and maybe log) CPU usage */
+
+/* Procedures exported from dbgc.c. */
+void dbgc_init(void);		/* Start removing stale database records */
+
+/* Procedures exported from admit.c. */
+int  admit_request(int *);	/* Ask to start authenticating */
+void admit_cancel(void);	/* Give back an unused admission */
+void admit_note_peer(void);	/* Note that the peer got connected */
+int  admit_seen_expired(const void *, int);
+				/* Can this record be removed? */
+
+/* Procedures exported from backoff.c. */
+int  backoff_pending(void);	/* Secs to wait before the first attempt */
+int  backoff_next(int, int, int); /* Secs to wait before the next attempt */
+
+/* Procedures exported from authfail.c. */
+int  authfail_blocked(char *);	/* Reject this peer without checking? */
+void authfail_record(char *, int); /* Count a failure or clear the count */
+int  authfail_expired(const void *, int); /* Can this record be removed? */
+
+/* Procedures exported from negcache.c. */
+struct fsm;
+int  negcache_fetch(struct fsm *, void *, int);
+				/* Get the options agreed last time */
+void negcache_store(struct fsm *, const void *, int);
+				/* Save the options agreed this time */
+
+/* Procedures exported from mempool.c. */
+void mempool_compact(void);	/* Free empty slabs and publish usage */
+
 /* Procedures exported from tty.c. */
 void tty_init(void);
 
+/* Procedures exported from modem.c. */
+int  modem_chat(int, char *, int, int);
+				/* Dial out with expect/send strings */
+
 void print_string(char *, int,  printer_func, void *);
 				/* Format a string for output */
 ssize_t complete_read(int, void *, size_t);
@@ -399,6 +472,7 @@ void clean_check(void);	/* Check if line was 8-bit clean */
 void set_up_tty(int, int); /* Set up port's speed, parameters, etc. */
 void restore_tty(int);	/* Restore port's original parameters */
 void setdtr(int, int);	/* Raise or lower port's DTR line */
+int  tty_ready(int, int); /* Check modem lines say port is ready */
 void output(int, unsigned char *, int); /* Output a PPP packet */
 int  read_packet(unsigned char *); /* Read PPP packet */
 int  get_loop_output(void); /* Read pkts from loopback */
@@ -417,6 +491,11 @@ int  get_idle_time(int, struct ppp_idle *);
 				/* Find out how long link has been idle */
 int  get_ppp_stats(int, struct pppd_stats *);
 				/* Return link statistics */
+int  get_ppp_comp_stats(int, struct ppp_comp_stats *);
+				/* Return compression statistics */
+int  get_ppp_vj_stats(int, struct vjstat *);
+				/* Return VJ compression statistics */
+int  ppp_bridge_channel(int);	/* Bridge our channel to fd's in the kernel */
 int  sifvjcomp(int, int, int, int);
 				/* Configure VJ TCP header compression */
 int  sifup(int);		/* Configure i/f up for one protocol */
@@ -0,0 +1,151 @@
+/*
+ * pppd-utmp - export the login records which pppd keeps in its
+ * database with the session-db option.
+ *
+ * Copyright (c) 2007 Diego Rivera. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * 3. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Paul Mackerras
+ *     <paulus@ozlabs.org>".
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Usage:
+ *	pppd-utmp [-d database] [-f] [-w wtmp] [-o file]
+ *
+ * With -o, writes the login records as a utmp file, which who(1) and
+ * similar programs can be pointed at.  With -f, writes any queued
+ * records to wtmp now.  With neither, lists the logins.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <paths.h>
+#include <sys/param.h>
+
+#include "pathnames.h"
+#include "utmpdb.h"
+
+/* tdb.c uses this when creating the database, which we never do */
+int
+mkdir_recursive(const char *path)
+{
+    return -1;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: pppd-utmp [-d database] [-f] [-w wtmp] [-o file]\n");
+    exit(2);
+}
+
+static int
+list_one(TDB_CONTEXT *db, TDB_DATA key, TDB_DATA rec, void *arg)
+{
+    struct utmp ut;
+    time_t t;
+    char tbuf[32];
+
+    if (key.dsize <= strlen(UTMPDB_KEY_PREFIX)
+	|| memcmp(key.dptr, UTMPDB_KEY_PREFIX, strlen(UTMPDB_KEY_PREFIX)) != 0
+	|| rec.dsize != sizeof(ut))
+	return 0;
+    memcpy(&ut, rec.dptr, sizeof(ut));
+    t = ut.ut_tv.tv_sec;
+    strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M", localtime(&t));
+    printf("%-12.*s %-12.*s %s %.*s\n", (int) sizeof(ut.ut_user), ut.ut_user,
+	   (int) sizeof(ut.ut_line), ut.ut_line, tbuf,
+	   (int) sizeof(ut.ut_host), ut.ut_host);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    char *dbname = PPP_PATH_PPPDB;
+    char *wtmp = _PATH_WTMP;
+    char *outfile = NULL;
+    char tmp[MAXPATHLEN];
+    int flush = 0;
+    int c, fd, status = 0;
+    TDB_CONTEXT *db;
+
+    while ((c = getopt(argc, argv, "d:fw:o:")) != -1) {
+	switch (c) {
+	case 'd':
+	    dbname = optarg;
+	    break;
+	case 'f':
+	    flush = 1;
+	    break;
+	case 'w':
+	    wtmp = optarg;
+	    break;
+	case 'o':
+	    outfile = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc)
+	usage();
+
+    db = tdb_open(dbname, 0, 0, flush? O_RDWR: O_RDONLY, 0);
+    if (db == NULL) {
+	perror(dbname);
+	exit(1);
+    }
+
+    if (flush && utmpdb_flush_wtmp(db, wtmp) < 0) {
+	perror(wtmp);
+	status = 1;
+    }
+
+    if (outfile != NULL) {
+	/* write a new file and rename it, so readers never see half of it */
+	snprintf(tmp, sizeof(tmp), "%s.%d", outfile, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+	    perror(tmp);
+	    exit(1);
+	}
+	if (utmpdb_export(db, fd) < 0 || close(fd) < 0
+	    || rename(tmp, outfile) < 0) {
+	    perror(outfile);
+	    unlink(tmp);
+	    status = 1;
+	}
+    } else if (!flush)
+	tdb_traverse(db, list_one, NULL);
+
+    tdb_close(db);
+    return status;
+}
@@ -435,6 +435,37 @@ void ppp_script_setenv(char *, char *, int);
  */
 void ppp_script_unsetenv(char *);
 
+/*
+ * Store, fetch or delete a record in the pppd database, for plugins
+ * which share information with other pppd instances or with external
+ * programs.  ppp_db_fetch returns a malloc'd copy of the record, which
+ * the caller must free.  All return 0 on success, or -1 on failure or
+ * if pppd has no database.
+ */
+int ppp_db_store(const char *key, const void *data, int len);
+int ppp_db_fetch(const char *key, void **data, int *len);
+int ppp_db_delete(const char *key);
+
+/*
+ * Take and release a lock on the pppd database which is shared by all
+ * pppd instances, for plugins which need to read and update several
+ * records atomically.  ppp_db_lock returns 0 on success, or -1 if pppd
+ * has no database.
+ */
+int ppp_db_lock(void);
+void ppp_db_unlock(void);
+
+/*
+ * Pools of fixed-size objects, for state which is allocated and freed
+ * often during a session.  Objects are kept together in slabs rather
+ * than scattered through the heap, and empty slabs are given back when
+ * the link goes down.  ppp_pool_alloc returns NULL if out of memory.
+ */
+struct ppp_pool;
+struct ppp_pool *ppp_pool_create(const char *name, size_t size);
+void *ppp_pool_alloc(struct ppp_pool *pool);
+void ppp_pool_free(struct ppp_pool *pool, void *obj);
+
 /*
  * Test whether ppp kernel support exists
  */
@@ -510,6 +541,19 @@ int ppp_set_pppdevnam(const char *name);
  */
 const char *ppp_pppdevnam();
 
+/*
+ * In a process forked by a plugin to run a link of its own, leave the
+ * pid files to the process it was forked from.
+ */
+void ppp_forget_pidfiles(void);
+
+/*
+ * In a process forked by a plugin to run a link of its own, reseed the
+ * random number generator, so that its magic numbers and challenges
+ * differ from those of the process it was forked from.
+ */
+void ppp_reseed(void);
+
 /*
  * Get the current devnam, e.g. /dev/ttyS0, /dev/ptmx
  */
@@ -564,6 +608,78 @@ extern int  (*allowed_address_hook)(uint32_t addr);
 extern void (*snoop_recv_hook)(unsigned char *p, int len);
 extern void (*snoop_send_hook)(unsigned char *p, int len);
 
+/*
+ * Called once the peer has authenticated.  To hand the session on to
+ * another channel (for example an L2TP session, for a LAC), return a
+ * file descriptor for that channel, and pppd will have the kernel
+ * bridge the two; otherwise return -1.
+ */
+extern int (*bridge_hook)(void);
+
+/*
+ * Running the protocol engine from another program's event loop, as
+ * with libpppd.  The program calls ppp_engine_init, sets its options
+ * (with ppp_options_from_file, for example), and calls ppp_engine_open
+ * once its link is up.  It then passes each frame it receives to
+ * ppp_input_frame, and calls ppp_advance_time whenever the time that
+ * ppp_advance_time last returned, or that timer_arm_hook was last
+ * given, has passed.  Frames sent go to frame_out_hook, if it is set,
+ * instead of to the channel.  To be told the negotiated parameters,
+ * the program may point the_channel at a channel of its own after
+ * ppp_engine_init.  There is no ppp unit, so the program sets
+ * iface_config_hook and configures its own interface when asked.
+ *
+ * There is one engine per process, for one link: as in pppd, the
+ * protocols keep their state in globals, and these hooks are global
+ * too.  A program which serves many sessions runs each in a process
+ * of its own, as the pppoe-server option does by forking.
+ */
+extern void (*frame_out_hook)(int unit, unsigned char *p, int len);
+extern void (*timer_arm_hook)(int msecs);
+
+/*
+ * What iface_config_hook is asked to do.  UP and DOWN come once from
+ * each network protocol; the interface should stay up until both IPCP
+ * and IPv6CP have said DOWN.
+ */
+typedef enum ppp_iface_op {
+    PPP_IFACE_UP,		/* proto wants the interface up */
+    PPP_IFACE_DOWN,		/* proto is done with it */
+    PPP_IFACE_ADDR,		/* set the IPv4 addresses and netmask */
+    PPP_IFACE_CLEAR_ADDR,	/* remove them */
+    PPP_IFACE_ADDR6,		/* set the IPv6 link-local addresses */
+    PPP_IFACE_CLEAR_ADDR6,	/* remove them */
+    PPP_IFACE_NPMODE,		/* pass, drop or queue proto's packets */
+    PPP_IFACE_MTU,		/* set the MTU */
+} ppp_iface_op_t;
+
+struct ppp_iface_config {
+    int proto;			/* PPP_IP or PPP_IPV6 */
+    uint32_t ouraddr;		/* IPv4 addresses, network byte order */
+    uint32_t hisaddr;
+    uint32_t netmask;
+    uint8_t ourid[8];		/* IPv6 interface identifiers */
+    uint8_t hisid[8];
+    int npmode;			/* an enum NPmode from <net/ppp_defs.h> */
+    int mtu;
+};
+
+/*
+ * If set, called instead of configuring the kernel's ppp interface.
+ * Returns 1 on success, 0 on failure, which takes the protocol down.
+ * Default routes and proxy ARP entries are still made in the system's
+ * tables, if asked for.
+ */
+extern int (*iface_config_hook)(int unit, ppp_iface_op_t op,
+				struct ppp_iface_config *cfg);
+
+void ppp_engine_init(void);	/* Initialize the protocols */
+void ppp_engine_open(void);	/* The link is up: start LCP */
+void ppp_engine_close(char *reason); /* Take the link down */
+void ppp_input_frame(unsigned char *p, int len); /* Process a frame */
+int  ppp_advance_time(void);	/* Run due timeouts; returns ms to next */
+int  ppp_main(int argc, char *argv[]); /* pppd's main(), in libpppd */
+
 /* mechanism to setup event handlers */
 typedef void (*event_cb)(int fd, void* ctx); /* callback signature */
 void add_fd_callback(int, event_cb, void*); /* add fd with callback */
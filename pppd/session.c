@@ -96,6 +96,14 @@
 #include <security/pam_appl.h>
 #endif /* #ifdef PPP_WITH_PAM */
 
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+#include <sys/time.h>
+#include "tdb.h"
+#include "utmpdb.h"
+
+extern TDB_CONTEXT *pppdb;
+#endif
+
 #define SET_MSG(var, msg) if (var != NULL) { var[0] = msg; }
 #define COPY_STRING(s) ((s) ? strdup(s) : NULL)
 
@@ -109,6 +117,9 @@
 /* We have successfully started a session */
 static bool logged_in = 0;
 
+static void session_logwtmp(const char *line, const char *name,
+			    const char *host);
+
 #ifdef PPP_WITH_PAM
 /*
  * Static variables used to communicate between the conversation function
@@ -367,7 +378,7 @@ session_start(const int flags, const char *user, const char *passwd, const char
     if (SESS_ACCT & flags) {
 	if (strncmp(ttyName, "/dev/", 5) == 0)
 	    ttyName += 5;
-	logwtmp(ttyName, user, ifname); /* Add wtmp login entry */
+	session_logwtmp(ttyName, user, ifname); /* Add wtmp login entry */
 	logged_in = 1;
 
 #if defined(_PATH_LASTLOG) && !defined(PPP_WITH_PAM)
@@ -420,7 +431,78 @@ session_end(const char* ttyName)
     if (logged_in) {
 	if (strncmp(ttyName, "/dev/", 5) == 0)
 	    ttyName += 5;
-	logwtmp(ttyName, "", ""); /* Wipe out utmp logout entry */
+	session_logwtmp(ttyName, "", ""); /* Wipe out utmp logout entry */
 	logged_in = 0;
     }
 }
+
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+static bool wtmp_queued;	/* we have queued records for wtmp */
+
+/*
+ * wtmp_flush_timer - write out the queue once the records we put in
+ * it have waited long enough, in case nobody else has.
+ */
+static void
+wtmp_flush_timer(void *arg)
+{
+    wtmp_queued = 0;
+    if (pppdb != NULL && utmpdb_flush_wtmp(pppdb, _PATH_WTMP) < 0)
+	warn("error writing %s: %m", _PATH_WTMP);
+}
+#endif
+
+/*
+ * session_flush - write out any wtmp records we have queued, as we
+ * are about to exit.
+ */
+void
+session_flush(void)
+{
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+    if (wtmp_queued) {
+	UNTIMEOUT(wtmp_flush_timer, NULL);
+	wtmp_flush_timer(NULL);
+    }
+#endif
+}
+
+/*
+ * session_logwtmp - record a login or logout in utmp and wtmp, or
+ * with the session-db option, in the pppd database.  There a login
+ * record is found by a hash lookup on the line rather than a scan of
+ * utmp, and wtmp records are appended in batches.  Each pppd writes
+ * out the queue WTMPDB_MAX_AGE seconds after it adds to it, or when it
+ * exits, unless another pppd has done so already.
+ */
+static void
+session_logwtmp(const char *line, const char *name, const char *host)
+{
+#if defined(PPP_WITH_TDB) && defined(__linux__)
+    struct utmp ut;
+    struct timeval now;
+
+    if (session_db && pppdb != NULL) {
+	memset(&ut, 0, sizeof(ut));
+	ut.ut_type = name[0]? USER_PROCESS: DEAD_PROCESS;
+	ut.ut_pid = getpid();
+	strncpy(ut.ut_line, line, sizeof(ut.ut_line));
+	strncpy(ut.ut_user, name, sizeof(ut.ut_user));
+	strncpy(ut.ut_host, host, sizeof(ut.ut_host));
+	gettimeofday(&now, NULL);
+	ut.ut_tv.tv_sec = now.tv_sec;
+	ut.ut_tv.tv_usec = now.tv_usec;
+
+	if (utmpdb_update(pppdb, &ut) < 0)
+	    warn("Couldn't store login record for %s", line);
+	if (utmpdb_queue_wtmp(pppdb, &ut, wtmp_batch, _PATH_WTMP) < 0)
+	    warn("error writing %s: %m", _PATH_WTMP);
+	if (wtmp_batch > 1 && !wtmp_queued) {
+	    wtmp_queued = 1;
+	    TIMEOUT(wtmp_flush_timer, NULL, WTMPDB_MAX_AGE);
+	}
+	return;
+    }
+#endif
+    logwtmp(line, name, host);
+}
@@ -146,6 +146,7 @@
 #include "options.h"
 #include "fsm.h"
 #include "ipcp.h"
+#include "pathnames.h"
 
 #ifdef PPP_WITH_IPV6CP
 #include "eui64.h"
@@ -214,6 +215,7 @@ static int sock6_fd = -1;
 int ppp_dev_fd = -1;		/* fd for /dev/ppp (new style driver) */
 
 static int chindex;		/* channel index (new style driver) */
+static int bridged;		/* channel is bridged to another */
 
 static unsigned routing_table_id = RT_TABLE_MAIN;
 
@@ -245,6 +247,22 @@ static struct utsname utsname;	/* for the kernel version */
 static int kernel_version;
 #define KVERSION(j,n,p)	((j)*1000000 + (n)*1000 + (p))
 
+/*
+ * What we have found out about the kernel, which is remembered across
+ * pppd instances in PPP_PATH_KFEATURES until the next reboot.
+ * For each field, 0 means we don't know yet.
+ */
+#define KFEATURES_VERSION	1
+#define KF_STATS_RTNETLINK	1
+#define KF_STATS_SYSFS		2
+#define KF_STATS_IOCTL		3
+static struct kernel_features {
+    int		driver;		/* 1 => new-style driver via /dev/ppp */
+    int		stats;		/* how to get statistics, KF_STATS_* */
+    int		newlink;	/* 1 => RTM_NEWLINK works, -1 => doesn't */
+} kfeatures;
+static char boot_id[40];	/* identifies this boot of the kernel */
+
 #define MAX_IFS		100
 
 #define FLAGS_GOOD (IFF_UP          | IFF_BROADCAST)
@@ -267,6 +285,7 @@ static int set_kdebugflag(int level);
 static int ppp_registered(void);
 static int make_ppp_unit(void);
 static int setifstate (int u, int state);
+static void save_kernel_features(void);
 
 extern u_char	inpacket_buf[];	/* borrowed from main.c */
 
@@ -773,6 +792,11 @@ flushfailed:
 void ppp_generic_disestablish(int dev_fd)
 {
     if (new_style_driver) {
+#ifdef PPPIOCUNBRIDGECHAN
+	if (bridged && ioctl(ppp_fd, PPPIOCUNBRIDGECHAN) < 0)
+	    warn("Couldn't unbridge channel %d: %m", chindex);
+#endif
+	bridged = 0;
 	close(ppp_fd);
 	ppp_fd = -1;
 	if (demand) {
@@ -792,6 +816,45 @@ void ppp_generic_disestablish(int dev_fd)
     }
 }
 
+/********************************************************************
+ *
+ * ppp_bridge_channel - have the kernel pass all the frames received on
+ * our channel to the channel which fd belongs to (a PPPoL2TP session
+ * socket, say) and vice versa.  Our channel is first disconnected from
+ * the ppp unit, since a bridged channel can't belong to one.
+ */
+int ppp_bridge_channel(int fd)
+{
+#ifdef PPPIOCBRIDGECHAN
+    int other;
+
+    if (!new_style_driver || ppp_fd < 0) {
+	error("Channel bridging needs the ppp_generic driver");
+	return -1;
+    }
+    if (ioctl(fd, PPPIOCGCHAN, &other) < 0) {
+	error("Couldn't get channel number to bridge to: %m");
+	return -1;
+    }
+    if (ioctl(ppp_fd, PPPIOCDISCONN) < 0 && errno != EINVAL) {
+	error("Couldn't disconnect channel %d from unit: %m", chindex);
+	return -1;
+    }
+    if (ioctl(ppp_fd, PPPIOCBRIDGECHAN, &other) < 0) {
+	error("Couldn't bridge channel %d to channel %d: %m", chindex, other);
+	if (!multilink && ioctl(ppp_fd, PPPIOCCONNECT, &ifunit) < 0)
+	    error("Couldn't reattach to PPP unit %d: %m", ifunit);
+	return -1;
+    }
+    bridged = 1;
+    info("Channel %d bridged to channel %d", chindex, other);
+    return 0;
+#else
+    error("Channel bridging is not supported on this system");
+    return -1;
+#endif
+}
+
 /********************************************************************
  *
  * get_vrf_table_id - get the routing table id of a VRF from its ifindex.
@@ -1006,10 +1069,15 @@ static int make_ppp_unit(void)
 	 * So use rtnetlink API only when user requested custom ifname. It will
 	 * avoid system issues with interface renaming.
 	 */
-	if (req_unit == -1 && req_ifname[0] != '\0' && kernel_version >= KVERSION(2,1,16)) {
+	if (req_unit == -1 && req_ifname[0] != '\0' && kernel_version >= KVERSION(2,1,16)
+	    && kfeatures.newlink >= 0) {
 	    if (make_ppp_unit_rtnetlink(vrf_ifindex)) {
 		if (ioctl(ppp_dev_fd, PPPIOCGUNIT, &ifunit))
 		    fatal("Couldn't retrieve PPP unit id: %m");
+		if (kfeatures.newlink == 0) {
+		    kfeatures.newlink = 1;
+		    save_kernel_features();
+		}
 		return 0;
 	    }
 	    /*
@@ -1018,6 +1086,11 @@ static int make_ppp_unit(void)
 	     */
 	    if (errno == EEXIST)
 		return -1;
+	    /* The kernel doesn't know how to create ppp interfaces this way */
+	    if (errno == EOPNOTSUPP && kfeatures.newlink == 0) {
+		kfeatures.newlink = -1;
+		save_kernel_features();
+	    }
 	}
 
 	ifunit = req_unit;
@@ -1495,6 +1568,27 @@ void setdtr (int tty_fd, int on)
     ioctl(tty_fd, (on ? TIOCMBIS : TIOCMBIC), &modembits);
 }
 
+/********************************************************************
+ *
+ * tty_ready - check the modem control lines to see whether the
+ * device looks ready for use: DSR must be asserted, and CD too if
+ * need_carrier is set.  Returns 1 if ready, 0 if not, or -1 if the
+ * device doesn't have modem control lines.
+ */
+
+int tty_ready (int tty_fd, int need_carrier)
+{
+    int modembits;
+
+    if (ioctl(tty_fd, TIOCMGET, &modembits) < 0)
+	return -1;
+    if ((modembits & TIOCM_DSR) == 0)
+	return 0;
+    if (need_carrier && (modembits & TIOCM_CAR) == 0)
+	return 0;
+    return 1;
+}
+
 /********************************************************************
  *
  * restore_tty - restore the terminal to the saved settings.
@@ -1532,6 +1626,10 @@ void output (int unit, unsigned char *p, int len)
 
     dump_packet("sent", p, len);
     if (snoop_send_hook) snoop_send_hook(p, len);
+    if (frame_out_hook) {
+	(*frame_out_hook)(unit, p, len);
+	return;
+    }
 
     if (len < PPP_HDRLEN)
 	return;
@@ -1634,6 +1732,12 @@ ppp_set_mtu(int unit, int mtu)
 {
     struct ifreq ifr;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .mtu = mtu };
+	(*iface_config_hook)(unit, PPP_IFACE_MTU, &c);
+	return;
+    }
+
     memset (&ifr, '\0', sizeof (ifr));
     strlcpy(ifr.ifr_name, ifname, sizeof (ifr.ifr_name));
     ifr.ifr_mtu = mtu;
@@ -2007,23 +2111,84 @@ int get_ppp_stats(int u, struct pppd_stats *stats)
 {
     static int (*func)(int, struct pppd_stats*) = NULL;
 
+    /* An earlier pppd may already have found which method works */
+    if (!func) {
+	switch (kfeatures.stats) {
+	case KF_STATS_RTNETLINK:
+	    func = get_ppp_stats_rtnetlink;
+	    break;
+	case KF_STATS_SYSFS:
+	    func = get_ppp_stats_sysfs;
+	    break;
+	case KF_STATS_IOCTL:
+	    func = get_ppp_stats_ioctl;
+	    TIMEOUT(ppp_stats_poller, (void*)(long)u, 25);
+	    break;
+	}
+    }
     if (!func) {
 	if (get_ppp_stats_rtnetlink(u, stats)) {
 	    func = get_ppp_stats_rtnetlink;
+	    kfeatures.stats = KF_STATS_RTNETLINK;
+	    save_kernel_features();
 	    return 1;
 	}
 	if (get_ppp_stats_sysfs(u, stats)) {
 	    func = get_ppp_stats_sysfs;
+	    kfeatures.stats = KF_STATS_SYSFS;
+	    save_kernel_features();
 	    return 1;
 	}
 	warn("statistics falling back to ioctl which only supports 32-bit counters");
 	func = get_ppp_stats_ioctl;
+	kfeatures.stats = KF_STATS_IOCTL;
+	save_kernel_features();
 	TIMEOUT(ppp_stats_poller, (void*)(long)u, 25);
     }
 
     return func(u, stats);
 }
 
+/********************************************************************
+ *
+ * get_ppp_comp_stats - return the compression statistics for the link.
+ */
+int get_ppp_comp_stats(int u, struct ppp_comp_stats *cstats)
+{
+    struct ifreq req;
+
+    memset (&req, 0, sizeof (req));
+
+    req.ifr_data = (caddr_t) cstats;
+    strlcpy(req.ifr_name, ifname, sizeof(req.ifr_name));
+    if (ioctl(sock_fd, SIOCGPPPCSTATS, &req) < 0) {
+	error("Couldn't get PPP compression statistics: %m");
+	return 0;
+    }
+    return 1;
+}
+
+/********************************************************************
+ *
+ * get_ppp_vj_stats - return the VJ header compression statistics.
+ */
+int get_ppp_vj_stats(int u, struct vjstat *vj)
+{
+    struct ifreq req;
+    struct ppp_stats data;
+
+    memset (&req, 0, sizeof (req));
+
+    req.ifr_data = (caddr_t) &data;
+    strlcpy(req.ifr_name, ifname, sizeof(req.ifr_name));
+    if (ioctl(sock_fd, SIOCGPPPSTATS, &req) < 0) {
+	error("Couldn't get PPP statistics: %m");
+	return 0;
+    }
+    *vj = data.vj;
+    return 1;
+}
+
 /********************************************************************
  *
  * ccp_fatal_error - returns 1 if decompression was disabled as a
@@ -2842,6 +3007,95 @@ ppp_registered(void)
     return ret;
 }
 
+/********************************************************************
+ *
+ * load_kernel_features - read what a previous pppd found out about
+ * the kernel, if it was running on this same boot of this kernel.
+ */
+
+static void load_kernel_features(void)
+{
+    FILE *f;
+    char key[32], value[MAXPATHLEN];
+    int version = 0, same_boot = 0, same_pppd = 0, same_kernel = 0;
+    struct kernel_features kf;
+
+    f = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (f == NULL)
+	return;
+    if (fgets(boot_id, sizeof(boot_id), f) == NULL)
+	boot_id[0] = 0;
+    fclose(f);
+    boot_id[strcspn(boot_id, "\n")] = 0;
+    if (boot_id[0] == 0 || recheck_kernel)
+	return;
+
+    f = fopen(PPP_PATH_KFEATURES, "r");
+    if (f == NULL)
+	return;
+    memset(&kf, 0, sizeof(kf));
+    while (fscanf(f, "%31s %1023s", key, value) == 2) {
+	if (strcmp(key, "version") == 0)
+	    version = atoi(value);
+	else if (strcmp(key, "boot_id") == 0)
+	    same_boot = strcmp(value, boot_id) == 0;
+	else if (strcmp(key, "pppd") == 0)
+	    same_pppd = strcmp(value, VERSION) == 0;
+	else if (strcmp(key, "kernel") == 0)
+	    same_kernel = strcmp(value, utsname.release) == 0;
+	else if (strcmp(key, "driver") == 0)
+	    kf.driver = atoi(value);
+	else if (strcmp(key, "stats") == 0)
+	    kf.stats = atoi(value);
+	else if (strcmp(key, "newlink") == 0)
+	    kf.newlink = atoi(value);
+    }
+    fclose(f);
+
+    if (version != KFEATURES_VERSION || !same_boot || !same_pppd
+	|| !same_kernel)
+	return;
+    if (kf.stats < 0 || kf.stats > KF_STATS_IOCTL)
+	kf.stats = 0;
+    kfeatures = kf;
+    dbglog("Using cached kernel features from %s", PPP_PATH_KFEATURES);
+}
+
+/********************************************************************
+ *
+ * save_kernel_features - record what we know about the kernel so that
+ * other instances of pppd don't have to find it out again.  We write
+ * a new file and rename it so that readers never see a partial file.
+ */
+
+static void save_kernel_features(void)
+{
+    FILE *f;
+    int fd;
+    char tmp[MAXPATHLEN];
+
+    if (boot_id[0] == 0)
+	return;
+    slprintf(tmp, sizeof(tmp), "%s.%d", PPP_PATH_KFEATURES, getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+	return;
+    f = fdopen(fd, "w");
+    if (f == NULL) {
+	close(fd);
+	unlink(tmp);
+	return;
+    }
+    fprintf(f, "version %d\nboot_id %s\npppd %s\nkernel %s\n",
+	    KFEATURES_VERSION, boot_id, VERSION, utsname.release);
+    fprintf(f, "driver %d\nstats %d\nnewlink %d\n",
+	    kfeatures.driver, kfeatures.stats, kfeatures.newlink);
+    if (fclose(f) == EOF || rename(tmp, PPP_PATH_KFEATURES) < 0) {
+	dbglog("Couldn't save kernel features: %m");
+	unlink(tmp);
+    }
+}
+
 /********************************************************************
  *
  * ppp_check_kernel_support - check whether the system has any ppp interfaces
@@ -2862,15 +3116,25 @@ int ppp_check_kernel_support(void)
     sscanf(utsname.release, "%d.%d.%d", &osmaj, &osmin, &ospatch);
     kernel_version = KVERSION(osmaj, osmin, ospatch);
 
-    fd = open("/dev/ppp", O_RDWR);
-    if (fd >= 0) {
+    load_kernel_features();
+
+    /* If an earlier pppd found /dev/ppp works, don't try it again */
+    fd = -1;
+    if (kfeatures.driver != 1) {
+	fd = open("/dev/ppp", O_RDWR);
+	if (fd >= 0) {
+	    close(fd);
+	    kfeatures.driver = 1;
+	    save_kernel_features();
+	}
+    }
+    if (kfeatures.driver == 1) {
 	new_style_driver = 1;
 
 	/* XXX should get from driver */
 	driver_version = 2;
 	driver_modification = 4;
 	driver_patch = 0;
-	close(fd);
 	return 1;
     }
 
@@ -3086,6 +3350,10 @@ int sifup(int u)
 {
     int ret;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IP };
+	return (*iface_config_hook)(u, PPP_IFACE_UP, &c);
+    }
     if ((ret = setifstate(u, 1)))
 	if_is_up++;
 
@@ -3100,6 +3368,10 @@ int sifup(int u)
 
 int sifdown (int u)
 {
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IP };
+	return (*iface_config_hook)(u, PPP_IFACE_DOWN, &c);
+    }
     if (if_is_up && --if_is_up > 0)
 	return 1;
 
@@ -3121,6 +3393,10 @@ int sif6up(int u)
 {
     int ret;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	return (*iface_config_hook)(u, PPP_IFACE_UP, &c);
+    }
     if ((ret = setifstate(u, 1)))
 	if6_is_up = 1;
 
@@ -3135,6 +3411,10 @@ int sif6up(int u)
 
 int sif6down (int u)
 {
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	return (*iface_config_hook)(u, PPP_IFACE_DOWN, &c);
+    }
     if6_is_up = 0;
 
     if (if_is_up)
@@ -3185,6 +3465,14 @@ int sifaddr (int unit, u_int32_t our_adr, u_int32_t his_adr,
     struct ifreq   ifr;
     struct rtentry rt;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = {
+	    .proto = PPP_IP, .ouraddr = our_adr, .hisaddr = his_adr,
+	    .netmask = net_mask
+	};
+	return (*iface_config_hook)(unit, PPP_IFACE_ADDR, &c);
+    }
+
     memset (&ifr, '\0', sizeof (ifr));
     memset (&rt,  '\0', sizeof (rt));
 
@@ -3286,6 +3574,12 @@ int cifaddr (int unit, u_int32_t our_adr, u_int32_t his_adr)
 {
     struct ifreq ifr;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = {
+	    .proto = PPP_IP, .ouraddr = our_adr, .hisaddr = his_adr
+	};
+	return (*iface_config_hook)(unit, PPP_IFACE_CLEAR_ADDR, &c);
+    }
     if (kernel_version < KVERSION(2,1,16)) {
 /*
  *  Delete the route through the device
@@ -3403,6 +3697,13 @@ int sif6addr (int unit, eui64_t our_eui64, eui64_t his_eui64)
     struct in6_rtmsg rt6;
     int ret;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	memcpy(c.ourid, our_eui64.e8, sizeof(c.ourid));
+	memcpy(c.hisid, his_eui64.e8, sizeof(c.hisid));
+	return (*iface_config_hook)(unit, PPP_IFACE_ADDR6, &c);
+    }
+
     if (sock6_fd < 0) {
 	errno = -sock6_fd;
 	error("IPv6 socket creation failed: %m");
@@ -3472,6 +3773,12 @@ int cif6addr (int unit, eui64_t our_eui64, eui64_t his_eui64)
     struct ifreq ifr;
     struct in6_ifreq ifr6;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	memcpy(c.ourid, our_eui64.e8, sizeof(c.ourid));
+	memcpy(c.hisid, his_eui64.e8, sizeof(c.hisid));
+	return (*iface_config_hook)(unit, PPP_IFACE_CLEAR_ADDR6, &c);
+    }
     if (sock6_fd < 0) {
 	errno = -sock6_fd;
 	error("IPv6 socket creation failed: %m");
@@ -3644,6 +3951,10 @@ sifnpmode(int u, int proto, enum NPmode mode)
 {
     struct npioctl npi;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = proto, .npmode = mode };
+	return (*iface_config_hook)(u, PPP_IFACE_NPMODE, &c);
+    }
     npi.protocol = proto;
     npi.mode     = mode;
     if (ioctl(ppp_dev_fd, PPPIOCSNPMODE, (caddr_t) &npi) < 0) {
@@ -1020,6 +1020,26 @@ setdtr(int fd, int on)
     ioctl(fd, (on? TIOCMBIS: TIOCMBIC), &modembits);
 }
 
+/*
+ * tty_ready - check the modem control lines to see whether the
+ * device looks ready for use: DSR must be asserted, and CD too if
+ * need_carrier is set.  Returns 1 if ready, 0 if not, or -1 if the
+ * device doesn't have modem control lines.
+ */
+int
+tty_ready(int fd, int need_carrier)
+{
+    int modembits;
+
+    if (ioctl(fd, TIOCMGET, &modembits) < 0)
+	return -1;
+    if ((modembits & TIOCM_DSR) == 0)
+	return 0;
+    if (need_carrier && (modembits & TIOCM_CAR) == 0)
+	return 0;
+    return 1;
+}
+
 /*
  * open_loopback - open the device we use for getting packets
  * in demand mode.  Under Solaris 2, we use our existing fd
@@ -1043,6 +1063,10 @@ output(int unit, u_char *p, int len)
 
     dump_packet("sent", p, len);
     if (snoop_send_hook) snoop_send_hook(p, len);
+    if (frame_out_hook) {
+	(*frame_out_hook)(unit, p, len);
+	return;
+    }
 
     data.len = len;
     data.buf = (caddr_t) p;
@@ -1125,6 +1149,12 @@ ppp_set_mtu(int unit, int mtu)
     struct lifreq lifr;
     int	fd;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .mtu = mtu };
+	(*iface_config_hook)(unit, PPP_IFACE_MTU, &c);
+	return;
+    }
+
     memset(&ifr, 0, sizeof(ifr));
     strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
     ifr.ifr_metric = mtu;
@@ -1300,6 +1330,45 @@ get_ppp_stats(int u, struct pppd_stats *stats)
     return 1;
 }
 
+/*
+ * get_ppp_comp_stats - return the compression statistics for the link.
+ */
+int
+get_ppp_comp_stats(int u, struct ppp_comp_stats *cstats)
+{
+    if (strioctl(pppfd, PPPIO_GETCSTAT, cstats, 0, sizeof(*cstats)) < 0) {
+	error("Couldn't get compression statistics: %m");
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * get_ppp_vj_stats - return the VJ header compression statistics.
+ */
+int
+get_ppp_vj_stats(int u, struct vjstat *vj)
+{
+    struct ppp_stats s;
+
+    if (strioctl(pppfd, PPPIO_GETSTAT, &s, 0, sizeof(s)) < 0) {
+	error("Couldn't get link statistics: %m");
+	return 0;
+    }
+    *vj = s.vj;
+    return 1;
+}
+
+/*
+ * ppp_bridge_channel - bridge our channel to another in the kernel.
+ */
+int
+ppp_bridge_channel(int fd)
+{
+    error("Channel bridging is not supported on this system");
+    return -1;
+}
+
 /*
  * ccp_fatal_error - returns 1 if decompression was disabled as a
  * result of an error detected after decompression of a packet,
@@ -1355,6 +1424,10 @@ sifup(int u)
 {
     struct ifreq ifr;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IP };
+	return (*iface_config_hook)(u, PPP_IFACE_UP, &c);
+    }
     strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
     if (ioctl(ipfd, SIOCGIFFLAGS, &ifr) < 0) {
 	error("Couldn't mark interface up (get): %m");
@@ -1377,6 +1450,10 @@ sifdown(int u)
 {
     struct ifreq ifr;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IP };
+	return (*iface_config_hook)(u, PPP_IFACE_DOWN, &c);
+    }
     if (ipmuxid < 0)
 	return 1;
     strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
@@ -1401,6 +1478,10 @@ sifnpmode(int u, int proto, enum NPmode mode)
 {
     int npi[2];
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = proto, .npmode = mode };
+	return (*iface_config_hook)(u, PPP_IFACE_NPMODE, &c);
+    }
     npi[0] = proto;
     npi[1] = (int) mode;
     if (strioctl(pppfd, PPPIO_NPMODE, &npi, 2 * sizeof(int), 0) < 0) {
@@ -1419,6 +1500,10 @@ sif6up(int u)
     struct lifreq lifr;
     int fd;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	return (*iface_config_hook)(u, PPP_IFACE_UP, &c);
+    }
     fd = socket(AF_INET6, SOCK_DGRAM, 0);
     if (fd < 0) {
 	return 0;
@@ -1452,6 +1537,10 @@ sif6down(int u)
     struct lifreq lifr;
     int fd;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	return (*iface_config_hook)(u, PPP_IFACE_DOWN, &c);
+    }
     fd = socket(AF_INET6, SOCK_DGRAM, 0);
     if (fd < 0)
 	return 0;
@@ -1486,6 +1575,13 @@ sif6addr(int u, eui64_t o, eui64_t h)
     struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&laddr;
     int fd;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	memcpy(c.ourid, o.e8, sizeof(c.ourid));
+	memcpy(c.hisid, h.e8, sizeof(c.hisid));
+	return (*iface_config_hook)(u, PPP_IFACE_ADDR6, &c);
+    }
+
     fd = socket(AF_INET6, SOCK_DGRAM, 0);
     if (fd < 0)
 	return 0;
@@ -1530,6 +1626,12 @@ sif6addr(int u, eui64_t o, eui64_t h)
 int
 cif6addr(int u, eui64_t o, eui64_t h)
 {
+    if (iface_config_hook) {
+	struct ppp_iface_config c = { .proto = PPP_IPV6 };
+	memcpy(c.ourid, o.e8, sizeof(c.ourid));
+	memcpy(c.hisid, h.e8, sizeof(c.hisid));
+	return (*iface_config_hook)(u, PPP_IFACE_CLEAR_ADDR6, &c);
+    }
     return 1;
 }
 
@@ -1604,6 +1706,13 @@ sifaddr(int u, u_int32_t o, u_int32_t h, u_int32_t m)
     struct ifreq ifr;
     int ret = 1;
 
+    if (iface_config_hook) {
+	struct ppp_iface_config c = {
+	    .proto = PPP_IP, .ouraddr = o, .hisaddr = h, .netmask = m
+	};
+	return (*iface_config_hook)(u, PPP_IFACE_ADDR, &c);
+    }
+
     memset(&ifr, 0, sizeof(ifr));
     strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
     ifr.ifr_addr.sa_family = AF_INET;
@@ -1649,6 +1758,12 @@ sifaddr(int u, u_int32_t o, u_int32_t h, u_int32_t m)
 int
 cifaddr(int u, u_int32_t o, u_int32_t h)
 {
+    if (iface_config_hook) {
+	struct ppp_iface_config c = {
+	    .proto = PPP_IP, .ouraddr = o, .hisaddr = h
+	};
+	return (*iface_config_hook)(u, PPP_IFACE_CLEAR_ADDR, &c);
+    }
 #if defined(__USLC__)		/* was: #if 0 */
     cifroute(unit, ouraddr, hisaddr);
     if (ipmuxid >= 0) {
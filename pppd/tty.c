@@ -90,6 +90,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <glob.h>
 
 #include "pppd-private.h"
 #include "options.h"
@@ -118,6 +119,8 @@ static int record_write(FILE *, int code, u_char *buf, int nb,
 			struct timeval *);
 static int open_socket(char *);
 static void maybe_relock(void *, int);
+static int open_tty(char *, int);
+static int claim_pool_device(void);
 
 static int pty_master;		/* fd for master side of pty */
 static int pty_slave;		/* fd for slave side of pty */
@@ -134,6 +137,7 @@ struct stat devstat;		/* result of stat() on devnam */
 
 /* option variables */
 char	devnam[MAXPATHLEN];	/* Device name */
+char	*device_pool = NULL;	/* Set of devices to choose one from */
 char	ppp_devname[MAXPATHLEN];/* name of PPP tty (maybe ttypx) */
 int	crtscts = 0;		/* Use hardware flow control */
 int	stop_bits = 1;		/* Number of serial port stop bits */
@@ -144,6 +148,9 @@ char	*initializer = NULL;	/* Script to initialize physical link */
 char	*connect_script = NULL;	/* Script to establish physical link */
 char	*disconnect_script = NULL; /* Script to disestablish physical link */
 char	*welcomer = NULL;	/* Script to run after phys link estab. */
+char	*modem_chat_script = NULL; /* Built-in dialler expect/send script */
+int	modem_timeout = 45;	/* Seconds to wait for each modem response */
+int	modem_retries = 2;	/* # times to resend an unanswered command */
 char	*ptycommand = NULL;	/* Command to run on other side of pty */
 bool	notty = 0;		/* Stdin/out is not a tty */
 char	*record_file = NULL;	/* File to record chars sent/received */
@@ -164,12 +171,16 @@ u_int32_t xmit_accm[8];		/* extended transmit ACCM */
 
 /* option descriptors */
 static struct option tty_options[] = {
-    /* device name must be first, or change connect_tty() below! */
+    /* device name and pool must be first, or change open_tty() below! */
     { "device name", o_wild, (void *) &setdevname,
       "Serial port device name",
       OPT_DEVNAM | OPT_PRIVFIX | OPT_NOARG  | OPT_A2STRVAL | OPT_STATIC,
       devnam},
 
+    { "device-pool", o_string, &device_pool,
+      "Set of serial ports to use the first free one of",
+      OPT_DEVNAM | OPT_PRIVFIX | OPT_PRIO },
+
     { "tty speed", o_wild, (void *) &setspeed,
       "Baud rate for serial port",
       OPT_PRIO | OPT_NOARG | OPT_A2STRVAL | OPT_STATIC, speed_str },
@@ -178,6 +189,9 @@ static struct option tty_options[] = {
       "Lock serial device with UUCP-style lock file", OPT_PRIO | 1 },
     { "nolock", o_bool, &lockflag,
       "Don't lock serial device", OPT_PRIOSUB | OPT_PRIV },
+    { "lock-manager", o_string, &lock_manager,
+      "Get device locks from the lock manager on this socket",
+      OPT_PRIO | OPT_PRIV },
 
     { "init", o_string, &initializer,
       "A program to initialize the device", OPT_PRIO | OPT_PRIVFIX },
@@ -191,6 +205,16 @@ static struct option tty_options[] = {
     { "welcome", o_string, &welcomer,
       "Script to welcome client", OPT_PRIO | OPT_PRIVFIX },
 
+    { "modem-chat", o_string, &modem_chat_script,
+      "Expect/send strings for built-in modem dialler",
+      OPT_PRIO | OPT_PRIVFIX },
+    { "modem-timeout", o_int, &modem_timeout,
+      "Seconds to wait for each response from the modem",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 1 },
+    { "modem-retries", o_int, &modem_retries,
+      "Number of times to resend a modem command with no response",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 0 },
+
     { "pty", o_string, &ptycommand,
       "Script to run on pseudo-tty master side",
       OPT_PRIO | OPT_PRIVFIX | OPT_DEVNAM },
@@ -462,6 +486,11 @@ void tty_process_extra_options(void)
 	using_pty = notty || ptycommand != NULL || pty_socket != NULL;
 	if (using_pty)
 		return;
+	if (device_pool != NULL) {
+		/* the device isn't known until we connect */
+		default_device = 0;
+		return;
+	}
 	if (default_device) {
 		char *p;
 		if (!isatty(0) || (p = ttyname(0)) == NULL) {
@@ -498,13 +527,18 @@ tty_check_options(void)
 		ppp_option_error("demand-dialling is incompatible with notty");
 		exit(EXIT_OPTION_ERROR);
 	}
-	if (demand && connect_script == 0 && ptycommand == NULL
-	    && pty_socket == NULL) {
+	if (demand && connect_script == 0 && modem_chat_script == NULL
+	    && ptycommand == NULL && pty_socket == NULL) {
 		ppp_option_error("connect script is required for demand-dialling\n");
 		exit(EXIT_OPTION_ERROR);
 	}
+	if (connect_script != NULL && modem_chat_script != NULL) {
+		ppp_option_error("connect and modem-chat options are mutually exclusive");
+		exit(EXIT_OPTION_ERROR);
+	}
 	/* default holdoff to 0 if no connect script has been given */
-	if (connect_script == 0 && !holdoff_specified)
+	if (connect_script == 0 && modem_chat_script == NULL
+	    && !holdoff_specified)
 		holdoff = 0;
 
 	if (using_pty) {
@@ -521,11 +555,21 @@ tty_check_options(void)
 			ppp_option_error("socket option is incompatible with pty and notty");
 			exit(EXIT_OPTION_ERROR);
 		}
+		if (device_pool != NULL) {
+			ppp_option_error("%s option is incompatible with device-pool",
+				     pty_socket? "socket": notty? "notty": "pty");
+			exit(EXIT_OPTION_ERROR);
+		}
 		default_device = notty;
 		lockflag = 0;
 		modem = 0;
 		if (notty && log_to_fd <= 1)
 			log_to_fd = -1;
+	} else if (device_pool != NULL) {
+		if (devnam[0] != 0) {
+			ppp_option_error("device-pool option precludes specifying device name");
+			exit(EXIT_OPTION_ERROR);
+		}
 	} else {
 		/*
 		 * If the user has specified a device which is the same as
@@ -561,13 +605,24 @@ tty_check_options(void)
  */
 int connect_tty(void)
 {
-	char *connector;
+	char *connector, *dialler;
 	int fdflags;
 #ifndef __linux__
 	struct stat statbuf;
 #endif
 	char numbuf[16];
 
+	/*
+	 * Pick a device from the pool, if we were given one.
+	 * This locks the device too.
+	 */
+	if (device_pool != NULL) {
+		if (claim_pool_device() < 0) {
+			ppp_set_status(EXIT_OPEN_FAILED);
+			return -1;
+		}
+	}
+
 	/*
 	 * Get a pty master/slave pair if the pty, notty, socket,
 	 * or record options were specified.
@@ -589,7 +644,7 @@ int connect_tty(void)
 	 * Lock the device if we've been asked to.
 	 */
 	ppp_set_status(EXIT_LOCK_FAILED);
-	if (lockflag && !privopen) {
+	if (lockflag && !privopen && !locked) {
 		if (lock(devnam) < 0)
 			goto errret;
 		locked = 1;
@@ -604,26 +659,15 @@ int connect_tty(void)
 	 */
 	got_sigterm = 0;
 	connector = doing_callback? callback_script: connect_script;
+	dialler = doing_callback? NULL: modem_chat_script;
 	if (devnam[0] != 0) {
 		for (;;) {
-			/* If the user specified the device name, become the
-			   user before opening it. */
-			int err, prio;
-
-			prio = privopen? OPRIO_ROOT: tty_options[0].priority;
-			if (prio < OPRIO_ROOT && seteuid(uid) == -1) {
-				error("Unable to drop privileges before opening %s: %m\n",
-				      devnam);
-				ppp_set_status(EXIT_OPEN_FAILED);
-				goto errret;
-			}
-			real_ttyfd = open(devnam, O_NONBLOCK | O_RDWR, 0);
+			int err;
+
+			real_ttyfd = open_tty(devnam, O_NONBLOCK | O_RDWR);
 			err = errno;
-			if (prio < OPRIO_ROOT && seteuid(0) == -1)
-				fatal("Unable to regain privileges");
 			if (real_ttyfd >= 0)
 				break;
-			errno = err;
 			if (err != EINTR) {
 				error("Failed to open %s: %m", devnam);
 				ppp_set_status(EXIT_OPEN_FAILED);
@@ -662,7 +706,7 @@ int connect_tty(void)
 		 * we could clear CLOCAL at this point.
 		 */
 		set_up_tty(ttyfd, ((connector != NULL && connector[0] != 0)
-				   || initializer != NULL));
+				   || initializer != NULL || dialler != NULL));
 	}
 
 	/*
@@ -722,7 +766,7 @@ int connect_tty(void)
 	}
 
 	/* run connection script */
-	if ((connector && connector[0]) || initializer) {
+	if ((connector && connector[0]) || initializer || dialler) {
 		if (real_ttyfd != -1) {
 			/* XXX do this if doing_callback == CALLBACK_DIALIN? */
 			if (!default_device && modem) {
@@ -745,7 +789,19 @@ int connect_tty(void)
 			info("Serial port initialized.");
 		}
 
-		if (connector && connector[0]) {
+		if (dialler != NULL) {
+			if (modem_chat(ttyfd, dialler, modem_timeout,
+				       modem_retries) < 0) {
+				error("Modem dialling failed");
+				ppp_set_status(EXIT_CONNECT_FAILED);
+				goto errretf;
+			}
+			if (got_sigterm) {
+				disconnect_tty();
+				goto errretf;
+			}
+			info("Serial connection established.");
+		} else if (connector && connector[0]) {
 			if (device_script(connector, ttyfd, ttyfd, 0) < 0) {
 				error("Connect script failed");
 				ppp_set_status(EXIT_CONNECT_FAILED);
@@ -768,7 +824,7 @@ int connect_tty(void)
 	}
 
 	/* reopen tty if necessary to wait for carrier */
-	if (connector == NULL && modem && devnam[0] != 0) {
+	if (connector == NULL && dialler == NULL && modem && devnam[0] != 0) {
 		int i;
 		for (;;) {
 			if ((i = open(devnam, O_RDWR)) >= 0)
@@ -893,6 +949,102 @@ finish_tty(void)
 	real_ttyfd = -1;
 }
 
+/*
+ * open_tty - open a serial device.  If the user specified the device
+ * name (or pool), become the user before opening it.
+ */
+static int
+open_tty(char *dev, int flags)
+{
+	int fd, err, prio;
+
+	prio = privopen? OPRIO_ROOT: tty_options[device_pool? 1: 0].priority;
+	if (prio < OPRIO_ROOT && seteuid(uid) == -1) {
+		error("Unable to drop privileges before opening %s: %m\n", dev);
+		errno = EPERM;
+		return -1;
+	}
+	fd = open(dev, flags, 0);
+	err = errno;
+	if (prio < OPRIO_ROOT && seteuid(0) == -1)
+		fatal("Unable to regain privileges");
+	errno = err;
+	return fd;
+}
+
+/*
+ * claim_pool_device - make the first device in device_pool which we
+ * can lock, and whose modem control lines say it is ready, our device.
+ * The pool is a list of device names or glob patterns separated by
+ * spaces or commas.  The device is unlocked again by cleanup_tty().
+ */
+static int
+claim_pool_device(void)
+{
+	glob_t gl;
+	struct stat statbuf;
+	char *pool, *word, *save, *dev;
+	char pattern[MAXPATHLEN];
+	int i, fd, ready, flags = 0;
+
+	pool = strdup(device_pool);
+	if (pool == NULL)
+		novm("device pool");
+	for (word = strtok_r(pool, " ,", &save); word != NULL;
+	     word = strtok_r(NULL, " ,", &save)) {
+		if (*word != '/')
+			slprintf(pattern, sizeof(pattern), "/dev/%s", word);
+		else
+			strlcpy(pattern, word, sizeof(pattern));
+		if (glob(pattern, flags, NULL, &gl) == 0)
+			flags = GLOB_APPEND;
+	}
+	free(pool);
+	if (flags == 0) {
+		error("No devices found in device pool %s", device_pool);
+		return -1;
+	}
+
+	for (i = 0; i < gl.gl_pathc; ++i) {
+		dev = gl.gl_pathv[i];
+		if (stat(dev, &statbuf) < 0 || !S_ISCHR(statbuf.st_mode))
+			continue;
+		if (lockflag && !privopen && lock(dev) < 0)
+			continue;
+
+		/*
+		 * A non-blocking open doesn't wait for carrier, so this
+		 * is quick even for ports with nothing attached.
+		 */
+		ready = 1;
+		if (modem) {
+			fd = open_tty(dev, O_NONBLOCK | O_RDWR | O_NOCTTY);
+			if (fd < 0)
+				ready = 0;
+			else {
+				ready = tty_ready(fd, connect_script == NULL);
+				close(fd);
+			}
+		}
+		if (ready) {
+			if (lockflag && !privopen)
+				locked = 1;
+			strlcpy(devnam, dev, sizeof(devnam));
+			devstat = statbuf;
+			globfree(&gl);
+			info("Using %s from device pool", devnam);
+			ppp_script_setenv("DEVICE", devnam, 1);
+			return 0;
+		}
+		if (lockflag && !privopen)
+			unlock();
+		dbglog("Device %s in pool is not ready", dev);
+	}
+	globfree(&gl);
+	error("No free device in device pool %s", device_pool);
+	return -1;
+}
+
 /*
  * maybe_relock - our PID has changed, maybe update the lock file.
  */
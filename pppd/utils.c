@@ -49,6 +49,8 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
 #include <netinet/in.h>
 #ifdef SVR4
 #include <sys/mkdev.h>
@@ -886,50 +888,35 @@ mkdir_recursive(const char *path)
 
 /* Procedures for locking the serial device using a lock file. */
 static char lock_file[MAXPATHLEN];
+static int lock_fd = -1;	/* fd holding the flock on lock_file */
+static int lockmgr_fd = -1;	/* connection to the lock manager */
 
+char *lock_manager = NULL;	/* socket of the lock manager, if any */
+
+#ifndef LOCKLIB
 /*
- * lock - create a lock file for the named device
+ * lock_name - work out the name of the lock file for a device.
+ * Returns the short device name used in log messages, or NULL.
  */
-int
-lock(char *dev)
+static char *
+lock_name(char *dev, char *lockdev, char *buf, int buflen)
 {
-#ifdef LOCKLIB
-    int result;
-
-    result = mklock (dev, (void *) 0);
-    if (result == 0) {
-	strlcpy(lock_file, dev, sizeof(lock_file));
-	return 0;
-    }
-
-    if (result > 0)
-        notice("Device %s is locked by pid %d", dev, result);
-    else
-	error("Can't create lock file %s", lock_file);
-    return -1;
-
-#else /* LOCKLIB */
-
-    char lock_buffer[12];
-    int fd, pid, n, siz;
-
 #ifdef SVR4
     struct stat sbuf;
 
     if (stat(dev, &sbuf) < 0) {
 	error("Can't get device number for %s: %m", dev);
-	return -1;
+	return NULL;
     }
     if ((sbuf.st_mode & S_IFMT) != S_IFCHR) {
 	error("Can't lock %s: not a character device", dev);
-	return -1;
+	return NULL;
     }
-    slprintf(lock_file, sizeof(lock_file), "%s/LK.%03d.%03d.%03d",
+    slprintf(buf, buflen, "%s/LK.%03d.%03d.%03d",
 	     PPP_PATH_LOCKDIR, major(sbuf.st_dev),
 	     major(sbuf.st_rdev), minor(sbuf.st_rdev));
 #else
     char *p;
-    char lockdev[MAXPATHLEN];
 
     if ((p = strstr(dev, "dev/")) != NULL) {
 	dev = p + 4;
@@ -943,8 +930,226 @@ lock(char *dev)
 	if ((p = strrchr(dev, '/')) != NULL)
 	    dev = p + 1;
 
-    slprintf(lock_file, sizeof(lock_file), "%s/LCK..%s", PPP_PATH_LOCKDIR, dev);
+    slprintf(buf, buflen, "%s/LCK..%s", PPP_PATH_LOCKDIR, dev);
 #endif
+    return dev;
+}
+
+/*
+ * read_lock_pid - read the pid stored in a lock file.
+ * Returns the pid, or -1 if it couldn't be read.
+ */
+static int
+read_lock_pid(int fd)
+{
+    int n, pid;
+#ifndef LOCK_BINARY
+    char lock_buffer[12];
+
+    n = pread(fd, lock_buffer, 11, 0);
+    if (n <= 0)
+	return -1;
+    lock_buffer[n] = 0;
+    pid = atoi(lock_buffer);
+#else
+    n = pread(fd, &pid, sizeof(pid), 0);
+    if (n != sizeof(pid))
+	return -1;
+#endif /* LOCK_BINARY */
+    return pid;
+}
+
+/*
+ * write_lock_pid - store a pid in a lock file, in the legacy format.
+ */
+static int
+write_lock_pid(int fd, int pid)
+{
+    int n, siz;
+#ifndef LOCK_BINARY
+    char lock_buffer[12];
+
+    siz = 11;
+    slprintf(lock_buffer, sizeof(lock_buffer), "%10d\n", pid);
+    n = pwrite(fd, lock_buffer, siz, 0);
+#else
+    siz = sizeof(pid);
+    n = pwrite(fd, &pid, siz, 0);
+#endif /* LOCK_BINARY */
+    if (n != siz) {
+	error("Could not write pid to lock file when locking");
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * lockmgr_request - send a request to the lock manager and read
+ * its one-line reply into buf.  Returns 0 on success, -1 on error.
+ */
+static int
+lockmgr_request(const char *req, char *buf, int buflen)
+{
+    int n, len = 0;
+
+    if (write(lockmgr_fd, req, strlen(req)) != (ssize_t) strlen(req)) {
+	error("Couldn't send request to lock manager: %m");
+	return -1;
+    }
+    while (len < buflen - 1) {
+	n = read(lockmgr_fd, buf + len, 1);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0) {
+	    error("Lock manager closed connection");
+	    return -1;
+	}
+	if (buf[len] == '\n')
+	    break;
+	++len;
+    }
+    buf[len] = 0;
+    return 0;
+}
+
+/*
+ * lock_from_manager - ask the lock manager at lock_manager to lock
+ * the device for us.  The manager holds the lock (and keeps the
+ * UUCP-style lock file up to date) for as long as our connection to
+ * it stays open.
+ */
+static int
+lock_from_manager(char *dev)
+{
+    struct sockaddr_un addr;
+    char req[MAXPATHLEN + 32], reply[64];
+
+    if (strlen(lock_manager) >= sizeof(addr.sun_path)) {
+	error("Lock manager socket name %s is too long", lock_manager);
+	return -1;
+    }
+    lockmgr_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lockmgr_fd < 0) {
+	error("Can't create socket for lock manager: %m");
+	return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, lock_manager, sizeof(addr.sun_path));
+    if (connect(lockmgr_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+	error("Can't connect to lock manager %s: %m", lock_manager);
+	goto fail;
+    }
+
+    slprintf(req, sizeof(req), "LOCK %s %d\n", lock_file, getpid());
+    if (lockmgr_request(req, reply, sizeof(reply)) < 0)
+	goto fail;
+    if (strcmp(reply, "OK") == 0)
+	return 0;
+    if (strncmp(reply, "BUSY ", 5) == 0)
+	notice("Device %s is locked by pid %d", dev, atoi(reply + 5));
+    else
+	error("Lock manager refused to lock %s: %s", dev, reply);
+
+ fail:
+    close(lockmgr_fd);
+    lockmgr_fd = -1;
+    return -1;
+}
+#endif /* LOCKLIB */
+
+/*
+ * lock - create a lock file for the named device
+ */
+int
+lock(char *dev)
+{
+#ifdef LOCKLIB
+    int result;
+
+    result = mklock (dev, (void *) 0);
+    if (result == 0) {
+	strlcpy(lock_file, dev, sizeof(lock_file));
+	return 0;
+    }
+
+    if (result > 0)
+        notice("Device %s is locked by pid %d", dev, result);
+    else
+	error("Can't create lock file %s", lock_file);
+    return -1;
+
+#else /* LOCKLIB */
+
+    int fd, pid;
+    char lockdev[MAXPATHLEN];
+#ifdef LOCK_NB
+    struct stat fsbuf, sbuf;
+#endif
+
+    dev = lock_name(dev, lockdev, lock_file, sizeof(lock_file));
+    if (dev == NULL) {
+	lock_file[0] = 0;
+	return -1;
+    }
+
+    if (lock_manager != NULL) {
+	if (lock_from_manager(dev) < 0) {
+	    lock_file[0] = 0;
+	    return -1;
+	}
+	return 0;
+    }
+
+#ifdef LOCK_NB
+    /*
+     * Fast path: take an flock on the lock file.  The lock is released
+     * by the kernel when we exit, so a failure to get it means the
+     * device really is in use and there's no need to go looking for
+     * the owner.  We still write our pid into the file, and honour a
+     * live pid left there by a locker that doesn't use flock.
+     */
+    for (;;) {
+	fd = open(lock_file, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+	if (fd < 0) {
+	    error("Can't create lock file %s: %m", lock_file);
+	    break;
+	}
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+	    if (errno != EWOULDBLOCK)
+		error("Can't lock %s: %m", lock_file);
+	    else if ((pid = read_lock_pid(fd)) > 0)
+		notice("Device %s is locked by pid %d", dev, pid);
+	    else
+		notice("Device %s is locked", dev);
+	    close(fd);
+	    fd = -1;
+	    break;
+	}
+
+	/* Make sure nobody removed the file before we got the lock. */
+	if (fstat(fd, &fsbuf) < 0 || stat(lock_file, &sbuf) < 0
+	    || fsbuf.st_ino != sbuf.st_ino || fsbuf.st_dev != sbuf.st_dev) {
+	    close(fd);
+	    continue;
+	}
+
+	pid = read_lock_pid(fd);
+	if (pid <= 0 || pid == getpid())
+	    break;
+	if (kill(pid, 0) == -1 && errno == ESRCH) {
+	    notice("Removed stale lock on %s (pid %d)", dev, pid);
+	    if (ftruncate(fd, 0) < 0)
+		warn("Couldn't truncate lock file %s: %m", lock_file);
+	    break;
+	}
+	notice("Device %s is locked by pid %d", dev, pid);
+	close(fd);
+	fd = -1;
+	break;
+    }
+
+#else /* LOCK_NB */
 
     while ((fd = open(lock_file, O_EXCL | O_CREAT | O_RDWR, 0644)) < 0) {
 	if (errno != EEXIST) {
@@ -960,23 +1165,15 @@ lock(char *dev)
 	    error("Can't open existing lock file %s: %m", lock_file);
 	    break;
 	}
-#ifndef LOCK_BINARY
-	n = read(fd, lock_buffer, 11);
-#else
-	n = read(fd, &pid, sizeof(pid));
-#endif /* LOCK_BINARY */
+	pid = read_lock_pid(fd);
 	close(fd);
 	fd = -1;
-	if (n <= 0) {
+	if (pid < 0) {
 	    error("Can't read pid from lock file %s", lock_file);
 	    break;
 	}
 
 	/* See if the process still exists. */
-#ifndef LOCK_BINARY
-	lock_buffer[n] = 0;
-	pid = atoi(lock_buffer);
-#endif /* LOCK_BINARY */
 	if (pid == getpid())
 	    return 1;		/* somebody else locked it for us */
 	if (pid == 0
@@ -990,25 +1187,19 @@ lock(char *dev)
 	    notice("Device %s is locked by pid %d", dev, pid);
 	break;
     }
+#endif /* LOCK_NB */
 
     if (fd < 0) {
 	lock_file[0] = 0;
 	return -1;
     }
 
-    pid = getpid();
-#ifndef LOCK_BINARY
-    siz = 11;
-    slprintf(lock_buffer, sizeof(lock_buffer), "%10d\n", pid);
-    n = write (fd, lock_buffer, siz);
+    write_lock_pid(fd, getpid());
+#ifdef LOCK_NB
+    lock_fd = fd;		/* keep it open to hold the flock */
 #else
-    siz = sizeof (pid);
-    n = write(fd, &pid, siz);
-#endif
-    if (n != siz) {
-	error("Could not write pid to lock file when locking");
-    }
     close(fd);
+#endif
     return 0;
 
 #endif
@@ -1031,29 +1222,37 @@ relock(int pid)
     return -1;
 #else /* LOCKLIB */
 
-    int fd, n, siz;
-    char lock_buffer[12];
+    int fd;
+    char req[32], reply[64];
 
     if (lock_file[0] == 0)
 	return -1;
+
+    if (lockmgr_fd >= 0) {
+	slprintf(req, sizeof(req), "RELOCK %d\n", pid);
+	if (lockmgr_request(req, reply, sizeof(reply)) < 0
+	    || strcmp(reply, "OK") != 0) {
+	    error("Lock manager couldn't update lock on %s", lock_file);
+	    return -1;
+	}
+	return 0;
+    }
+
+    if (lock_fd >= 0) {
+	/* We still hold the flock; just rewrite the pid. */
+	if (ftruncate(lock_fd, 0) < 0)
+	    warn("Couldn't truncate lock file %s: %m", lock_file);
+	write_lock_pid(lock_fd, pid);
+	return 0;
+    }
+
     fd = open(lock_file, O_WRONLY, 0);
     if (fd < 0) {
 	error("Couldn't reopen lock file %s: %m", lock_file);
 	lock_file[0] = 0;
 	return -1;
     }
-
-#ifndef LOCK_BINARY
-    siz = 11;
-    slprintf(lock_buffer, sizeof(lock_buffer), "%10d\n", pid);
-    n = write (fd, lock_buffer, siz);
-#else
-    siz = sizeof(pid);
-    n = write(fd, &pid, siz);
-#endif /* LOCK_BINARY */
-    if (n != siz) {
-	error("Could not write pid to lock file when locking");
-    }
+    write_lock_pid(fd, pid);
     close(fd);
     return 0;
 
@@ -1070,9 +1269,18 @@ unlock(void)
 #ifdef LOCKLIB
 	(void) rmlock(lock_file, (void *) 0);
 #else
-	unlink(lock_file);
+	if (lockmgr_fd >= 0) {
+	    /* closing the connection releases the lock */
+	    close(lockmgr_fd);
+	    lockmgr_fd = -1;
+	} else {
+	    unlink(lock_file);
+	    if (lock_fd >= 0) {
+		close(lock_fd);
+		lock_fd = -1;
+	    }
+	}
 #endif
 	lock_file[0] = 0;
     }
 }
-
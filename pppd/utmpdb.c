@@ -0,0 +1,235 @@
+/*
+ * utmpdb.c - login records kept in the pppd database.
+ *
+ * Copyright (c) 2007 Diego Rivera. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * 3. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Paul Mackerras
+ *     <paulus@ozlabs.org>".
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * With thousands of sessions, the utmp file gets large, and pppd's
+ * login and logout each scan it under an exclusive lock.  Instead we
+ * can keep the login records in the pppd database keyed by line, and
+ * queue the wtmp records so that they are appended to wtmp several at
+ * a time.  These routines are shared by pppd and by pppd-utmp, which
+ * produces a utmp file from the records for who(1) and friends.
+ * They return -1 on error with errno set, and don't log anything.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/file.h>
+
+#include "utmpdb.h"
+
+static void
+utmpdb_key(TDB_DATA *key, char *buf, int len, const struct utmp *ut)
+{
+    int n;
+
+    n = strlen(UTMPDB_KEY_PREFIX);
+    memcpy(buf, UTMPDB_KEY_PREFIX, n);
+    strncpy(buf + n, ut->ut_line, len - n - 1);
+    buf[len - 1] = 0;
+    key->dptr = buf;
+    key->dsize = strlen(buf);
+}
+
+/*
+ * utmpdb_update - record a login on ut->ut_line, or if ut->ut_user is
+ * empty, remove the record of the login there.
+ */
+int
+utmpdb_update(TDB_CONTEXT *db, const struct utmp *ut)
+{
+    TDB_DATA key, rec;
+    char kbuf[sizeof(UTMPDB_KEY_PREFIX) + sizeof(ut->ut_line)];
+
+    utmpdb_key(&key, kbuf, sizeof(kbuf), ut);
+    if (ut->ut_user[0] == 0) {
+	tdb_delete(db, key);
+	return 0;
+    }
+    rec.dptr = (char *) ut;
+    rec.dsize = sizeof(*ut);
+    return tdb_store(db, key, rec, TDB_REPLACE) == 0? 0: -1;
+}
+
+/*
+ * write_wtmp - append some records to the wtmp file.
+ */
+static int
+write_wtmp(const char *wtmp_file, const char *recs, int len)
+{
+    int fd, n, ret = 0;
+
+    fd = open(wtmp_file, O_APPEND | O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+	return -1;
+    flock(fd, LOCK_EX);
+    n = write(fd, recs, len);
+    if (n != len) {
+	if (n >= 0)
+	    errno = ENOSPC;
+	ret = -1;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    return ret;
+}
+
+/*
+ * flush_locked - write out the queued records, keeping them queued
+ * if that fails.  The caller holds the lock on the queue.
+ */
+static int
+flush_locked(TDB_CONTEXT *db, TDB_DATA key, TDB_DATA queue,
+	     const char *wtmp_file)
+{
+    if (write_wtmp(wtmp_file, queue.dptr, queue.dsize) < 0) {
+	tdb_store(db, key, queue, TDB_REPLACE);
+	return -1;
+    }
+    tdb_delete(db, key);
+    return 0;
+}
+
+/*
+ * utmpdb_queue_wtmp - add a record to the queue for wtmp.  The queue
+ * is written out once it holds batch records, or when its first
+ * record has waited WTMPDB_MAX_AGE seconds.
+ */
+int
+utmpdb_queue_wtmp(TDB_CONTEXT *db, const struct utmp *ut, int batch,
+		  const char *wtmp_file)
+{
+    TDB_DATA key, queue, nq;
+    struct utmp first;
+    int ret = 0;
+
+    if (batch <= 1)
+	return write_wtmp(wtmp_file, (const char *) ut, sizeof(*ut));
+
+    key.dptr = WTMPDB_QUEUE_KEY;
+    key.dsize = strlen(WTMPDB_QUEUE_KEY);
+    if (tdb_chainlock(db, key) < 0)
+	return -1;
+
+    queue = tdb_fetch(db, key);
+    if (queue.dptr != NULL && queue.dsize % sizeof(*ut) != 0) {
+	/* shouldn't happen; throw away the rubbish */
+	free(queue.dptr);
+	queue.dptr = NULL;
+	queue.dsize = 0;
+    }
+    nq.dsize = queue.dsize + sizeof(*ut);
+    nq.dptr = malloc(nq.dsize);
+    if (nq.dptr == NULL) {
+	free(queue.dptr);
+	tdb_chainunlock(db, key);
+	return write_wtmp(wtmp_file, (const char *) ut, sizeof(*ut));
+    }
+    if (queue.dsize)
+	memcpy(nq.dptr, queue.dptr, queue.dsize);
+    memcpy(nq.dptr + queue.dsize, ut, sizeof(*ut));
+    free(queue.dptr);
+
+    memcpy(&first, nq.dptr, sizeof(first));
+    if (nq.dsize >= batch * sizeof(*ut)
+	|| time(NULL) - first.ut_tv.tv_sec >= WTMPDB_MAX_AGE)
+	ret = flush_locked(db, key, nq, wtmp_file);
+    else if (tdb_store(db, key, nq, TDB_REPLACE) != 0)
+	ret = write_wtmp(wtmp_file, (const char *) ut, sizeof(*ut));
+
+    free(nq.dptr);
+    tdb_chainunlock(db, key);
+    return ret;
+}
+
+/*
+ * utmpdb_flush_wtmp - write out any queued records now.
+ */
+int
+utmpdb_flush_wtmp(TDB_CONTEXT *db, const char *wtmp_file)
+{
+    TDB_DATA key, queue;
+    int ret = 0;
+
+    key.dptr = WTMPDB_QUEUE_KEY;
+    key.dsize = strlen(WTMPDB_QUEUE_KEY);
+    if (tdb_chainlock(db, key) < 0)
+	return -1;
+    queue = tdb_fetch(db, key);
+    if (queue.dptr != NULL) {
+	ret = flush_locked(db, key, queue, wtmp_file);
+	free(queue.dptr);
+    }
+    tdb_chainunlock(db, key);
+    return ret;
+}
+
+struct export_state {
+    int fd;
+    int err;
+};
+
+static int
+export_one(TDB_CONTEXT *db, TDB_DATA key, TDB_DATA rec, void *arg)
+{
+    struct export_state *st = arg;
+    int n = strlen(UTMPDB_KEY_PREFIX);
+
+    if (key.dsize <= n || memcmp(key.dptr, UTMPDB_KEY_PREFIX, n) != 0
+	|| rec.dsize != sizeof(struct utmp))
+	return 0;
+    if (write(st->fd, rec.dptr, rec.dsize) != rec.dsize) {
+	st->err = 1;
+	return 1;		/* stop the traversal */
+    }
+    return 0;
+}
+
+/*
+ * utmpdb_export - write all the login records to fd, as a utmp file.
+ */
+int
+utmpdb_export(TDB_CONTEXT *db, int fd)
+{
+    struct export_state st;
+
+    st.fd = fd;
+    st.err = 0;
+    if (tdb_traverse(db, export_one, &st) < 0 || st.err)
+	return -1;
+    return 0;
+}
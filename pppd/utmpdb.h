@@ -0,0 +1,55 @@
+/*
+ * utmpdb.h - login records kept in the pppd database.
+ *
+ * Copyright (c) 2007 Diego Rivera. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * 3. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Paul Mackerras
+ *     <paulus@ozlabs.org>".
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PPP_UTMPDB_H
+#define PPP_UTMPDB_H
+
+#include <utmp.h>
+#include "tdb.h"
+
+/*
+ * The login record for each line is stored under "utmp:<line>", so
+ * finding it is a hash lookup rather than a scan of the utmp file.
+ * Records bound for wtmp are queued under WTMPDB_QUEUE_KEY and written
+ * out together.
+ */
+#define UTMPDB_KEY_PREFIX	"utmp:"
+#define WTMPDB_QUEUE_KEY	"wtmp:queue"
+
+/* How long a record may wait in the queue before it is written */
+#define WTMPDB_MAX_AGE		10	/* seconds */
+
+int utmpdb_update(TDB_CONTEXT *db, const struct utmp *ut);
+int utmpdb_queue_wtmp(TDB_CONTEXT *db, const struct utmp *ut, int batch,
+		      const char *wtmp_file);
+int utmpdb_flush_wtmp(TDB_CONTEXT *db, const char *wtmp_file);
+int utmpdb_export(TDB_CONTEXT *db, int fd);
+
+#endif /* PPP_UTMPDB_H */